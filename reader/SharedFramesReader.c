@@ -0,0 +1,117 @@
+//
+//  SharedFramesReader.c
+//  fluidSimulation
+//
+
+#include "SharedFramesReader.h"
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int sharedFramesOpen(struct SharedFramesReader *reader, const char *name) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fileDescriptor = -1;
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return -1;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < (off_t) sizeof(struct SharedFramesHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    void *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    reader->fileDescriptor = fd;
+    reader->segment = (const unsigned char *) mapping;
+    reader->segmentSize = status.st_size;
+    reader->header = (const struct SharedFramesHeader *) mapping;
+
+    // the writer stores the magic last, so the rest of the header is in place once it shows
+    const struct SharedFramesHeader *header = reader->header;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHARED_FRAMES_MAGIC
+        || header->version != SHARED_FRAMES_VERSION
+        || header->particleSize != sizeof(struct SharedFramesParticle)
+        || header->segmentSize > reader->segmentSize
+        || header->headerSize + (uint64_t) header->slotCount * header->slotSize > header->segmentSize) {
+        sharedFramesClose(reader);
+        return -1;
+    }
+
+    reader->lastPublished = 0;
+    return 0;
+}
+
+void sharedFramesClose(struct SharedFramesReader *reader) {
+    if (reader->segment != NULL) {
+        munmap((void *) reader->segment, reader->segmentSize);
+    }
+    if (reader->fileDescriptor >= 0) {
+        close(reader->fileDescriptor);
+    }
+    memset(reader, 0, sizeof(*reader));
+    reader->fileDescriptor = -1;
+}
+
+int sharedFramesLatest(struct SharedFramesReader *reader, struct SharedFramesView *view) {
+    const struct SharedFramesHeader *header = reader->header;
+    if (header == NULL) return -1;
+
+    // a slot taken over by the writer between the two loads is tried again with the newer publish
+    for (int attempt = 0; attempt < 8; attempt++) {
+        uint64_t published = __atomic_load_n(&header->publishedCount, __ATOMIC_ACQUIRE);
+        if (published == 0 || published == reader->lastPublished) {
+            return __atomic_load_n(&header->writerActive, __ATOMIC_ACQUIRE) ? 0 : -1;
+        }
+
+        uint64_t publish = published - 1;
+        const unsigned char *slotData = reader->segment + header->headerSize + (publish % header->slotCount) * header->slotSize;
+        const struct SharedFramesSlot *slot = (const struct SharedFramesSlot *) slotData;
+
+        uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence != publish * 2 + 2) continue;
+
+        view->publish = publish;
+        view->skipped = publish - reader->lastPublished;
+        view->step = slot->step;
+        view->timeMicros = slot->timeMicros;
+        view->particleCount = slot->particleCount < header->particleCapacity ? slot->particleCount : header->particleCapacity;
+        view->particles = (const struct SharedFramesParticle *) (slotData + header->particlesOffset);
+        view->frame = slot->hasFrame ? slotData + header->frameOffset : NULL;
+        view->frameWidth = header->frameWidth;
+        view->frameHeight = header->frameHeight;
+        view->slot = slot;
+        view->sequence = sequence;
+
+        reader->lastPublished = published;
+        return 1;
+    }
+
+    return 0;
+}
+
+int sharedFramesWait(struct SharedFramesReader *reader, struct SharedFramesView *view, uint64_t timeoutMicros) {
+    struct timespec pause = { 0, 200000 };
+    uint64_t waited = 0;
+
+    for (;;) {
+        int result = sharedFramesLatest(reader, view);
+        if (result != 0 || waited >= timeoutMicros) return result;
+        nanosleep(&pause, NULL);
+        waited += pause.tv_nsec / 1000;
+    }
+}
+
+int sharedFramesValid(const struct SharedFramesView *view) {
+    // reads of the data are ordered before the sequence is checked again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&view->slot->sequence, __ATOMIC_RELAXED) == view->sequence;
+}
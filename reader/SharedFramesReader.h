@@ -0,0 +1,63 @@
+//
+//  SharedFramesReader.h
+//  fluidSimulation
+//
+
+#ifndef SharedFramesReader_h
+#define SharedFramesReader_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "SharedFrames.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// reads the particles and frames the simulation publishes into shared memory. a view points straight
+// into the segment, nothing is copied, so check it is still valid after using it: the writer may have
+// come round the ring and refilled the slot in the meantime
+struct SharedFramesReader {
+    int fileDescriptor;
+    const unsigned char *segment;
+    size_t segmentSize;
+    const struct SharedFramesHeader *header;
+    uint64_t lastPublished;
+};
+
+struct SharedFramesView {
+    uint64_t publish;
+    uint64_t skipped;
+    uint64_t step;
+    uint64_t timeMicros;
+    uint32_t particleCount;
+    const struct SharedFramesParticle *particles;
+
+    // null when the step was published without a frame
+    const unsigned char *frame;
+    uint32_t frameWidth;
+    uint32_t frameHeight;
+
+    const struct SharedFramesSlot *slot;
+    uint64_t sequence;
+};
+
+// 0 on success, -1 when there is no segment by that name or it is not a known layout
+int sharedFramesOpen(struct SharedFramesReader *reader, const char *name);
+void sharedFramesClose(struct SharedFramesReader *reader);
+
+// 1 and a view of the newest publish when there is one the reader has not returned yet,
+// 0 when there is nothing new, -1 once the writer has stopped
+int sharedFramesLatest(struct SharedFramesReader *reader, struct SharedFramesView *view);
+
+// polls for a new publish for up to timeoutMicros, same results as sharedFramesLatest
+int sharedFramesWait(struct SharedFramesReader *reader, struct SharedFramesView *view, uint64_t timeoutMicros);
+
+// 1 when the slot behind the view has not been rewritten since the view was taken
+int sharedFramesValid(const struct SharedFramesView *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SharedFramesReader_h */
@@ -0,0 +1,90 @@
+//
+//  sharedFramesCheck.c
+//  fluidSimulation
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "SharedFramesReader.h"
+
+// follows a running simulation for a while and checks every publish it gets hold of:
+// steps only move forward, particles are in pool order inside the capacity with finite values,
+// and nothing was rewritten under the reader. exits nonzero when anything is off
+int main(int argc, char **argv) {
+    const char *name = argc > 1 ? argv[1] : SHARED_FRAMES_NAME;
+    double seconds = argc > 2 ? atof(argv[2]) : 10.0;
+
+    struct SharedFramesReader reader;
+    struct timespec pause = { 0, 100000000 };
+    int opened = -1;
+    for (int attempt = 0; attempt < 50 && opened != 0; attempt++) {
+        opened = sharedFramesOpen(&reader, name);
+        if (opened != 0) nanosleep(&pause, NULL);
+    }
+    if (opened != 0) {
+        fprintf(stderr, "no shared frames at %s\n", name);
+        return 1;
+    }
+
+    printf("%s: %u slots, %u particles, %ux%u frames\n", name, reader.header->slotCount,
+        reader.header->particleCapacity, reader.header->frameWidth, reader.header->frameHeight);
+
+    uint64_t publishes = 0, skipped = 0, torn = 0, frames = 0, errors = 0;
+    uint64_t lastStep = 0, particles = 0;
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (;;) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+        if (elapsed >= seconds) break;
+
+        struct SharedFramesView view;
+        int result = sharedFramesWait(&reader, &view, 100000);
+        if (result < 0) {
+            printf("writer stopped\n");
+            break;
+        }
+        if (result == 0) continue;
+
+        int bad = 0;
+        if (publishes > 0 && view.step < lastStep) bad = 1;
+
+        for (uint32_t i = 0; i < view.particleCount; i++) {
+            const struct SharedFramesParticle *particle = &view.particles[i];
+            if (i > 0 && particle->index <= view.particles[i - 1].index) bad = 1;
+            for (int k = 0; k < 3; k++) {
+                if (!isfinite(particle->position[k]) || !isfinite(particle->velocity[k])) bad = 1;
+            }
+        }
+
+        uint64_t checksum = 0;
+        if (view.frame != NULL) {
+            size_t frameSize = (size_t) view.frameWidth * view.frameHeight * 4;
+            for (size_t k = 0; k < frameSize; k += 4096) checksum += view.frame[k];
+        }
+
+        // what was read is only trusted when the slot still holds the same publish
+        if (!sharedFramesValid(&view)) {
+            torn++;
+            continue;
+        }
+
+        publishes++;
+        skipped += view.skipped;
+        frames += view.frame != NULL;
+        particles += view.particleCount;
+        errors += bad;
+        lastStep = view.step;
+        (void) checksum;
+    }
+
+    printf("publishes %llu, skipped %llu, rewritten while read %llu, with frames %llu, mean particles %.0f, errors %llu\n",
+        (unsigned long long) publishes, (unsigned long long) skipped, (unsigned long long) torn,
+        (unsigned long long) frames, publishes ? (double) particles / publishes : 0.0, (unsigned long long) errors);
+
+    sharedFramesClose(&reader);
+    return errors == 0 && publishes > 0 ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+//
+//  Checkpoint.hpp
+//  fluidSimulation
+//
+
+#ifndef Checkpoint_hpp
+#define Checkpoint_hpp
+
+#include <stdint.h>
+
+// binary snapshot layout, a fixed header followed by one record per particle.
+// fields are only ever appended, readers skip headerSize and recordSize bytes
+// so older builds can still load newer files of the same version
+#define CHECKPOINT_MAGIC "FLUIDCKP"
+#define CHECKPOINT_VERSION 1
+
+enum checkpointFlags {
+    CHECKPOINT_CIRCLE_BOUNDARY = 1 << 0,
+    CHECKPOINT_IMPLICIT_VISCOSITY = 1 << 1,
+    CHECKPOINT_INCREMENTAL_SORT = 1 << 2,
+    CHECKPOINT_PAIR_CACHE = 1 << 3
+};
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordSize;
+    uint32_t particleCount;
+    
+    // random state
+    uint64_t seed;
+    uint32_t stepCount, resetCount, spawnCount;
+    uint32_t flags;
+    
+    // solver settings
+    int32_t solverMode, neighborMode, solverIterations, viscosityIterations;
+    int32_t systemWidth, systemHeight;
+    float radius, deltaTime, predictionFactor, collisionDamping;
+    float gravityMultiplier, gravityForceX, gravityForceY;
+    float targetDensity, pressureMultiplier, nearPressureMultiplier, viscosityStrength;
+    float boundsSizeX, boundsSizeY, boundsSizeZ, circleBoundaryRadius;
+    float verletSkin, solverTolerance;
+    float solverRestDensity;
+};
+
+struct CheckpointParticle {
+    float position[3];
+    float velocity[3];
+    float density, nearDensity;
+};
+
+static_assert(sizeof(CheckpointHeader) == 144, "checkpoint header layout changed");
+static_assert(sizeof(CheckpointParticle) == 32, "checkpoint particle layout changed");
+
+#endif /* Checkpoint_hpp */
@@ -0,0 +1,114 @@
+//
+//  CompactHash3D.cpp
+//  fluidSimulation
+//
+
+#include "CompactHash3D.hpp"
+#include "tbb/parallel_for.h"
+#include "tbb/parallel_sort.h"
+
+// 21 bits per axis, cells are offset so negative coordinates keep their order
+#define MORTON_BITS 21
+#define MORTON_BIAS (1 << (MORTON_BITS - 1))
+
+CompactHash3D::CompactHash3D() {
+}
+
+CompactHash3D::Cell CompactHash3D::positionToCell(ofVec3f position, float cellSize) {
+    Cell cell;
+    cell.x = ofClamp(floor(position.x / cellSize), -MORTON_BIAS, MORTON_BIAS - 1);
+    cell.y = ofClamp(floor(position.y / cellSize), -MORTON_BIAS, MORTON_BIAS - 1);
+    cell.z = ofClamp(floor(position.z / cellSize), -MORTON_BIAS, MORTON_BIAS - 1);
+    return cell;
+}
+
+static uint64_t spreadBits(uint64_t value) {
+    // puts two zero bits between each of the low 21 bits
+    value &= 0x1fffff;
+    value = (value | value << 32) & 0x1f00000000ffff;
+    value = (value | value << 16) & 0x1f0000ff0000ff;
+    value = (value | value << 8) & 0x100f00f00f00f00f;
+    value = (value | value << 4) & 0x10c30c30c30c30c3;
+    value = (value | value << 2) & 0x1249249249249249;
+    return value;
+}
+
+uint64_t CompactHash3D::getMortonKey(Cell cell) {
+    uint64_t x = spreadBits(uint64_t(cell.x + MORTON_BIAS));
+    uint64_t y = spreadBits(uint64_t(cell.y + MORTON_BIAS));
+    uint64_t z = spreadBits(uint64_t(cell.z + MORTON_BIAS));
+    return x | (y << 1) | (z << 2);
+}
+
+void CompactHash3D::build(const vector<Particle> &particles, const vector<char> &aliveFlags, float cellSize) {
+    int numParticles = particles.size();
+    entries.resize(numParticles);
+    particleCells.assign(numParticles, -1);
+    
+    // dead particles sort to the back and are cut off
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            uint64_t key = aliveFlags[i] ? getMortonKey(positionToCell(particles[i].position, cellSize)) : UINT64_MAX;
+            entries[i] = pair<uint64_t, int> (key, i);
+        }
+    });
+    
+    tbb::parallel_sort(entries.begin(), entries.end());
+    
+    int numEntries = numParticles;
+    while (numEntries > 0 && entries[numEntries - 1].first == UINT64_MAX) {
+        numEntries--;
+    }
+    
+    sortedIndices.resize(numEntries);
+    cellKeys.clear();
+    cells.clear();
+    cellStarts.clear();
+    
+    for (int e = 0; e < numEntries; e++) {
+        if (e == 0 || entries[e].first != entries[e - 1].first) {
+            cellKeys.push_back(entries[e].first);
+            cells.push_back(positionToCell(particles[entries[e].second].position, cellSize));
+            cellStarts.push_back(e);
+        }
+        sortedIndices[e] = entries[e].second;
+        particleCells[entries[e].second] = cellKeys.size() - 1;
+    }
+    cellStarts.push_back(numEntries);
+    
+    int numCells = cellKeys.size();
+    table.reset(numCells);
+    for (int c = 0; c < numCells; c++) {
+        table.insert(cellKeys[c], c);
+    }
+    
+    neighborCells.resize(size_t(numCells) * 27);
+    neighborCounts.resize(numCells);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numCells), [&](tbb::blocked_range<int> r) {
+        for (int c = r.begin(); c < r.end(); ++c) {
+            int *neighbors = &neighborCells[size_t(c) * 27];
+            int count = 0;
+            
+            for (int offsetX = -1; offsetX < 2; offsetX++) {
+                for (int offsetY = -1; offsetY < 2; offsetY++) {
+                    for (int offsetZ = -1; offsetZ < 2; offsetZ++) {
+                        Cell cell = { cells[c].x + offsetX, cells[c].y + offsetY, cells[c].z + offsetZ };
+                        int neighborCell = table.find(getMortonKey(cell));
+                        if (neighborCell != -1) {
+                            neighbors[count++] = neighborCell;
+                        }
+                    }
+                }
+            }
+            
+            // visiting the cells in memory order reads the sorted particles front to back
+            std::sort(neighbors, neighbors + count);
+            neighborCounts[c] = count;
+        }
+    });
+}
+
+int CompactHash3D::getNumCells() const {
+    return cellKeys.size();
+}
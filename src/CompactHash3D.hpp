@@ -0,0 +1,64 @@
+//
+//  CompactHash3D.hpp
+//  fluidSimulation
+//
+
+#ifndef CompactHash3D_hpp
+#define CompactHash3D_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ofMain.h"
+#include "Particle.hpp"
+#include "MortonTable.hpp"
+
+// spatial index for 3D neighbor search. particles are sorted by the morton code of their integer cell,
+// only occupied cells are stored, and a small open addressing table maps a code to its cell.
+// the occupied neighbors of every cell are found once per build, so a query never hashes
+class CompactHash3D {
+public:
+    CompactHash3D();
+    
+    struct Cell {
+        int x, y, z;
+    };
+    
+    static Cell positionToCell(ofVec3f position, float cellSize);
+    static uint64_t getMortonKey(Cell cell);
+    
+    void build(const vector<Particle> &particles, const vector<char> &aliveFlags, float cellSize);
+    
+    // every particle in the 27 cells around the particle's own, in morton order
+    template <typename Callback> void foreachCandidate(int particleIndex, Callback callback) const;
+    
+    // alive particles in morton order, walking them in this order keeps neighbors in cache
+    vector<int> sortedIndices;
+    int getNumCells() const;
+    
+private:
+    vector<pair<uint64_t, int>> entries;
+    vector<uint64_t> cellKeys;
+    vector<Cell> cells;
+    vector<int> cellStarts, particleCells;
+    MortonTable table;
+    
+    // 27 slots per cell, the occupied neighbors first
+    vector<int> neighborCells;
+    vector<unsigned char> neighborCounts;
+};
+
+template <typename Callback>
+void CompactHash3D::foreachCandidate(int particleIndex, Callback callback) const {
+    int cell = particleCells[particleIndex];
+    if (cell < 0) return;
+    
+    const int *neighbors = &neighborCells[size_t(cell) * 27];
+    for (int n = 0; n < neighborCounts[cell]; n++) {
+        int neighborCell = neighbors[n];
+        for (int e = cellStarts[neighborCell]; e < cellStarts[neighborCell + 1]; e++) {
+            callback(sortedIndices[e]);
+        }
+    }
+}
+
+#endif /* CompactHash3D_hpp */
@@ -0,0 +1,556 @@
+//
+//  DomainDecomposition.cpp
+//  fluidSimulation
+//
+
+#include "DomainDecomposition.hpp"
+#include <string.h>
+#include <float.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+DomainDecomposition::DomainDecomposition() {
+    segment = nullptr;
+    segmentSize = 0;
+    control = nullptr;
+    rings = nullptr;
+    outputs = nullptr;
+    numWorkers = 0;
+    requestedWorkers = 0;
+    capacity = 0;
+    stepIndex = 0;
+    startPoolRevision = 0;
+    startResetCount = 0;
+}
+
+DomainDecomposition::~DomainDecomposition() {
+    stop();
+}
+
+Boolean DomainDecomposition::start(FluidSystem2D &fluidSystem, int _numWorkers) {
+    stop();
+
+    // strips at least one radius wide, so halos only ever come from the two neighbors
+    float minX = fluidSystem.xBounds.x;
+    float width = fluidSystem.xBounds.y - fluidSystem.xBounds.x;
+    int maxWorkers = std::max(1, int(width / std::max(fluidSystem.radius, 1.0f)));
+    requestedWorkers = _numWorkers;
+    numWorkers = ofClamp(_numWorkers, 1, std::min(maxWorkers, DOMAIN_MAX_WORKERS));
+    capacity = std::max(1, int(fluidSystem.particles.size()));
+    startPoolRevision = fluidSystem.poolRevision;
+    startResetCount = fluidSystem.resetCount;
+
+    // the outer strips reach to infinity, particles are clamped to the bounds anyway
+    stripEdges.resize(numWorkers + 1);
+    for (int w = 0; w <= numWorkers; w++) {
+        stripEdges[w] = minX + width * w / numWorkers;
+    }
+    stripEdges[0] = -FLT_MAX;
+    stripEdges[numWorkers] = FLT_MAX;
+
+    solvers.assign(numWorkers, SubdomainSolver());
+    SubdomainSolver::Settings settings = fluidSystem.getSubdomainSettings();
+    for (int w = 0; w < numWorkers; w++) {
+        solvers[w].setSettings(settings);
+        solvers[w].setStrip(stripEdges[w], stripEdges[w + 1]);
+    }
+
+    for (int i = 0; i < fluidSystem.particles.size(); i++) {
+        if (!fluidSystem.aliveFlags[i]) continue;
+        const Particle &particle = fluidSystem.particles[i];
+
+        int w = 0;
+        while (w < numWorkers - 1 && particle.position.x >= stripEdges[w + 1]) w++;
+        solvers[w].addParticle(i, particle.position.x, particle.position.y, particle.velocity.x, particle.velocity.y);
+    }
+
+    // control block, then a ring each way between neighbors, then one output slot per worker
+    int numRings = 2 * (numWorkers - 1);
+    size_t controlSize = (sizeof(SharedControl) + 63) & ~size_t(63);
+    size_t ringsSize = numRings * sizeof(SharedRing);
+    segmentSize = controlSize + ringsSize + size_t(numWorkers) * capacity * sizeof(SharedParticle);
+
+    // the name is unlinked straight away, the forked workers inherit the mapping
+    string name = "/fluidDomain." + ofToString(getpid());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        ofLogError("DomainDecomposition") << "could not create shared memory " << name;
+        return false;
+    }
+    shm_unlink(name.c_str());
+
+    if (ftruncate(fd, segmentSize) != 0) {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    // fresh shared memory is zero filled, which is a valid state for every counter in it
+    segment = static_cast<unsigned char *>(mapping);
+    control = reinterpret_cast<SharedControl *>(segment);
+    rings = reinterpret_cast<SharedRing *>(segment + controlSize);
+    outputs = reinterpret_cast<SharedParticle *>(segment + controlSize + ringsSize);
+
+    control->settings = settings;
+    control->running.store(1);
+    control->requestedStep.store(0);
+    stepIndex = 0;
+
+    pthread_mutexattr_t mutexAttributes;
+    pthread_mutexattr_init(&mutexAttributes);
+    pthread_mutexattr_setpshared(&mutexAttributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&control->mutex, &mutexAttributes);
+    pthread_mutexattr_destroy(&mutexAttributes);
+
+    pthread_condattr_t condAttributes;
+    pthread_condattr_init(&condAttributes);
+    pthread_condattr_setpshared(&condAttributes, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&control->stepRequested, &condAttributes);
+    pthread_cond_init(&control->stepCompleted, &condAttributes);
+    pthread_condattr_destroy(&condAttributes);
+
+    vector<WorkerContext> contexts(numWorkers);
+    for (int w = 0; w < numWorkers; w++) {
+        contexts[w].solver = &solvers[w];
+        contexts[w].control = control;
+        contexts[w].rings = rings;
+        contexts[w].outputs = outputs;
+        contexts[w].worker = w;
+        contexts[w].numWorkers = numWorkers;
+        contexts[w].capacity = capacity;
+    }
+
+    for (int w = 0; w < numWorkers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // no destructors or exit handlers, they belong to the app
+            runWorker(contexts[w]);
+            _exit(0);
+        }
+        if (pid < 0) {
+            ofLogError("DomainDecomposition") << "could not fork worker " << w;
+            stop();
+            return false;
+        }
+        workerPids.push_back(pid);
+    }
+
+    // the workers own the particles now
+    solvers.clear();
+
+    return true;
+}
+
+void DomainDecomposition::stop() {
+    if (segment == nullptr) return;
+
+    pthread_mutex_lock(&control->mutex);
+    control->running.store(0);
+    control->requestedStep.fetch_add(1);
+    pthread_cond_broadcast(&control->stepRequested);
+    pthread_mutex_unlock(&control->mutex);
+
+    for (pid_t pid : workerPids) {
+        waitpid(pid, nullptr, 0);
+    }
+    workerPids.clear();
+
+    // the condition variables are not destroyed, with glibc that waits on a worker that died waiting
+    // on them. nothing else refers to them once the segment is unmapped
+
+    munmap(segment, segmentSize);
+    segment = nullptr;
+    control = nullptr;
+    rings = nullptr;
+    outputs = nullptr;
+    numWorkers = 0;
+}
+
+Boolean DomainDecomposition::isRunning() {
+    return segment != nullptr;
+}
+
+int DomainDecomposition::getNumWorkers() {
+    return numWorkers;
+}
+
+Boolean DomainDecomposition::step(FluidSystem2D &fluidSystem) {
+    if (segment == nullptr) return false;
+
+    // the particles hold the last gathered state plus whatever was reset, spawned, killed or loaded since
+    if (fluidSystem.poolRevision != startPoolRevision || fluidSystem.resetCount != startResetCount) {
+        if (!start(fluidSystem, requestedWorkers)) return false;
+    }
+
+    // settings are written before the step number is published, the workers read them after seeing it
+    pthread_mutex_lock(&control->mutex);
+    control->settings = fluidSystem.getSubdomainSettings();
+    control->requestedStep.store(++stepIndex, std::memory_order_release);
+    pthread_cond_broadcast(&control->stepRequested);
+    pthread_mutex_unlock(&control->mutex);
+
+    if (!waitForWorkers(stepIndex)) {
+        ofLogError("DomainDecomposition") << "a worker exited, stopping";
+        stop();
+        return false;
+    }
+
+    for (int w = 0; w < numWorkers; w++) {
+        const SharedParticle *output = outputs + size_t(w) * capacity;
+        int particleCount = control->workers[w].particleCount.load(std::memory_order_acquire);
+
+        tbb::parallel_for( tbb::blocked_range<int>(0, particleCount), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                const SharedParticle &shared = output[i];
+                if (!fluidSystem.aliveFlags[shared.id]) continue;
+                Particle &particle = fluidSystem.particles[shared.id];
+                particle.position = ofVec3f(shared.positionX, shared.positionY, 0.0);
+                particle.velocity = ofVec3f(shared.velocityX, shared.velocityY, 0.0);
+                particle.density = shared.density;
+                particle.update();
+                fluidSystem.updateMesh(shared.id);
+            }
+        });
+    }
+
+    fluidSystem.stepCount++;
+    return true;
+}
+
+Boolean DomainDecomposition::waitForWorkers(uint32_t step) {
+    pthread_mutex_lock(&control->mutex);
+
+    for (int w = 0; w < numWorkers; w++) {
+        while (control->workers[w].completedStep.load(std::memory_order_acquire) != step) {
+            // a crashed worker never signals, look for it every 100ms. macos has no monotonic clock for this
+            timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 100000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            if (pthread_cond_timedwait(&control->stepCompleted, &control->mutex, &deadline) != ETIMEDOUT) continue;
+
+            for (pid_t pid : workerPids) {
+                if (waitpid(pid, nullptr, WNOHANG) != 0) {
+                    pthread_mutex_unlock(&control->mutex);
+                    return false;
+                }
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&control->mutex);
+    return true;
+}
+
+float DomainDecomposition::verify(FluidSystem2D &fluidSystem, int steps) {
+    if (segment == nullptr) return -1.0;
+
+    // the reference is the app's own solver in neighbor list mode with only the box bounds and gravity,
+    // what the workers simulate, started from the state they hold, which is exactly the last gathered one
+    FluidSystem2D reference;
+    reference.setWidth(fluidSystem.systemWidth);
+    reference.setHeight(fluidSystem.systemHeight);
+    reference.setBoundsSize(fluidSystem.boundsSize);
+    reference.setCollisionDamping(fluidSystem.collisionDamping);
+    reference.setNeighborMode(0);
+    reference.setMode(0);
+
+    // the same slots, so particles compare by index
+    reference.setAliveRange(fluidSystem.particles.size());
+    for (int i = 0; i < fluidSystem.particles.size(); i++) {
+        if (!fluidSystem.aliveFlags[i]) {
+            reference.killParticle(i);
+            continue;
+        }
+        reference.particles[i].position = fluidSystem.particles[i].position;
+        reference.particles[i].velocity = fluidSystem.particles[i].velocity;
+    }
+
+    for (int s = 0; s < steps; s++) {
+        // settings are followed every step, like the workers do
+        reference.setRadius(fluidSystem.radius);
+        reference.setDeltaTime(fluidSystem.deltaTime);
+        reference.predictionFactor = fluidSystem.predictionFactor;
+        reference.gravityForce = fluidSystem.gravityForce;
+        reference.setGravityMultiplier(fluidSystem.gravityMultiplier);
+        reference.setTargetDensity(fluidSystem.targetDensity);
+        reference.setPressureMultiplier(fluidSystem.pressureMultiplier);
+        reference.setNearPressureMultiplier(fluidSystem.nearPressureMultiplier);
+        reference.setViscosityStrength(fluidSystem.viscosityStrength);
+        reference.random.setSeed(fluidSystem.random.getSeed());
+        reference.stepCount = fluidSystem.stepCount;
+
+        reference.update();
+        if (!step(fluidSystem)) return -1.0;
+    }
+
+    float maxDifference = 0.0;
+    for (int i = 0; i < fluidSystem.particles.size(); i++) {
+        if (!fluidSystem.aliveFlags[i]) continue;
+        maxDifference = std::max(maxDifference, reference.particles[i].position.distance(fluidSystem.particles[i].position));
+    }
+
+    return maxDifference;
+}
+
+// worker process
+
+void DomainDecomposition::runWorker(const WorkerContext &context) {
+    SubdomainSolver &solver = *context.solver;
+    SharedControl *control = context.control;
+    SharedRing *rings = context.rings;
+    int worker = context.worker;
+    int numWorkers = context.numWorkers;
+    SharedWorker &shared = control->workers[worker];
+    SharedParticle *output = context.outputs + size_t(worker) * context.capacity;
+
+    // ring 2w carries strip w to w + 1, ring 2w + 1 carries it back
+    vector<Channel> channels;
+    vector<int> sides;
+    if (worker > 0) {
+        Channel left;
+        left.outgoing = &rings[2 * (worker - 1) + 1];
+        left.incoming = &rings[2 * (worker - 1)];
+        channels.push_back(left);
+        sides.push_back(-1);
+    }
+    if (worker < numWorkers - 1) {
+        Channel right;
+        right.outgoing = &rings[2 * worker];
+        right.incoming = &rings[2 * worker + 1];
+        channels.push_back(right);
+        sides.push_back(1);
+    }
+
+    uint32_t lastStep = 0;
+
+    while (true) {
+        // sleeps between steps and while paused instead of holding a core
+        pthread_mutex_lock(&control->mutex);
+        while (control->requestedStep.load(std::memory_order_acquire) == lastStep) {
+            pthread_cond_wait(&control->stepRequested, &control->mutex);
+        }
+        lastStep = control->requestedStep.load(std::memory_order_acquire);
+        pthread_mutex_unlock(&control->mutex);
+        if (!control->running.load()) return;
+
+        solver.setSettings(control->settings);
+        float radius = solver.settings.radius;
+        solver.predict();
+
+        // owned particles within a radius of an edge are copied to that neighbor
+        for (int c = 0; c < channels.size(); c++) {
+            Channel &channel = channels[c];
+            channel.haloIndices.clear();
+            beginMessage(channel);
+
+            for (int i = 0; i < solver.ownedCount; i++) {
+                Boolean inHalo = sides[c] < 0 ? solver.positionX[i] <= solver.stripMinX + radius : solver.positionX[i] >= solver.stripMaxX - radius;
+                if (!inHalo) continue;
+
+                channel.haloIndices.push_back(i);
+                pack<int32_t>(channel, solver.ids[i]);
+                pack<float>(channel, solver.positionX[i]);
+                pack<float>(channel, solver.positionY[i]);
+                pack<float>(channel, solver.velocityX[i]);
+                pack<float>(channel, solver.velocityY[i]);
+                pack<float>(channel, solver.predictedX[i]);
+                pack<float>(channel, solver.predictedY[i]);
+            }
+            endMessage(channel);
+        }
+        if (!exchange(channels, control)) return;
+
+        for (Channel &channel : channels) {
+            const unsigned char *data = channel.receiveBuffer.data() + sizeof(uint32_t);
+            const unsigned char *end = channel.receiveBuffer.data() + channel.receiveBuffer.size();
+            channel.haloStart = solver.ids.size();
+
+            while (data < end) {
+                int id = unpack<int32_t>(data);
+                float positionX = unpack<float>(data);
+                float positionY = unpack<float>(data);
+                float velocityX = unpack<float>(data);
+                float velocityY = unpack<float>(data);
+                float predictedX = unpack<float>(data);
+                float predictedY = unpack<float>(data);
+                solver.addHalo(id, positionX, positionY, velocityX, velocityY, predictedX, predictedY);
+            }
+            channel.haloCount = solver.ids.size() - channel.haloStart;
+        }
+
+        solver.findNeighbors();
+        solver.computeDensities();
+
+        // densities follow in the order the halo was sent
+        for (Channel &channel : channels) {
+            beginMessage(channel);
+            for (int i : channel.haloIndices) {
+                pack<float>(channel, solver.density[i]);
+                pack<float>(channel, solver.nearDensity[i]);
+            }
+            endMessage(channel);
+        }
+        if (!exchange(channels, control)) return;
+
+        for (Channel &channel : channels) {
+            const unsigned char *data = channel.receiveBuffer.data() + sizeof(uint32_t);
+            for (int k = 0; k < channel.haloCount; k++) {
+                solver.density[channel.haloStart + k] = unpack<float>(data);
+                solver.nearDensity[channel.haloStart + k] = unpack<float>(data);
+            }
+        }
+
+        solver.computeForces();
+        solver.integrate();
+        solver.clearHalo();
+
+        // particles that left the strip are handed to the neighbor on that side
+        for (Channel &channel : channels) {
+            beginMessage(channel);
+        }
+        for (int i = solver.ownedCount - 1; i >= 0; i--) {
+            int side = 0;
+            if (solver.positionX[i] < solver.stripMinX) side = -1;
+            if (solver.positionX[i] >= solver.stripMaxX) side = 1;
+            if (side == 0) continue;
+
+            for (int c = 0; c < channels.size(); c++) {
+                if (sides[c] != side) continue;
+                pack<int32_t>(channels[c], solver.ids[i]);
+                pack<float>(channels[c], solver.positionX[i]);
+                pack<float>(channels[c], solver.positionY[i]);
+                pack<float>(channels[c], solver.velocityX[i]);
+                pack<float>(channels[c], solver.velocityY[i]);
+                solver.removeParticle(i);
+            }
+        }
+        for (Channel &channel : channels) {
+            endMessage(channel);
+        }
+        if (!exchange(channels, control)) return;
+
+        for (Channel &channel : channels) {
+            const unsigned char *data = channel.receiveBuffer.data() + sizeof(uint32_t);
+            const unsigned char *end = channel.receiveBuffer.data() + channel.receiveBuffer.size();
+
+            while (data < end) {
+                int id = unpack<int32_t>(data);
+                float positionX = unpack<float>(data);
+                float positionY = unpack<float>(data);
+                float velocityX = unpack<float>(data);
+                float velocityY = unpack<float>(data);
+                solver.addParticle(id, positionX, positionY, velocityX, velocityY);
+            }
+        }
+
+        for (int i = 0; i < solver.ownedCount; i++) {
+            SharedParticle &particle = output[i];
+            particle.id = solver.ids[i];
+            particle.positionX = solver.positionX[i];
+            particle.positionY = solver.positionY[i];
+            particle.velocityX = solver.velocityX[i];
+            particle.velocityY = solver.velocityY[i];
+            particle.density = solver.density[i];
+        }
+        shared.particleCount.store(solver.ownedCount, std::memory_order_release);
+
+        pthread_mutex_lock(&control->mutex);
+        shared.completedStep.store(lastStep, std::memory_order_release);
+        pthread_cond_signal(&control->stepCompleted);
+        pthread_mutex_unlock(&control->mutex);
+    }
+}
+
+void DomainDecomposition::beginMessage(Channel &channel) {
+    channel.sendBuffer.resize(sizeof(uint32_t));
+}
+
+void DomainDecomposition::endMessage(Channel &channel) {
+    uint32_t payloadSize = channel.sendBuffer.size() - sizeof(uint32_t);
+    memcpy(channel.sendBuffer.data(), &payloadSize, sizeof(uint32_t));
+    channel.sent = 0;
+    channel.received = 0;
+    channel.sizeKnown = false;
+    channel.receiveBuffer.resize(sizeof(uint32_t));
+}
+
+Boolean DomainDecomposition::exchange(vector<Channel> &channels, const SharedControl *control) {
+    // sends and receives on both sides advance together, so two full rings can never wait on each other
+    while (true) {
+        Boolean done = true;
+        Boolean progress = false;
+
+        for (Channel &channel : channels) {
+            if (channel.sent < channel.sendBuffer.size()) {
+                size_t count = push(channel.outgoing, channel.sendBuffer.data() + channel.sent, channel.sendBuffer.size() - channel.sent);
+                channel.sent += count;
+                progress |= count > 0;
+                done &= channel.sent == channel.sendBuffer.size();
+            }
+
+            if (channel.received < channel.receiveBuffer.size()) {
+                size_t count = pop(channel.incoming, channel.receiveBuffer.data() + channel.received, channel.receiveBuffer.size() - channel.received);
+                channel.received += count;
+                progress |= count > 0;
+
+                if (!channel.sizeKnown && channel.received == sizeof(uint32_t)) {
+                    uint32_t payloadSize;
+                    memcpy(&payloadSize, channel.receiveBuffer.data(), sizeof(uint32_t));
+                    channel.receiveBuffer.resize(sizeof(uint32_t) + payloadSize);
+                    channel.sizeKnown = true;
+                }
+                done &= channel.sizeKnown && channel.received == channel.receiveBuffer.size();
+            }
+        }
+
+        if (done) return true;
+        if (!progress) {
+            if (!control->running.load()) return false;
+            sched_yield();
+        }
+    }
+}
+
+size_t DomainDecomposition::push(SharedRing *ring, const unsigned char *data, size_t size) {
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    size_t count = std::min(size, size_t(DOMAIN_RING_CAPACITY - (head - tail)));
+
+    for (size_t written = 0; written < count; ) {
+        size_t offset = (head + written) % DOMAIN_RING_CAPACITY;
+        size_t chunk = std::min(count - written, size_t(DOMAIN_RING_CAPACITY) - offset);
+        memcpy(ring->data + offset, data + written, chunk);
+        written += chunk;
+    }
+
+    ring->head.store(head + count, std::memory_order_release);
+    return count;
+}
+
+size_t DomainDecomposition::pop(SharedRing *ring, unsigned char *data, size_t size) {
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    size_t count = std::min(size, size_t(head - tail));
+
+    for (size_t read = 0; read < count; ) {
+        size_t offset = (tail + read) % DOMAIN_RING_CAPACITY;
+        size_t chunk = std::min(count - read, size_t(DOMAIN_RING_CAPACITY) - offset);
+        memcpy(data + read, ring->data + offset, chunk);
+        read += chunk;
+    }
+
+    ring->tail.store(tail + count, std::memory_order_release);
+    return count;
+}
@@ -0,0 +1,140 @@
+//
+//  DomainDecomposition.hpp
+//  fluidSimulation
+//
+
+#ifndef DomainDecomposition_hpp
+#define DomainDecomposition_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <pthread.h>
+#include <sys/types.h>
+#include "ofMain.h"
+#include "FluidSystem2D.hpp"
+#include "SubdomainSolver.hpp"
+
+#define DOMAIN_MAX_WORKERS 16
+#define DOMAIN_RING_CAPACITY (1 << 22)
+
+// splits the bounds into vertical strips, each stepped by its own forked worker process.
+// neighboring strips swap halo particles and migrants through shared memory rings every step,
+// and the coordinator gathers the owned particles back into the fluid system for drawing.
+// only the box bounds and gravity are simulated, boundary shapes, force fields and interaction stay local.
+// resets, count changes and checkpoint loads restart the workers from the fluid system's particles.
+//
+// the workers are forks of the app and only the forking thread survives in them, so a lock held by tbb,
+// openFrameworks, gl or any other thread at fork time is held forever. the worker side is static and only
+// gets a WorkerContext: its own SubdomainSolver, the shared segment and plain memory. it never calls into
+// tbb, openFrameworks or gl and leaves through _exit, keep it that way
+class DomainDecomposition {
+public:
+    DomainDecomposition();
+    ~DomainDecomposition();
+
+    Boolean start(FluidSystem2D &fluidSystem, int numWorkers);
+    void stop();
+    Boolean isRunning();
+    int getNumWorkers();
+
+    // one step on the workers, the result is written back into the fluid system's particles
+    Boolean step(FluidSystem2D &fluidSystem);
+
+    // steps the workers and FluidSystem2D itself in neighbor list mode side by side from the current state,
+    // returns the largest position difference, zero when the decomposition is exact
+    float verify(FluidSystem2D &fluidSystem, int steps);
+
+private:
+    // single producer single consumer byte stream, head and tail only ever grow
+    struct SharedRing {
+        alignas(64) std::atomic<uint64_t> head;
+        alignas(64) std::atomic<uint64_t> tail;
+        alignas(64) unsigned char data[DOMAIN_RING_CAPACITY];
+    };
+
+    struct SharedWorker {
+        alignas(64) std::atomic<uint32_t> completedStep;
+        std::atomic<int32_t> particleCount;
+    };
+
+    // idle workers and the waiting coordinator sleep on the process shared condition variables,
+    // the step numbers only change with the mutex held. unnamed semaphores would do but macos lacks them
+    struct SharedControl {
+        alignas(64) std::atomic<uint32_t> requestedStep;
+        std::atomic<uint32_t> running;
+        pthread_mutex_t mutex;
+        pthread_cond_t stepRequested;
+        pthread_cond_t stepCompleted;
+        SubdomainSolver::Settings settings;
+        SharedWorker workers[DOMAIN_MAX_WORKERS];
+    };
+
+    struct SharedParticle {
+        int32_t id;
+        float positionX, positionY, velocityX, velocityY, density;
+    };
+
+    // one direction pair with a neighboring strip, messages are a byte count and a payload
+    struct Channel {
+        SharedRing *outgoing, *incoming;
+        vector<unsigned char> sendBuffer, receiveBuffer;
+        size_t sent, received;
+        Boolean sizeKnown;
+        vector<int> haloIndices;
+        int haloStart, haloCount;
+    };
+
+    Boolean waitForWorkers(uint32_t step);
+
+    // everything a worker may touch, prepared before the fork
+    struct WorkerContext {
+        SubdomainSolver *solver;
+        SharedControl *control;
+        SharedRing *rings;
+        SharedParticle *outputs;
+        int worker, numWorkers, capacity;
+    };
+
+    // worker side, static so it cannot reach the app through this
+    static void runWorker(const WorkerContext &context);
+    static Boolean exchange(vector<Channel> &channels, const SharedControl *control);
+    static void beginMessage(Channel &channel);
+    static void endMessage(Channel &channel);
+    template <typename T> static void pack(Channel &channel, T value);
+    template <typename T> static T unpack(const unsigned char *&data);
+    static size_t push(SharedRing *ring, const unsigned char *data, size_t size);
+    static size_t pop(SharedRing *ring, unsigned char *data, size_t size);
+
+    unsigned char *segment;
+    size_t segmentSize;
+    SharedControl *control;
+    SharedRing *rings;
+    SharedParticle *outputs;
+
+    vector<pid_t> workerPids;
+    vector<SubdomainSolver> solvers;
+    vector<float> stripEdges;
+    int numWorkers, requestedWorkers, capacity;
+    uint32_t stepIndex;
+
+    // the pool the workers were started from
+    unsigned int startPoolRevision, startResetCount;
+};
+
+template <typename T>
+void DomainDecomposition::pack(Channel &channel, T value) {
+    size_t offset = channel.sendBuffer.size();
+    channel.sendBuffer.resize(offset + sizeof(T));
+    memcpy(channel.sendBuffer.data() + offset, &value, sizeof(T));
+}
+
+template <typename T>
+T DomainDecomposition::unpack(const unsigned char *&data) {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+#endif /* DomainDecomposition_hpp */
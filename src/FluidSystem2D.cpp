@@ -4,10 +4,49 @@
 //
 
 #include "FluidSystem2D.hpp"
+#include "Checkpoint.hpp"
+#include "MappedFile.hpp"
+#include <string.h>
+#include <float.h>
 
 FluidSystem2D::FluidSystem2D() {
     kernels.calculate3DVolumesFromRadius(radius);
     
+    neighborMode = NEIGHBOR_LISTS;
+    verletSkin = 2.0;
+    verletSearchRadius = 0.0;
+    verletParticleCount = 0;
+    verletPoolRevision = 0;
+    
+    incrementalSortActive = false;
+    incrementalSortThreshold = 0.1;
+    sortedParticleCount = 0;
+    
+    pairCacheActive = false;
+    stepMicros = 0;
+    
+    solverMode = DOUBLE_DENSITY;
+    solverIterations = 6;
+    solverTolerance = 0.01;
+    solverRelaxation = 0.1;
+    solverRestDensity = 1.0;
+    solverError = 0.0;
+    solverIterationCount = 0;
+    
+    implicitViscosityActive = false;
+    viscosityIterations = 4;
+    viscosityResidual = 0.0;
+    
+    sdfBoundaryActive = false;
+    
+    tileCells = 8;
+    tilesX = 0;
+    tilesY = 0;
+    tileSize = 0.0;
+    tilesDirty = true;
+    tilePoolRevision = 0;
+    tileResetCount = 0;
+    
     for (int i = -1; i < 2; i++) {
         for (int j = -1; j < 2; j++) {
             cellOffsets.push_back(ofVec2f(i, j));
@@ -17,74 +56,394 @@ FluidSystem2D::FluidSystem2D() {
 
 void FluidSystem2D::update() {
     if (!pauseActive || nextFrameActive) {
+        uint64_t stepStart = ofGetElapsedTimeMicros();
+        forceField.acquire();
+        boundaryField.acquire();
+        
+        if (solverMode == POSITION_BASED) {
+            stepPositionBased();
+            tilesDirty = true;
+        } else if (neighborMode == OWNED_TILES) {
+            stepTiled();
+        } else {
+            stepDoubleDensity();
+            tilesDirty = true;
+        }
+        
+        updateEmittersAndSinks();
+        
+        stepMicros = ofGetElapsedTimeMicros() - stepStart;
+        stepCount++;
+        nextFrameActive = false;
+    }
+
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            if (!aliveFlags[i]) continue;
+            particles[i].update();
+            updateMesh(i);
+        }
+    });
+}
+
+void FluidSystem2D::stepDoubleDensity() {
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            if (!aliveFlags[i]) continue;
+            ofVec2f externalForce = calculateExternalForce(i);
+            particles[i].velocity += externalForce;
+            particles[i].predictedPosition = particles[i].position + particles[i].velocity * predictionFactor;
+        }
+    });
+    
+    Boolean useCache = pairCacheActive && neighborMode != STREAMING;
+    
+    if (neighborMode == CELL_TILES) {
+        updateSpatialLookup();
+        applyInteractionForces();
+        updateDensitiesTiled();
+    } else if (neighborMode == STREAMING) {
+        // neighbors are walked straight from the sorted cells and never stored
+        updateSpatialLookup();
+        applyInteractionForces();
+        
         tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
             for (int i = r.begin(); i < r.end(); ++i) {
-                ofVec2f externalForce = calculateExternalForce(i);
-                particles[i].velocity += externalForce;
-                particles[i].predictedPosition = particles[i].position + particles[i].velocity * predictionFactor;
+                if (!aliveFlags[i]) continue;
+                pair<float, float> densities = calculateDensityStreaming(i);
+                particles[i].density = densities.first;
+                particles[i].nearDensity = densities.second;
             }
         });
-        
-        updateSpatialLookup();
+    } else {
+        updateNeighborLists();
+        applyInteractionForces();
         
         tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
             for (int i = r.begin(); i < r.end(); ++i) {
-                particles[i].indicesWithinRadius = foreachPointWithinRadius(i);
-                pair<float, float> densities = calculateDensity(i);
+                if (!aliveFlags[i]) continue;
+                pair<float, float> densities = useCache ? cachePairGeometry(i) : calculateDensity(i);
                 particles[i].density = densities.first;
                 particles[i].nearDensity = densities.second;
             }
         });
+    }
+    
+    if (useCache) {
+        tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                if (!aliveFlags[i]) continue;
+                particles[i].pressure = calculatePressureFromDensity(particles[i].density);
+                particles[i].nearPressure = calculateNearPressureFromDensity(particles[i].nearDensity);
+            }
+        });
+    }
+    
+    // in cell tile mode forces are walked in sorted cell order so neighbors stay cached,
+    // velocity changes are held back until every particle has read its neighbors
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int j = r.begin(); j < r.end(); ++j) {
+            int i = neighborMode == CELL_TILES ? spatialLookup[j].first : j;
+            if (!aliveFlags[i]) continue;
+            
+            if (neighborMode == STREAMING) {
+                pair<ofVec2f, ofVec2f> forces = calculateForcesStreaming(i);
+                ofVec2f velocityChange = forces.first / particles[i].density * deltaTime;
+                if (!implicitViscosityActive) {
+                    velocityChange += forces.second * deltaTime;
+                }
+                particles[i].velocityChange = velocityChange;
+                continue;
+            }
+            
+            ofVec2f pressureForce = useCache ? calculatePressureForceCached(i) : calculatePressureForce(i);
+            ofVec2f pressureAcceleration = pressureForce / particles[i].density;
+            ofVec2f velocityChange = pressureAcceleration * deltaTime;
+            
+            if (!implicitViscosityActive) {
+                ofVec2f viscosityForce = useCache ? calculateViscosityForceCached(i) : calculateViscosityForce(i);
+                velocityChange += viscosityForce * deltaTime;
+            }
+            
+            particles[i].velocityChange = velocityChange;
+        }
+    });
+    
+    if (implicitViscosityActive) {
+        applyImplicitViscosity();
+    }
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            if (!aliveFlags[i]) continue;
+            particles[i].velocity += particles[i].velocityChange;
+            particles[i].velocityChange = ofVec3f::zero();
+            particles[i].position += particles[i].velocity * deltaTime;
+            resolveCollisions(i);
+        }
+    });
+}
+
+void FluidSystem2D::stepPositionBased() {
+    float restDensity = calculateRestDensity() * solverRestDensity;
+    
+    // predict positions from the external forces, the solver then corrects them
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            if (!aliveFlags[i]) continue;
+            ofVec2f externalForce = calculateExternalForce(i);
+            particles[i].velocity += externalForce;
+            particles[i].lastPosition = particles[i].position;
+            particles[i].position += particles[i].velocity * deltaTime;
+            resolveCollisions(i);
+        }
+    });
+    
+    updateNeighborLists();
+    applyInteractionForces();
+    
+    solverIterationCount = 0;
+    
+    for (int iteration = 0; iteration < solverIterations; iteration++) {
+        solverError = tbb::parallel_reduce(tbb::blocked_range<int>(0, particles.size()), 0.0f, [&](tbb::blocked_range<int> r, float maxError) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                if (!aliveFlags[i]) continue;
+                maxError = std::max(maxError, calculateDensityConstraint(i, restDensity));
+            }
+            return maxError;
+        }, [](float a, float b) {
+            return std::max(a, b);
+        });
+        
+        if (solverError < solverTolerance) break;
+        solverIterationCount++;
         
         tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
             for (int i = r.begin(); i < r.end(); ++i) {
-                ofVec2f pressureForce = calculatePressureForce(i);
-                ofVec2f pressureAcceleration = pressureForce / particles[i].density;
-                particles[i].velocity += pressureAcceleration * deltaTime;
-                
-                ofVec2f viscosityForce = calculateViscosityForce(i);
-                particles[i].velocity += viscosityForce * deltaTime;
+                if (!aliveFlags[i]) continue;
+                particles[i].deltaPosition = calculatePositionCorrection(i, restDensity);
             }
         });
         
         tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
             for (int i = r.begin(); i < r.end(); ++i) {
-                particles[i].position += particles[i].velocity * deltaTime;
+                if (!aliveFlags[i]) continue;
+                particles[i].position += particles[i].deltaPosition;
                 resolveCollisions(i);
             }
         });
-        
-        nextFrameActive = false;
     }
-
+    
     tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
         for (int i = r.begin(); i < r.end(); ++i) {
-            particles[i].update();
-            updateMesh(i);
+            if (!aliveFlags[i]) continue;
+            particles[i].velocity = (particles[i].position - particles[i].lastPosition) / deltaTime;
+            particles[i].predictedPosition = particles[i].position;
         }
     });
+    
+    if (implicitViscosityActive) {
+        applyImplicitViscosity();
+    } else {
+        tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                if (!aliveFlags[i]) continue;
+                particles[i].velocityChange = calculateViscosityForce(i) * deltaTime;
+            }
+        });
+        
+        tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                if (!aliveFlags[i]) continue;
+                particles[i].velocity += particles[i].velocityChange;
+                particles[i].velocityChange = ofVec3f::zero();
+            }
+        });
+    }
+}
+
+void FluidSystem2D::updateNeighborLists() {
+    // verlet lists are only rebuilt once a particle has moved more than half the skin,
+    // spawns and kills in between are patched into the lists they touch
+    Boolean rebuildNeighbors = true;
+    if (neighborMode == VERLET_LISTS) {
+        if (verletPoolRevision != poolRevision && verletPoolRevision >= poolLogRevision
+            && verletParticleCount == particles.size() && verletSearchRadius == getSearchRadius()) {
+            patchNeighborLists();
+        }
+        rebuildNeighbors = verletRebuildNeeded();
+    }
+    
+    if (rebuildNeighbors) {
+        updateSpatialLookup();
+        
+        tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                if (!aliveFlags[i]) continue;
+                particles[i].indicesWithinRadius = foreachPointWithinRadius(i);
+                particles[i].verletPosition = particles[i].position;
+            }
+        });
+        
+        verletListed = aliveFlags;
+        verletSearchRadius = getSearchRadius();
+        verletParticleCount = particles.size();
+        verletPoolRevision = poolRevision;
+    }
 }
 
-ofVec2f FluidSystem2D::calculateInteractiveForce(int particleIndex) {
+void FluidSystem2D::patchNeighborLists() {
+    // a new particle can close in on a neighbor that has already drifted almost half the skin,
+    // so it gathers half a skin further than a rebuild would
+    float patchRadius = getSearchRadius() + verletSkin * 0.5;
+    unsortedFlags.resize(particles.size(), false);
+    
+    for (int c = verletPoolRevision - poolLogRevision; c < poolChanges.size(); c++) {
+        int particleIndex = poolChanges[c].particleIndex;
+        vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+        
+        // lists are symmetric, a killed particle only has to leave the lists of its own neighbors
+        if (!poolChanges[c].spawned) {
+            if (!verletListed[particleIndex]) continue;
+            for (int neighborParticleIndex : indicesWithinRadius) {
+                if (neighborParticleIndex == particleIndex) continue;
+                vector<int> &neighborIndices = particles[neighborParticleIndex].indicesWithinRadius;
+                auto entry = std::find(neighborIndices.begin(), neighborIndices.end(), particleIndex);
+                if (entry != neighborIndices.end()) neighborIndices.erase(entry);
+            }
+            indicesWithinRadius.clear();
+            verletListed[particleIndex] = false;
+            continue;
+        }
+        
+        if (verletListed[particleIndex]) continue;
+        verletListed[particleIndex] = true;
+        
+        // the lookup still files this slot under its old cell, it is walked directly until the next sort
+        if (!unsortedFlags[particleIndex]) {
+            unsortedFlags[particleIndex] = true;
+            unsortedSpawns.push_back(particleIndex);
+        }
+        
+        // only particles already in the lists are paired, later spawns find this one in turn
+        patchIndices.clear();
+        foreachParticleWithinDisc(particles[particleIndex].position, patchRadius, [&](int neighborParticleIndex) {
+            if (verletListed[neighborParticleIndex]) patchIndices.push_back(neighborParticleIndex);
+        });
+        std::sort(patchIndices.begin(), patchIndices.end());
+        
+        indicesWithinRadius.assign(patchIndices.begin(), patchIndices.end());
+        for (int neighborParticleIndex : indicesWithinRadius) {
+            if (neighborParticleIndex == particleIndex) continue;
+            particles[neighborParticleIndex].indicesWithinRadius.push_back(particleIndex);
+        }
+        particles[particleIndex].verletPosition = particles[particleIndex].position;
+    }
+    
+    verletPoolRevision = poolRevision;
+}
+
+ofVec2f FluidSystem2D::calculateInteractiveForce(const InteractionPoint &point, int particleIndex) {
     ofVec2f particlePosition = particles[particleIndex].position;
-    ofVec2f particleVelocity = particles[particleIndex].velocity;
+    
+    if (point.pull) {
+        return pullParticlesToPoint(point.position, particlePosition, point.radius, point.force);
+    }
+    return pushParticlesAwayFromPoint(point.position, particlePosition, point.radius, point.force);
+}
 
-    ofVec2f interactiveForce= ofVec2f::zero();
+void FluidSystem2D::applyInteractionForces() {
+    activeInteractionPoints = interactionPoints;
+    
+    if (mouseInputActive && (mouseButton == 0 || mouseButton == 2)) {
+        InteractionPoint mousePoint;
+        mousePoint.position = mousePosition;
+        mousePoint.radius = mouseRadius;
+        mousePoint.force = mouseForce;
+        mousePoint.pull = mouseButton == 2;
+        activeInteractionPoints.push_back(mousePoint);
+    }
     
-    if (mouseButton == 0) {
-        interactiveForce = pushParticlesAwayFromPoint(mousePosition, particlePosition, particleVelocity);
+    // points run one after another so a particle under two discs is never written twice at once
+    for (const InteractionPoint &point : activeInteractionPoints) {
+        if (point.radius <= 0.0) continue;
+        
+        foreachParticleWithinDisc(point.position, point.radius, [&](int particleIndex) {
+            ofVec2f interactiveForce = calculateInteractiveForce(point, particleIndex);
+            particles[particleIndex].velocity += interactiveForce;
+            
+            if (solverMode == POSITION_BASED) {
+                particles[particleIndex].position += interactiveForce * deltaTime;
+                resolveCollisions(particleIndex);
+            } else {
+                particles[particleIndex].predictedPosition += interactiveForce * predictionFactor;
+            }
+        });
     }
-    if (mouseButton == 2) {
-        interactiveForce = pullParticlesToPoint(mousePosition, particlePosition);
+}
+
+void FluidSystem2D::setInteractionPoints(const vector<InteractionPoint> &_interactionPoints) {
+    interactionPoints = _interactionPoints;
+}
+
+// emitters and sinks
+
+void FluidSystem2D::updateEmittersAndSinks() {
+    // sinks reuse this step's sorted cells, a particle that crossed in after the sort is caught next step
+    if (aliveCount > 0 && !sinks.empty()) {
+        sinkIndices.clear();
+        
+        for (const Sink &sink : sinks) {
+            if (sink.radius <= 0.0) continue;
+            
+            foreachParticleWithinDisc(sink.position, sink.radius, [&](int particleIndex) {
+                sinkIndices.push_back(particleIndex);
+            });
+        }
+        
+        // sorted so the free list, and with it every later spawn, does not depend on thread timing
+        std::sort(sinkIndices.begin(), sinkIndices.end());
+        for (int particleIndex : sinkIndices) {
+            killParticle(particleIndex);
+        }
     }
     
-    return interactiveForce;
+    emitterBudgets.resize(emitters.size(), 0.0);
+    
+    for (int e = 0; e < emitters.size(); e++) {
+        const Emitter &emitter = emitters[e];
+        emitterBudgets[e] += emitter.rate;
+        
+        while (emitterBudgets[e] >= 1.0 && !freeIndices.empty()) {
+            emitterBudgets[e] -= 1.0;
+            
+            float values[4];
+            random.uniform4(SPAWN_STREAM, freeIndices.back(), spawnCount++, 0, values);
+            
+            float theta = values[0] * TWO_PI;
+            float magnitude = sqrt(values[1]) * emitter.radius;
+            ofVec2f position = emitter.position + ofVec2f(cos(theta), sin(theta)) * magnitude;
+            
+            spawnParticle(position, emitter.velocity);
+        }
+        
+        // a full pool drops the backlog instead of bursting once slots free up
+        emitterBudgets[e] = std::min(emitterBudgets[e], std::max(emitter.rate, 1.0f));
+    }
+}
+
+void FluidSystem2D::setEmitters(const vector<Emitter> &_emitters) {
+    emitters = _emitters;
+    emitterBudgets.resize(emitters.size(), 0.0);
+}
+
+void FluidSystem2D::setSinks(const vector<Sink> &_sinks) {
+    sinks = _sinks;
 }
 
-ofVec2f FluidSystem2D::pullParticlesToPoint(ofVec2f pointA, ofVec2f pointB) {
+ofVec2f FluidSystem2D::pullParticlesToPoint(ofVec2f pointA, ofVec2f pointB, float inputRadius, float inputForce) {
     ofVec2f interactiveForce = ofVec2f::zero();
     
-    float inputRadius = mouseRadius;
     float squareDistance = pointA.squareDistance(pointB);
     
     if (squareDistance < inputRadius * inputRadius) {
@@ -92,15 +451,14 @@ ofVec2f FluidSystem2D::pullParticlesToPoint(ofVec2f pointA, ofVec2f pointB) {
         ofVec2f direction = (pointA - pointB) / distance;
         float scalarProximity = distance / inputRadius;
         
-        interactiveForce =  direction * mouseForce * scalarProximity;
+        interactiveForce =  direction * inputForce * scalarProximity;
     }
     return interactiveForce;
 }
 
-ofVec2f FluidSystem2D::pushParticlesAwayFromPoint(ofVec2f pointA, ofVec2f pointB, ofVec2f velocity) {
+ofVec2f FluidSystem2D::pushParticlesAwayFromPoint(ofVec2f pointA, ofVec2f pointB, float inputRadius, float inputForce) {
     ofVec2f interactiveForce = ofVec2f::zero();
     
-    float inputRadius = mouseRadius;
     float squareDistance = pointA.squareDistance(pointB);
     
     if (squareDistance < inputRadius * inputRadius) {
@@ -108,23 +466,24 @@ ofVec2f FluidSystem2D::pushParticlesAwayFromPoint(ofVec2f pointA, ofVec2f pointB
         ofVec2f direction = (pointB - pointA) / distance;
         float scalarProximity = 1.0 - distance / inputRadius;
         
-        interactiveForce =  direction * mouseForce * scalarProximity * scalarProximity;
+        interactiveForce =  direction * inputForce * scalarProximity * scalarProximity;
     }
     return interactiveForce;
 }
 
 ofVec2f FluidSystem2D::calculateExternalForce(int particleIndex) {
-    ofVec2f interactiveForce = ofVec2f::zero();
+    // interaction forces are added after the spatial lookup, see applyInteractionForces
+    ofVec2f externalForce = gravityForce * gravityConstant * gravityMultiplier * deltaTime;
     
-    if (mouseInputActive) {
-        interactiveForce = calculateInteractiveForce(particleIndex);
+    if (forceField.isActive()) {
+        externalForce += forceField.sample(ofVec2f(particles[particleIndex].position)) * deltaTime;
     }
     
-    return interactiveForce + gravityForce * gravityConstant * gravityMultiplier * deltaTime;
+    return externalForce;
 }
 
 pair<float, float> FluidSystem2D::calculateDensity(int particleIndex) {
-    vector<int> indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+    const vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
     ofVec2f particlePosition = particles[particleIndex].predictedPosition;
     
     float density = 0.0f;
@@ -134,6 +493,8 @@ pair<float, float> FluidSystem2D::calculateDensity(int particleIndex) {
         int neighborParticleIndex = indicesWithinRadius[i];
         
         float distance = particlePosition.distance(particles[neighborParticleIndex].predictedPosition);
+        if (distance > radius) continue;
+        
         density += kernels.densityKernel(distance, radius);
         nearDensity += kernels.nearDensityKernel(distance, radius);
     }
@@ -142,7 +503,7 @@ pair<float, float> FluidSystem2D::calculateDensity(int particleIndex) {
 }
 
 ofVec2f FluidSystem2D::calculatePressureForce(int particleIndex) {
-    vector<int> indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+    const vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
     ofVec2f particlePosition = particles[particleIndex].predictedPosition;
     float density = particles[particleIndex].density;
     float nearDensity = particles[particleIndex].nearDensity;
@@ -157,8 +518,10 @@ ofVec2f FluidSystem2D::calculatePressureForce(int particleIndex) {
         
         ofVec2f neighborPosition = particles[neighborParticleIndex].predictedPosition;
         float distance = particlePosition.distance(neighborPosition);
+        if (distance >= radius) continue;
+        
         ofVec2f direction = (neighborPosition - particlePosition) / distance;
-        direction = distance == 0.0 ? getRandom2DDirection() : direction;
+        direction = distance == 0.0 ? getRandom2DDirection(particleIndex, neighborParticleIndex) : direction;
         
         float slope = kernels.densityDerivative(distance, radius);
         float nearSlope = kernels.nearDensityDerivative(distance, radius);
@@ -169,7 +532,7 @@ ofVec2f FluidSystem2D::calculatePressureForce(int particleIndex) {
         float neighborNearPressure = calculateNearPressureFromDensity(neighborNearDensity);
         
         float sharedPressure = (pressure + neighborPressure) * 0.5;
-        float sharedNearPressure = (nearPressure = neighborNearPressure) * 0.5;
+        float sharedNearPressure = (nearPressure + neighborNearPressure) * 0.5;
         
         pressureForce += sharedPressure * direction * slope / density;
         pressureForce += sharedNearPressure * direction * nearSlope / nearDensity;
@@ -179,7 +542,7 @@ ofVec2f FluidSystem2D::calculatePressureForce(int particleIndex) {
 }
 
 ofVec2f FluidSystem2D::calculateViscosityForce(int particleIndex) {
-    vector<int> indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+    const vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
     ofVec2f particlePosition = particles[particleIndex].predictedPosition;
     ofVec2f viscosityForce = ofVec2f::zero();
     
@@ -188,6 +551,8 @@ ofVec2f FluidSystem2D::calculateViscosityForce(int particleIndex) {
         if (particleIndex == neighborParticleIndex) continue;
         
         float distance = particlePosition.distance(particles[neighborParticleIndex].predictedPosition);
+        if (distance > radius) continue;
+        
         float influence = kernels.viscosityKernel(distance, radius);
         viscosityForce += (particles[neighborParticleIndex].velocity - particles[particleIndex].velocity) * influence;
     }
@@ -195,105 +560,989 @@ ofVec2f FluidSystem2D::calculateViscosityForce(int particleIndex) {
     return viscosityForce * viscosityStrength;
 }
 
-float FluidSystem2D::calculatePressureFromDensity(float density) {
-    float densityError = density - targetDensity;
-    return densityError * pressureMultiplier;
-}
+// cached pair geometry
 
-float FluidSystem2D::calculateNearPressureFromDensity(float nearDensity) {
-    return nearDensity * nearPressureMultiplier;
+pair<float, float> FluidSystem2D::cachePairGeometry(int particleIndex) {
+    const vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+    vector<float> &neighborDistances = particles[particleIndex].neighborDistances;
+    vector<ofVec2f> &neighborDirections = particles[particleIndex].neighborDirections;
+    ofVec2f particlePosition = particles[particleIndex].predictedPosition;
+    
+    neighborDistances.resize(indicesWithinRadius.size());
+    neighborDirections.resize(indicesWithinRadius.size());
+    
+    float density = 0.0f;
+    float nearDensity = 0.0f;
+    
+    for (int i = 0; i < indicesWithinRadius.size(); ++i) {
+        ofVec2f neighborPosition = particles[indicesWithinRadius[i]].predictedPosition;
+        float distance = particlePosition.distance(neighborPosition);
+        
+        neighborDistances[i] = distance;
+        neighborDirections[i] = distance == 0.0 ? getRandom2DDirection(particleIndex, indicesWithinRadius[i]) : (neighborPosition - particlePosition) / distance;
+        
+        if (distance > radius) continue;
+        
+        density += kernels.densityKernel(distance, radius);
+        nearDensity += kernels.nearDensityKernel(distance, radius);
+    }
+    
+    return pair<float, float> (density, nearDensity);
 }
 
-// spatial lookup
-
-vector<int> FluidSystem2D::foreachPointWithinRadius(int particleIndex) {
-    ofVec2f position = particles[particleIndex].position;
+ofVec2f FluidSystem2D::calculatePressureForceCached(int particleIndex) {
+    const Particle &particle = particles[particleIndex];
+    const vector<int> &indicesWithinRadius = particle.indicesWithinRadius;
     
-    pair<int, int> center = positionToCellCoordinate(position, radius);
-    int centerX = center.first;
-    int centerY = center.second;
-    float squareRadius = radius * radius;
+    float inverseDensity = 1.0 / particle.density;
+    float inverseNearDensity = 1.0 / particle.nearDensity;
     
-    vector<int> indicesWithinRadius;
+    ofVec2f pressureForce = ofVec2f::zero();
     
-    for (auto offsetPair : cellOffsets) {
-        int offsetX = offsetPair.x;
-        int offsetY = offsetPair.y;
+    for (int i = 0; i < indicesWithinRadius.size(); ++i) {
+        int neighborParticleIndex = indicesWithinRadius[i];
+        if (particleIndex == neighborParticleIndex) continue;
         
-        unsigned int key = getKeyFromHash(hashCell(centerX + offsetX, centerY + offsetY));
-        int cellStartIndex = startIndices[key];
+        float distance = particle.neighborDistances[i];
+        if (distance >= radius) continue;
         
-        for (int i = cellStartIndex; i < spatialLookup.size(); i++) {
-            if (spatialLookup[i].second != key) break;
-            
-            int otherParticleIndex = spatialLookup[i].first;
-            float squareDistance = particles[otherParticleIndex].position.squareDistance(position);
-            
-            if (squareDistance <= squareRadius) {
-                indicesWithinRadius.push_back(otherParticleIndex);
-            }
-        }
+        float slope = kernels.densityDerivative(distance, radius);
+        float nearSlope = kernels.nearDensityDerivative(distance, radius);
+        
+        float sharedPressure = (particle.pressure + particles[neighborParticleIndex].pressure) * 0.5;
+        float sharedNearPressure = (particle.nearPressure + particles[neighborParticleIndex].nearPressure) * 0.5;
+        
+        float magnitude = sharedPressure * slope * inverseDensity + sharedNearPressure * nearSlope * inverseNearDensity;
+        pressureForce += particle.neighborDirections[i] * magnitude;
     }
     
-    return indicesWithinRadius;
+    return pressureForce;
 }
 
-void FluidSystem2D::updateSpatialLookup() {
-    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
-        for (int i = r.begin(); i < r.end(); ++i) {
-            pair<int, int> cell = positionToCellCoordinate(particles[i].position, radius);
-            unsigned int cellKey = getKeyFromHash(hashCell(cell.first, cell.second));
-            spatialLookup[i] = pair<int, unsigned int> (i, cellKey);
-            startIndices[i] = INT_MAX;
-        }
-    });
+ofVec2f FluidSystem2D::calculateViscosityForceCached(int particleIndex) {
+    const Particle &particle = particles[particleIndex];
+    const vector<int> &indicesWithinRadius = particle.indicesWithinRadius;
+    ofVec2f particleVelocity = particle.velocity;
+    ofVec2f viscosityForce = ofVec2f::zero();
     
-    tbb::parallel_sort(spatialLookup.begin(), spatialLookup.end(), [](auto &left, auto &right) {
-        return left.second < right.second;
-    });
+    for (int i = 0; i < indicesWithinRadius.size(); ++i) {
+        int neighborParticleIndex = indicesWithinRadius[i];
+        if (particleIndex == neighborParticleIndex) continue;
+        
+        float distance = particle.neighborDistances[i];
+        if (distance > radius) continue;
+        
+        float influence = kernels.viscosityKernel(distance, radius);
+        viscosityForce += (ofVec2f(particles[neighborParticleIndex].velocity) - particleVelocity) * influence;
+    }
     
-    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
-        for (int i = r.begin(); i < r.end(); ++i) {
-            unsigned int key = spatialLookup[i].second;
-            unsigned int keyPrev = i == 0 ? UINT_MAX : spatialLookup[i - 1].second;
-            if (key != keyPrev) {
-                startIndices[key] = i;
-            }
-        }
-    });
+    return viscosityForce * viscosityStrength;
 }
 
-unsigned int FluidSystem2D::hashCell(int cellX, int cellY) {
-    unsigned int a = u_int(cellX * 15823);
-    unsigned int b = u_int(cellY * 9737333);
-    return a + b;
-}
+// streaming neighbor passes
 
-unsigned int FluidSystem2D::getKeyFromHash(unsigned int hash) {
-    return hash % u_int(spatialLookup.size());
+pair<float, float> FluidSystem2D::calculateDensityStreaming(int particleIndex) {
+    ofVec2f particlePosition = particles[particleIndex].predictedPosition;
+    
+    float density = 0.0f;
+    float nearDensity = 0.0f;
+    
+    foreachNeighbor(particleIndex, [&](int neighborParticleIndex) {
+        float distance = particlePosition.distance(particles[neighborParticleIndex].predictedPosition);
+        if (distance > radius) return;
+        
+        density += kernels.densityKernel(distance, radius);
+        nearDensity += kernels.nearDensityKernel(distance, radius);
+    });
+    
+    return pair<float, float> (density, nearDensity);
 }
 
-pair<int, int> FluidSystem2D::positionToCellCoordinate(ofVec2f position, float radius) {
-    return pair<int, int> (int(position.x / radius), int(position.y / radius));
+pair<ofVec2f, ofVec2f> FluidSystem2D::calculateForcesStreaming(int particleIndex) {
+    ofVec2f particlePosition = particles[particleIndex].predictedPosition;
+    ofVec2f particleVelocity = particles[particleIndex].velocity;
+    float density = particles[particleIndex].density;
+    float nearDensity = particles[particleIndex].nearDensity;
+    float pressure = calculatePressureFromDensity(density);
+    float nearPressure = calculateNearPressureFromDensity(nearDensity);
+    
+    ofVec2f pressureForce = ofVec2f::zero();
+    ofVec2f viscosityForce = ofVec2f::zero();
+    
+    foreachNeighbor(particleIndex, [&](int neighborParticleIndex) {
+        if (particleIndex == neighborParticleIndex) return;
+        
+        ofVec2f neighborPosition = particles[neighborParticleIndex].predictedPosition;
+        float distance = particlePosition.distance(neighborPosition);
+        if (distance >= radius) return;
+        
+        ofVec2f direction = distance == 0.0 ? getRandom2DDirection(particleIndex, neighborParticleIndex) : (neighborPosition - particlePosition) / distance;
+        
+        float slope = kernels.densityDerivative(distance, radius);
+        float nearSlope = kernels.nearDensityDerivative(distance, radius);
+        
+        float neighborPressure = calculatePressureFromDensity(particles[neighborParticleIndex].density);
+        float neighborNearPressure = calculateNearPressureFromDensity(particles[neighborParticleIndex].nearDensity);
+        
+        float sharedPressure = (pressure + neighborPressure) * 0.5;
+        float sharedNearPressure = (nearPressure + neighborNearPressure) * 0.5;
+        
+        pressureForce += sharedPressure * direction * slope / density;
+        pressureForce += sharedNearPressure * direction * nearSlope / nearDensity;
+        
+        float influence = kernels.viscosityKernel(distance, radius);
+        viscosityForce += (ofVec2f(particles[neighborParticleIndex].velocity) - particleVelocity) * influence;
+    });
+    
+    return pair<ofVec2f, ofVec2f> (pressureForce, viscosityForce * viscosityStrength);
 }
 
-void FluidSystem2D::resolveCollisions(int particleIndex) {
+size_t FluidSystem2D::getNeighborListBytes() {
+    // allocated capacity, a list keeps its memory between steps even when it shrinks
+    return tbb::parallel_reduce(tbb::blocked_range<int>(0, particles.size()), size_t(0), [&](tbb::blocked_range<int> r, size_t bytes) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            bytes += particles[i].indicesWithinRadius.capacity() * sizeof(int);
+            bytes += particles[i].neighborDistances.capacity() * sizeof(float);
+            bytes += particles[i].neighborDirections.capacity() * sizeof(ofVec2f);
+        }
+        return bytes;
+    }, [](size_t a, size_t b) {
+        return a + b;
+    });
+}
+
+void FluidSystem2D::setPairCache(Boolean _pairCacheActive) {
+    pairCacheActive = _pairCacheActive;
+}
+
+// position based solver
+
+float FluidSystem2D::calculateRestDensity() {
+    // density of the particles spread evenly over the bounds
+    float area = boundsSize.x * boundsSize.y;
     if (circleBoundaryActive) {
-        float distance = particles[particleIndex].position.distance(center);
-        float maxDistance = circleBoundaryRadius;
+        area = PI * circleBoundaryRadius * circleBoundaryRadius;
+    }
+    float numberDensity = aliveCount / std::max(area, 1.0f);
+    
+    int steps = 32;
+    float stepSize = radius / steps;
+    float ringDensity = 0.0f;
+    
+    for (int i = 0; i < steps; i++) {
+        float distance = (i + 0.5) * stepSize;
+        ringDensity += kernels.densityKernel(distance, radius) * TWO_PI * distance * stepSize;
+    }
+    
+    return kernels.densityKernel(0.0, radius) + numberDensity * ringDensity;
+}
+
+float FluidSystem2D::calculateDensityConstraint(int particleIndex, float restDensity) {
+    const vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+    ofVec2f particlePosition = particles[particleIndex].position;
+    
+    float density = 0.0f;
+    float sumGradientSquared = 0.0f;
+    ofVec2f particleGradient = ofVec2f::zero();
+    
+    for (int i = 0; i < indicesWithinRadius.size(); ++i) {
+        int neighborParticleIndex = indicesWithinRadius[i];
+        ofVec2f neighborPosition = particles[neighborParticleIndex].position;
+        
+        float distance = particlePosition.distance(neighborPosition);
+        if (distance > radius) continue;
         
-        center.x = centerX;
-        center.y = centerY;
+        density += kernels.densityKernel(distance, radius);
+        if (particleIndex == neighborParticleIndex) continue;
         
-        if (distance > maxDistance) {
-            particles[particleIndex].velocity *= -1.0 * collisionDamping;
+        ofVec2f direction = distance == 0.0 ? getOverlapDirection(particleIndex, neighborParticleIndex) : (neighborPosition - particlePosition) / distance;
+        ofVec2f gradient = direction * kernels.densityDerivative(distance, radius) / restDensity;
+        particleGradient += gradient;
+        sumGradientSquared += gradient.lengthSquared();
+    }
+    
+    sumGradientSquared += particleGradient.lengthSquared();
+    
+    // only compression is corrected, so the free surface does not clump
+    float constraint = std::max(density / restDensity - 1.0f, 0.0f);
+    
+    particles[particleIndex].density = density;
+    particles[particleIndex].lambda = 0.0f;
+    if (sumGradientSquared > 0.0) {
+        particles[particleIndex].lambda = -constraint / (sumGradientSquared * (1.0 + solverRelaxation));
+    }
+    
+    return constraint;
+}
+
+ofVec2f FluidSystem2D::calculatePositionCorrection(int particleIndex, float restDensity) {
+    const vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+    ofVec2f particlePosition = particles[particleIndex].position;
+    float lambda = particles[particleIndex].lambda;
+    
+    ofVec2f deltaPosition = ofVec2f::zero();
+    
+    for (int i = 0; i < indicesWithinRadius.size(); ++i) {
+        int neighborParticleIndex = indicesWithinRadius[i];
+        if (particleIndex == neighborParticleIndex) continue;
+        
+        ofVec2f neighborPosition = particles[neighborParticleIndex].position;
+        float distance = particlePosition.distance(neighborPosition);
+        if (distance >= radius) continue;
+        
+        ofVec2f direction = distance == 0.0 ? getOverlapDirection(particleIndex, neighborParticleIndex) : (neighborPosition - particlePosition) / distance;
+        float slope = kernels.densityDerivative(distance, radius);
+        
+        deltaPosition += (lambda + particles[neighborParticleIndex].lambda) * direction * slope;
+    }
+    
+    deltaPosition /= restDensity;
+    
+    // a single iteration never moves a particle further than a fraction of the radius
+    float maxCorrection = radius * 0.25;
+    if (deltaPosition.lengthSquared() > maxCorrection * maxCorrection) {
+        deltaPosition = deltaPosition.getNormalized() * maxCorrection;
+    }
+    
+    return deltaPosition;
+}
+
+ofVec2f FluidSystem2D::getOverlapDirection(int particleIndex, int neighborParticleIndex) {
+    // overlapping pairs (e.g. clamped into a corner) are split along a fixed axis per pair,
+    // opposite for each side, so the correction separates them instead of cancelling out
+    int low = std::min(particleIndex, neighborParticleIndex);
+    int high = std::max(particleIndex, neighborParticleIndex);
+    float theta = float((low * 7919u + high * 104729u) % 360u) * DEG_TO_RAD;
+    
+    ofVec2f direction = ofVec2f(cos(theta), sin(theta));
+    return particleIndex < neighborParticleIndex ? direction : -direction;
+}
+
+void FluidSystem2D::setSolverMode(int _solverModeInt) {
+    if (_solverModeInt == 0) {
+        solverMode = DOUBLE_DENSITY;
+    } else if (_solverModeInt == 1) {
+        solverMode = POSITION_BASED;
+        
+        if (neighborMode == STREAMING) {
+            ofLogWarning("FluidSystem2D") << "position based solver needs neighbor lists, leaving streaming mode";
+            setNeighborMode(NEIGHBOR_LISTS);
+        }
+    }
+}
+
+void FluidSystem2D::setSolverIterations(int _solverIterations) {
+    solverIterations = _solverIterations;
+}
+
+void FluidSystem2D::setSolverTolerance(float _solverTolerance) {
+    solverTolerance = _solverTolerance;
+}
+
+void FluidSystem2D::setSolverRelaxation(float _solverRelaxation) {
+    solverRelaxation = std::max(_solverRelaxation, 0.0f);
+}
+
+void FluidSystem2D::setSolverRestDensity(float _solverRestDensity) {
+    solverRestDensity = _solverRestDensity;
+}
+
+// implicit viscosity
+
+void FluidSystem2D::applyImplicitViscosity() {
+    // backward euler solve of v = v0 + dt * strength * sum(w * (vj - v)), relaxed with jacobi sweeps
+    int numParticles = particles.size();
+    float scale = deltaTime * viscosityStrength;
+    
+    initialVelocities.resize(numParticles);
+    viscosityVelocities.resize(numParticles);
+    viscosityWeightSums.resize(numParticles);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            if (!aliveFlags[i]) continue;
+            // pressure changes from the force pass are folded in before neighbors are read
+            particles[i].velocity += particles[i].velocityChange;
+            particles[i].velocityChange = ofVec3f::zero();
+            
+            initialVelocities[i] = particles[i].velocity;
+            viscosityVelocities[i] = particles[i].velocity;
+            
+            float weightSum = 0.0f;
+            foreachViscosityNeighbor(i, [&](int neighborParticleIndex, float influence) {
+                weightSum += influence;
+            });
+            viscosityWeightSums[i] = weightSum;
+        }
+    });
+    
+    viscosityResidual = 0.0;
+    
+    for (int iteration = 0; iteration < viscosityIterations; iteration++) {
+        viscosityResidual = tbb::parallel_reduce(tbb::blocked_range<int>(0, numParticles), 0.0f, [&](tbb::blocked_range<int> r, float maxResidual) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                if (!aliveFlags[i]) continue;
+                ofVec2f neighborSum = ofVec2f::zero();
+                foreachViscosityNeighbor(i, [&](int neighborParticleIndex, float influence) {
+                    neighborSum += ofVec2f(particles[neighborParticleIndex].velocity) * influence;
+                });
+                
+                ofVec2f velocity = (initialVelocities[i] + neighborSum * scale) / (1.0 + viscosityWeightSums[i] * scale);
+                maxResidual = std::max(maxResidual, velocity.distance(particles[i].velocity));
+                viscosityVelocities[i] = velocity;
+            }
+            return maxResidual;
+        }, [](float a, float b) {
+            return std::max(a, b);
+        });
+        
+        tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                if (!aliveFlags[i]) continue;
+                particles[i].velocity = viscosityVelocities[i];
+            }
+        });
+    }
+}
+
+void FluidSystem2D::setImplicitViscosity(Boolean _implicitViscosityActive) {
+    implicitViscosityActive = _implicitViscosityActive;
+}
+
+void FluidSystem2D::setViscosityIterations(int _viscosityIterations) {
+    viscosityIterations = _viscosityIterations;
+}
+
+float FluidSystem2D::calculatePressureFromDensity(float density) {
+    float densityError = density - targetDensity;
+    return densityError * pressureMultiplier;
+}
+
+float FluidSystem2D::calculateNearPressureFromDensity(float nearDensity) {
+    return nearDensity * nearPressureMultiplier;
+}
+
+// spatial lookup
+
+vector<int> FluidSystem2D::foreachPointWithinRadius(int particleIndex) {
+    vector<int> indicesWithinRadius;
+    
+    foreachNeighbor(particleIndex, [&](int otherParticleIndex) {
+        indicesWithinRadius.push_back(otherParticleIndex);
+    });
+    
+    return indicesWithinRadius;
+}
+
+void FluidSystem2D::updateDensitiesTiled() {
+    float searchRadius = getSearchRadius();
+    float squareSearchRadius = searchRadius * searchRadius;
+    int numEntries = spatialLookup.size();
+    
+    // each task owns the cells whose sorted run starts inside its range
+    tbb::parallel_for( tbb::blocked_range<int>(0, numEntries), [&](tbb::blocked_range<int> r) {
+        vector<TileEntry> &tile = tileBuffers.local();
+        
+        for (int runStart = r.begin(); runStart < r.end(); ++runStart) {
+            unsigned int key = spatialLookup[runStart].second;
+            if (key == UINT_MAX) break;
+            if (runStart > 0 && spatialLookup[runStart - 1].second == key) continue;
             
-            ofVec2f point = particles[particleIndex].position - center;
-            float theta = atan2(point.y, point.x);
+            int runEnd = runStart;
+            while (runEnd < numEntries && spatialLookup[runEnd].second == key) runEnd++;
             
-            ofVec2f edge = ofVec2f(cos(theta) * maxDistance, sin(theta) * maxDistance);
+            // a hashed bucket can hold more than one cell, so tile each distinct cell once
+            for (int i = runStart; i < runEnd; i++) {
+                pair<int, int> cell = positionToCellCoordinate(particles[spatialLookup[i].first].position, searchRadius);
+                
+                Boolean cellDone = false;
+                for (int j = runStart; j < i; j++) {
+                    if (positionToCellCoordinate(particles[spatialLookup[j].first].position, searchRadius) == cell) {
+                        cellDone = true;
+                        break;
+                    }
+                }
+                if (cellDone) continue;
+                
+                loadTile(cell.first, cell.second, tile);
+                
+                for (int j = i; j < runEnd; j++) {
+                    int particleIndex = spatialLookup[j].first;
+                    if (positionToCellCoordinate(particles[particleIndex].position, searchRadius) != cell) continue;
+                    
+                    ofVec2f position = particles[particleIndex].position;
+                    ofVec2f predictedPosition = particles[particleIndex].predictedPosition;
+                    vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+                    indicesWithinRadius.clear();
+                    particles[particleIndex].neighborDistances.clear();
+                    particles[particleIndex].neighborDirections.clear();
+                    
+                    float density = 0.0f;
+                    float nearDensity = 0.0f;
+                    
+                    for (const TileEntry &entry : tile) {
+                        if (entry.position.squareDistance(position) > squareSearchRadius) continue;
+                        indicesWithinRadius.push_back(entry.index);
+                        
+                        float distance = predictedPosition.distance(entry.predictedPosition);
+                        
+                        if (pairCacheActive) {
+                            ofVec2f direction = distance == 0.0 ? getRandom2DDirection(particleIndex, entry.index) : (entry.predictedPosition - predictedPosition) / distance;
+                            particles[particleIndex].neighborDistances.push_back(distance);
+                            particles[particleIndex].neighborDirections.push_back(direction);
+                        }
+                        
+                        if (distance > radius) continue;
+                        
+                        density += kernels.densityKernel(distance, radius);
+                        nearDensity += kernels.nearDensityKernel(distance, radius);
+                    }
+                    
+                    particles[particleIndex].density = density;
+                    particles[particleIndex].nearDensity = nearDensity;
+                }
+            }
+        }
+    });
+}
+
+void FluidSystem2D::loadTile(int cellX, int cellY, vector<TileEntry> &tile) {
+    tile.clear();
+    
+    for (auto offsetPair : cellOffsets) {
+        unsigned int key = getKeyFromHash(hashCell(cellX + offsetPair.x, cellY + offsetPair.y));
+        int cellStartIndex = startIndices[key];
+        
+        for (int i = cellStartIndex; i < spatialLookup.size(); i++) {
+            if (spatialLookup[i].second != key) break;
             
-            particles[particleIndex].position = center + edge;
+            int otherParticleIndex = spatialLookup[i].first;
+            TileEntry entry;
+            entry.index = otherParticleIndex;
+            entry.position = particles[otherParticleIndex].position;
+            entry.predictedPosition = particles[otherParticleIndex].predictedPosition;
+            tile.push_back(entry);
+        }
+    }
+}
+
+void FluidSystem2D::updateSpatialLookup() {
+    float searchRadius = getSearchRadius();
+    
+    // every slot gets its current cell again
+    for (int particleIndex : unsortedSpawns) {
+        unsortedFlags[particleIndex] = false;
+    }
+    unsortedSpawns.clear();
+    
+    if (incrementalSortActive && sortedParticleCount == particles.size()) {
+        if (updateSpatialLookupIncremental()) return;
+    }
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            // dead particles share the last key, so they sort past every cell and are never visited
+            pair<int, int> cell = positionToCellCoordinate(particles[i].position, searchRadius);
+            unsigned int cellKey = aliveFlags[i] ? getKeyFromHash(hashCell(cell.first, cell.second)) : UINT_MAX;
+            spatialLookup[i] = pair<int, unsigned int> (i, cellKey);
+            startIndices[i] = INT_MAX;
+        }
+    });
+    
+    // ties are broken by particle index so neighbor order, and with it every sum, is reproducible
+    tbb::parallel_sort(spatialLookup.begin(), spatialLookup.end(), [](auto &left, auto &right) {
+        return left.second < right.second || (left.second == right.second && left.first < right.first);
+    });
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            unsigned int key = spatialLookup[i].second;
+            unsigned int keyPrev = i == 0 ? UINT_MAX : spatialLookup[i - 1].second;
+            if (key != keyPrev && key != UINT_MAX) {
+                startIndices[key] = i;
+            }
+        }
+    });
+    
+    sortedParticleCount = particles.size();
+}
+
+Boolean FluidSystem2D::updateSpatialLookupIncremental() {
+    float searchRadius = getSearchRadius();
+    int numEntries = spatialLookup.size();
+    int blockSize = 4096;
+    int numBlocks = (numEntries + blockSize - 1) / blockSize;
+    
+    previousKeys.resize(numEntries);
+    blockMovers.resize(numBlocks);
+    
+    // rekey the previous sorted order in place and count the entries that changed cells in every block
+    tbb::parallel_for( tbb::blocked_range<int>(0, numBlocks), [&](tbb::blocked_range<int> r) {
+        for (int block = r.begin(); block < r.end(); ++block) {
+            int count = 0;
+            int blockEnd = std::min(numEntries, (block + 1) * blockSize);
+            
+            for (int i = block * blockSize; i < blockEnd; i++) {
+                int particleIndex = spatialLookup[i].first;
+                pair<int, int> cell = positionToCellCoordinate(particles[particleIndex].position, searchRadius);
+                unsigned int cellKey = aliveFlags[particleIndex] ? getKeyFromHash(hashCell(cell.first, cell.second)) : UINT_MAX;
+                
+                previousKeys[i] = spatialLookup[i].second;
+                spatialLookup[i].second = cellKey;
+                count += cellKey != previousKeys[i];
+            }
+            blockMovers[block] = count;
+        }
+    });
+    
+    // the scan over the block counts gives every block the slot of its first mover
+    int numMovers = 0;
+    for (int block = 0; block < numBlocks; block++) {
+        int count = blockMovers[block];
+        blockMovers[block] = numMovers;
+        numMovers += count;
+    }
+    
+    if (numMovers == 0) return true;
+    
+    // too many movers and a full sort is cheaper, it rewrites every entry anyway
+    if (numMovers > numEntries * incrementalSortThreshold) return false;
+    
+    int numStayers = numEntries - numMovers;
+    movers.resize(numMovers);
+    dirtyKeys.resize(numMovers);
+    stayers.resize(numStayers);
+    int firstMover = 0;
+    int lastMover = 0;
+    
+    // pull the movers out, the stayers remain sorted. blocks write from their scanned offsets so they can run in any order
+    tbb::parallel_for( tbb::blocked_range<int>(0, numBlocks), [&](tbb::blocked_range<int> r) {
+        for (int block = r.begin(); block < r.end(); ++block) {
+            int moverIndex = blockMovers[block];
+            int stayerIndex = block * blockSize - moverIndex;
+            int blockEnd = std::min(numEntries, (block + 1) * blockSize);
+            
+            for (int i = block * blockSize; i < blockEnd; i++) {
+                if (spatialLookup[i].second == previousKeys[i]) {
+                    stayers[stayerIndex++] = spatialLookup[i];
+                    continue;
+                }
+                
+                if (moverIndex == 0) firstMover = i;
+                if (moverIndex == numMovers - 1) lastMover = i;
+                movers[moverIndex] = spatialLookup[i];
+                dirtyKeys[moverIndex] = previousKeys[i];
+                moverIndex++;
+            }
+        }
+    });
+    
+    auto byKey = [](const pair<int, unsigned int> &left, const pair<int, unsigned int> &right) {
+        return left.second < right.second || (left.second == right.second && left.first < right.first);
+    };
+    
+    tbb::parallel_sort(movers.begin(), movers.end(), byKey);
+    
+    // every mover finds its slot among the stayers, the stayers then shift by the number of movers in front of them
+    insertionPoints.resize(numMovers);
+    tbb::parallel_for( tbb::blocked_range<int>(0, numMovers), [&](tbb::blocked_range<int> r) {
+        for (int k = r.begin(); k < r.end(); ++k) {
+            insertionPoints[k] = std::upper_bound(stayers.begin(), stayers.end(), movers[k], byKey) - stayers.begin();
+            spatialLookup[insertionPoints[k] + k] = movers[k];
+        }
+    });
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numStayers, blockSize), [&](tbb::blocked_range<int> r) {
+        int shift = std::upper_bound(insertionPoints.begin(), insertionPoints.end(), r.begin()) - insertionPoints.begin();
+        for (int s = r.begin(); s < r.end(); ++s) {
+            while (shift < numMovers && insertionPoints[shift] <= s) shift++;
+            spatialLookup[s + shift] = stayers[s];
+        }
+    });
+    
+    // entries before the first removal or insertion and after the last one kept their slots,
+    // so only bucket starts inside that span move. the entry after it may have lost its predecessor's key
+    int firstChanged = std::min(firstMover, insertionPoints.front());
+    int lastChanged = std::min(numEntries - 1, std::max(lastMover, insertionPoints.back() + numMovers - 1) + 1);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(firstChanged, lastChanged + 1), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            unsigned int key = spatialLookup[i].second;
+            unsigned int keyPrev = i == 0 ? UINT_MAX : spatialLookup[i - 1].second;
+            if (key != keyPrev && key != UINT_MAX) {
+                startIndices[key] = i;
+            }
+        }
+    });
+    
+    // buckets a mover left may now be empty
+    for (unsigned int key : dirtyKeys) {
+        if (key == UINT_MAX) continue;
+        int start = startIndices[key];
+        if (start == INT_MAX) continue;
+        if (start >= numEntries || spatialLookup[start].second != key) {
+            startIndices[key] = INT_MAX;
+        }
+    }
+    
+    return true;
+}
+
+void FluidSystem2D::setIncrementalSort(Boolean _incrementalSortActive) {
+    incrementalSortActive = _incrementalSortActive;
+}
+
+float FluidSystem2D::getSearchRadius() {
+    if (neighborMode == VERLET_LISTS) {
+        return radius + verletSkin;
+    }
+    return radius;
+}
+
+Boolean FluidSystem2D::verletRebuildNeeded() {
+    if (verletParticleCount != particles.size()) return true;
+    if (verletPoolRevision != poolRevision) return true;
+    if (verletSearchRadius != getSearchRadius()) return true;
+    
+    float halfSkin = verletSkin * 0.5;
+    float squareHalfSkin = halfSkin * halfSkin;
+    
+    float maxSquareDisplacement = tbb::parallel_reduce(tbb::blocked_range<int>(0, particles.size()), 0.0f, [&](tbb::blocked_range<int> r, float maxValue) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            if (!aliveFlags[i]) continue;
+            maxValue = std::max(maxValue, particles[i].position.squareDistance(particles[i].verletPosition));
+        }
+        return maxValue;
+    }, [](float a, float b) {
+        return std::max(a, b);
+    });
+    
+    return maxSquareDisplacement > squareHalfSkin;
+}
+
+void FluidSystem2D::setNeighborMode(int _neighborModeInt) {
+    if (_neighborModeInt == 0) {
+        neighborMode = NEIGHBOR_LISTS;
+    } else if (_neighborModeInt == 1) {
+        neighborMode = VERLET_LISTS;
+    } else if (_neighborModeInt == 2) {
+        neighborMode = CELL_TILES;
+    } else if (_neighborModeInt == 4) {
+        neighborMode = OWNED_TILES;
+        tilesDirty = true;
+    } else if (_neighborModeInt == 3 && solverMode == POSITION_BASED) {
+        ofLogWarning("FluidSystem2D") << "streaming has no neighbor lists for the position based solver, using lists";
+        neighborMode = NEIGHBOR_LISTS;
+    } else if (_neighborModeInt == 3) {
+        neighborMode = STREAMING;
+        
+        // give the list memory back, streaming never reads it
+        for (int i = 0; i < particles.size(); i++) {
+            vector<int>().swap(particles[i].indicesWithinRadius);
+            vector<float>().swap(particles[i].neighborDistances);
+            vector<ofVec2f>().swap(particles[i].neighborDirections);
+        }
+    }
+    
+    // force the next update to gather fresh lists
+    verletParticleCount = 0;
+}
+
+void FluidSystem2D::setVerletSkin(float _verletSkin) {
+    verletSkin = _verletSkin;
+}
+
+// owned tiles
+
+SubdomainSolver::Settings FluidSystem2D::getSubdomainSettings() {
+    SubdomainSolver::Settings settings;
+    memset(&settings, 0, sizeof(settings));
+    
+    settings.radius = radius;
+    settings.deltaTime = deltaTime;
+    settings.predictionFactor = predictionFactor;
+    settings.collisionDamping = collisionDamping;
+    settings.targetDensity = targetDensity;
+    settings.pressureMultiplier = pressureMultiplier;
+    settings.nearPressureMultiplier = nearPressureMultiplier;
+    settings.viscosityStrength = viscosityStrength;
+    settings.gravityX = gravityForce.x * gravityConstant * gravityMultiplier;
+    settings.gravityY = gravityForce.y * gravityConstant * gravityMultiplier;
+    settings.boundsMinX = xBounds.x;
+    settings.boundsMaxX = xBounds.y;
+    settings.boundsMinY = yBounds.x;
+    settings.boundsMaxY = yBounds.y;
+    settings.seed = random.getSeed();
+    settings.stepCount = stepCount;
+    
+    return settings;
+}
+
+void FluidSystem2D::stepTiled() {
+    // tiles are at least one radius wide, so every neighbor lies in the 3x3 block of tiles around a particle
+    float size = std::max(tileCells, 1) * radius;
+    int countX = std::max(1, int(ceil((xBounds.y - xBounds.x) / size)));
+    int countY = std::max(1, int(ceil((yBounds.y - yBounds.x) / size)));
+    
+    // spawns and kills are patched into their tiles, only geometry, resets and capacity changes rebuild
+    if (tilesDirty || size != tileSize || countX != tilesX || countY != tilesY || tileOrigin != ofVec2f(xBounds.x, yBounds.x)
+        || tilePoolRevision < poolLogRevision || particleTiles.size() != particles.size() || tileResetCount != resetCount) {
+        tileSize = size;
+        tilesX = countX;
+        tilesY = countY;
+        tileOrigin = ofVec2f(xBounds.x, yBounds.x);
+        rebuildTiles();
+    } else if (tilePoolRevision != poolRevision) {
+        patchTiles();
+    }
+    
+    SubdomainSolver::Settings settings = getSubdomainSettings();
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, activeTiles.size()), [&](tbb::blocked_range<int> r) {
+        for (int a = r.begin(); a < r.end(); ++a) {
+            SubdomainSolver &tile = tiles[activeTiles[a]];
+            for (int k = 0; k < tile.ownedCount; k++) {
+                int i = tile.ids[k];
+                ofVec2f externalForce = calculateExternalForce(i);
+                particles[i].velocity += externalForce;
+                particles[i].predictedPosition = particles[i].position + particles[i].velocity * predictionFactor;
+            }
+        }
+    });
+    
+    // interaction discs find their particles through the tiles
+    applyInteractionForces();
+    
+    // every tile loads its own particles and copies the ones of its neighbors within a radius of its edges,
+    // the particles are only read here so the tiles can fill in any order
+    tbb::parallel_for( tbb::blocked_range<int>(0, activeTiles.size()), [&](tbb::blocked_range<int> r) {
+        for (int a = r.begin(); a < r.end(); ++a) {
+            int t = activeTiles[a];
+            SubdomainSolver &tile = tiles[t];
+            tile.setSettings(settings);
+            tile.clearHalo();
+            tileHalos[t].clear();
+            
+            for (int k = 0; k < tile.ownedCount; k++) {
+                const Particle &particle = particles[tile.ids[k]];
+                tile.positionX[k] = particle.position.x;
+                tile.positionY[k] = particle.position.y;
+                tile.velocityX[k] = particle.velocity.x;
+                tile.velocityY[k] = particle.velocity.y;
+                tile.predictedX[k] = particle.predictedPosition.x;
+                tile.predictedY[k] = particle.predictedPosition.y;
+            }
+            
+            float minX, minY, maxX, maxY;
+            getTileRect(t, minX, minY, maxX, maxY);
+            minX -= radius;
+            minY -= radius;
+            maxX += radius;
+            maxY += radius;
+            
+            int tileX = t % tilesX;
+            int tileY = t / tilesX;
+            for (int offsetX = -1; offsetX < 2; offsetX++) {
+                int x = tileX + offsetX;
+                if (x < 0 || x >= tilesX) continue;
+                
+                for (int offsetY = -1; offsetY < 2; offsetY++) {
+                    int y = tileY + offsetY;
+                    if (y < 0 || y >= tilesY) continue;
+                    if (offsetX == 0 && offsetY == 0) continue;
+                    
+                    int source = y * tilesX + x;
+                    const SubdomainSolver &sourceTile = tiles[source];
+                    for (int k = 0; k < sourceTile.ownedCount; k++) {
+                        const Particle &particle = particles[sourceTile.ids[k]];
+                        if (particle.position.x < minX || particle.position.x > maxX) continue;
+                        if (particle.position.y < minY || particle.position.y > maxY) continue;
+                        
+                        tile.addHalo(sourceTile.ids[k], particle.position.x, particle.position.y, particle.velocity.x, particle.velocity.y,
+                                     particle.predictedPosition.x, particle.predictedPosition.y);
+                        tileHalos[t].push_back({ source, k });
+                    }
+                }
+            }
+            
+            tile.findNeighbors();
+            tile.computeDensities();
+        }
+    });
+    
+    // halo densities come from the tiles that own them
+    tbb::parallel_for( tbb::blocked_range<int>(0, activeTiles.size()), [&](tbb::blocked_range<int> r) {
+        for (int a = r.begin(); a < r.end(); ++a) {
+            int t = activeTiles[a];
+            SubdomainSolver &tile = tiles[t];
+            for (int h = 0; h < tileHalos[t].size(); h++) {
+                const TileHalo &halo = tileHalos[t][h];
+                tile.density[tile.ownedCount + h] = tiles[halo.sourceTile].density[halo.sourceIndex];
+                tile.nearDensity[tile.ownedCount + h] = tiles[halo.sourceTile].nearDensity[halo.sourceIndex];
+            }
+            tile.computeForces();
+        }
+    });
+    
+    // the velocity changes go back to the particles, which then collide with every boundary shape.
+    // particles leaving their tile are taken out and handed over afterwards
+    tbb::parallel_for( tbb::blocked_range<int>(0, activeTiles.size()), [&](tbb::blocked_range<int> r) {
+        for (int a = r.begin(); a < r.end(); ++a) {
+            int t = activeTiles[a];
+            SubdomainSolver &tile = tiles[t];
+            tileMigrants[t].clear();
+            tile.clearHalo();
+            
+            // backwards, so the particle swapped into a removed slot has already been moved
+            for (int k = tile.ownedCount - 1; k >= 0; k--) {
+                int i = tile.ids[k];
+                particles[i].density = tile.density[k];
+                particles[i].nearDensity = tile.nearDensity[k];
+                particles[i].velocity += ofVec2f(tile.velocityChangeX[k], tile.velocityChangeY[k]);
+                particles[i].velocityChange = ofVec3f::zero();
+                particles[i].position += particles[i].velocity * deltaTime;
+                resolveCollisions(i);
+                
+                int destination = getTileIndex(particles[i].position.x, particles[i].position.y);
+                if (destination != t) {
+                    tileMigrants[t].push_back({ i, destination });
+                    tile.removeParticle(k);
+                }
+            }
+        }
+    });
+    
+    for (int a = 0; a < activeTiles.size(); a++) {
+        for (const TileMigrant &migrant : tileMigrants[activeTiles[a]]) {
+            const Particle &particle = particles[migrant.particleIndex];
+            tiles[migrant.tile].addParticle(migrant.particleIndex, particle.position.x, particle.position.y, particle.velocity.x, particle.velocity.y);
+            particleTiles[migrant.particleIndex] = migrant.tile;
+        }
+    }
+    
+    activeTiles.clear();
+    for (int t = 0; t < tiles.size(); t++) {
+        if (tiles[t].ownedCount > 0) {
+            activeTiles.push_back(t);
+        }
+    }
+}
+
+void FluidSystem2D::rebuildTiles() {
+    int numTiles = tilesX * tilesY;
+    tiles.resize(numTiles);
+    tileHalos.resize(numTiles);
+    tileMigrants.resize(numTiles);
+    for (int t = 0; t < numTiles; t++) {
+        tiles[t].clear();
+    }
+    particleTiles.assign(particles.size(), -1);
+    
+    for (int i = 0; i < particles.size(); i++) {
+        if (!aliveFlags[i]) continue;
+        const Particle &particle = particles[i];
+        int t = getTileIndex(particle.position.x, particle.position.y);
+        tiles[t].addParticle(i, particle.position.x, particle.position.y, particle.velocity.x, particle.velocity.y);
+        particleTiles[i] = t;
+    }
+    
+    activeTiles.clear();
+    for (int t = 0; t < numTiles; t++) {
+        if (tiles[t].ownedCount > 0) {
+            activeTiles.push_back(t);
+        }
+    }
+    
+    tilePoolRevision = poolRevision;
+    tileResetCount = resetCount;
+    tilesDirty = false;
+}
+
+void FluidSystem2D::patchTiles() {
+    // the same hand over as migration, a kill leaves its tile and a spawn joins the tile under it
+    for (int c = tilePoolRevision - poolLogRevision; c < poolChanges.size(); c++) {
+        int particleIndex = poolChanges[c].particleIndex;
+        int t = particleTiles[particleIndex];
+        
+        if (!poolChanges[c].spawned) {
+            if (t < 0) continue;
+            SubdomainSolver &tile = tiles[t];
+            for (int k = 0; k < tile.ownedCount; k++) {
+                if (tile.ids[k] == particleIndex) {
+                    tile.removeParticle(k);
+                    break;
+                }
+            }
+            particleTiles[particleIndex] = -1;
+            continue;
+        }
+        
+        if (t >= 0) continue;
+        const Particle &particle = particles[particleIndex];
+        t = getTileIndex(particle.position.x, particle.position.y);
+        tiles[t].addParticle(particleIndex, particle.position.x, particle.position.y, particle.velocity.x, particle.velocity.y);
+        particleTiles[particleIndex] = t;
+    }
+    
+    activeTiles.clear();
+    for (int t = 0; t < tiles.size(); t++) {
+        if (tiles[t].ownedCount > 0) {
+            activeTiles.push_back(t);
+        }
+    }
+    
+    tilePoolRevision = poolRevision;
+}
+
+int FluidSystem2D::getTileIndex(float x, float y) {
+    // particles outside the bounds belong to the edge tiles
+    int tileX = ofClamp(floor((x - tileOrigin.x) / tileSize), 0, tilesX - 1);
+    int tileY = ofClamp(floor((y - tileOrigin.y) / tileSize), 0, tilesY - 1);
+    return tileY * tilesX + tileX;
+}
+
+void FluidSystem2D::getTileRect(int tile, float &minX, float &minY, float &maxX, float &maxY) {
+    // edge tiles reach out to infinity, matching getTileIndex
+    int tileX = tile % tilesX;
+    int tileY = tile / tilesX;
+    minX = tileX == 0 ? -FLT_MAX : tileOrigin.x + tileX * tileSize;
+    minY = tileY == 0 ? -FLT_MAX : tileOrigin.y + tileY * tileSize;
+    maxX = tileX == tilesX - 1 ? FLT_MAX : tileOrigin.x + (tileX + 1) * tileSize;
+    maxY = tileY == tilesY - 1 ? FLT_MAX : tileOrigin.y + (tileY + 1) * tileSize;
+}
+
+void FluidSystem2D::setTileCells(int _tileCells) {
+    tileCells = _tileCells;
+    tilesDirty = true;
+}
+
+unsigned int FluidSystem2D::hashCell(int cellX, int cellY) {
+    unsigned int a = u_int(cellX * 15823);
+    unsigned int b = u_int(cellY * 9737333);
+    return a + b;
+}
+
+unsigned int FluidSystem2D::getKeyFromHash(unsigned int hash) {
+    return hash % u_int(spatialLookup.size());
+}
+
+pair<int, int> FluidSystem2D::positionToCellCoordinate(ofVec2f position, float radius) {
+    return pair<int, int> (int(position.x / radius), int(position.y / radius));
+}
+
+void FluidSystem2D::resolveCollisions(int particleIndex) {
+    if (sdfBoundaryActive && boundaryField.isReady()) {
+        resolveFieldCollision(particleIndex);
+    } else if (circleBoundaryActive) {
+        // runs on every thread at once, so the center is read, never written
+        ofVec2f circleCenter = ofVec2f(centerX, centerY);
+        ofVec2f point = particles[particleIndex].position - circleCenter;
+        float squareDistance = point.lengthSquared();
+        float maxDistance = circleBoundaryRadius;
+        
+        if (squareDistance > maxDistance * maxDistance) {
+            particles[particleIndex].velocity *= -1.0 * collisionDamping;
+            particles[particleIndex].position = circleCenter + point * (maxDistance / sqrt(squareDistance));
         }
     }
 
@@ -322,18 +1571,60 @@ void FluidSystem2D::resolveCollisions(int particleIndex) {
      
 }
 
+void FluidSystem2D::resolveFieldCollision(int particleIndex) {
+    ofVec2f position = particles[particleIndex].position;
+    ofVec2f normal;
+    float distance = boundaryField.sample(position, normal);
+    if (distance <= 0.0) return;
+    
+    // step back along the gradient to the surface and damp the outward part of the velocity
+    particles[particleIndex].position -= ofVec3f(normal.x, normal.y, 0.0) * distance;
+    
+    ofVec2f velocity = particles[particleIndex].velocity;
+    float normalSpeed = velocity.dot(normal);
+    if (normalSpeed > 0.0) {
+        velocity -= normal * normalSpeed * (1.0 + collisionDamping);
+        particles[particleIndex].velocity.x = velocity.x;
+        particles[particleIndex].velocity.y = velocity.y;
+    }
+}
+
+void FluidSystem2D::setSdfBoundary(Boolean _sdfBoundaryActive) {
+    sdfBoundaryActive = _sdfBoundaryActive;
+}
+
+void FluidSystem2D::setBoundaryPolygons(const vector<vector<ofVec2f>> &polygons) {
+    // about 256 cells across the long side of the system
+    float cellLength = std::max(systemWidth, systemHeight) / 256.0;
+    boundaryField.setup(ceil(systemWidth / cellLength), ceil(systemHeight / cellLength), ofVec2f::zero(), ofVec2f(systemWidth, systemHeight));
+    boundaryField.buildFromPolygons(polygons);
+}
+
+void FluidSystem2D::setBoundaryMask(const ofPixels &pixels) {
+    float cellLength = std::max(systemWidth, systemHeight) / 256.0;
+    boundaryField.setup(ceil(systemWidth / cellLength), ceil(systemHeight / cellLength), ofVec2f::zero(), ofVec2f(systemWidth, systemHeight));
+    boundaryField.buildFromMask(pixels, 0.5);
+}
+
 // reset particles
 
 void FluidSystem2D::resetRandom() {
     if (circleBoundaryActive) {
         resetCircle(1.0);
     } else {
-        for (int i = 0; i < particles.size(); ++i) {
-            float x = ofRandom(bounds.x, bounds.x + boundsSize.x);
-            float y = ofRandom(bounds.y, bounds.y + boundsSize.y);
-            particles[i].position = ofVec2f(x, y);
-            particles[i].velocity = getRandom2DDirection();
-        }
+        resetCount++;
+        
+        tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                float values[4];
+                random.uniform4(RESET_STREAM, i, resetCount, 0, values);
+                
+                float x = bounds.x + values[0] * boundsSize.x;
+                float y = bounds.y + values[1] * boundsSize.y;
+                particles[i].position = ofVec2f(x, y);
+                particles[i].velocity = getRandom2DDirection(i);
+            }
+        });
     }
 }
 
@@ -347,24 +1638,29 @@ void FluidSystem2D::resetGrid(float scale) {
     float xOffset = systemWidth / 2.0 - width / 2.0 * scale;
     float yOffset = systemHeight / 2.0 - height / 2.0 * scale;
     
-    for (int i = 0; i < rows; i++) {
-        float xSpace = width * scale / float(rows + 1);
-        float x = xSpace * (i + 1) + xOffset;
-        
-        for (int j = 0; j < cols; j++) {
-            int particleIndex = i * cols + j;
-            if (particleIndex >= particles.size()) return;
+    float xSpace = width * scale / float(rows + 1);
+    float ySpace = height * scale / float(cols + 1);
+    
+    resetCount++;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int particleIndex = r.begin(); particleIndex < r.end(); ++particleIndex) {
+            int i = particleIndex / cols;
+            int j = particleIndex % cols;
             
-            float ySpace = height * scale / float(cols + 1);
+            float x = xSpace * (i + 1) + xOffset;
             float y = ySpace * (j + 1) + yOffset;
             
-            float jitterX = xSpace * ofRandom(-0.1, 0.1);
-            float jitterY = ySpace * ofRandom(-0.1, 0.1);
+            float values[4];
+            random.uniform4(RESET_STREAM, particleIndex, resetCount, 0, values);
+            
+            float jitterX = xSpace * (values[0] * 0.2 - 0.1);
+            float jitterY = ySpace * (values[1] * 0.2 - 0.1);
             
             particles[particleIndex].position = ofVec2f(x + jitterX, y + jitterY);
-            particles[particleIndex].velocity = getRandom2DDirection();
+            particles[particleIndex].velocity = getRandom2DDirection(particleIndex);
         }
-    }
+    });
 }
 
 void FluidSystem2D::resetCircle(float scale) {
@@ -377,14 +1673,190 @@ void FluidSystem2D::resetCircle(float scale) {
     
     float radius = diameter / 2.0 * scale;
     
+    resetCount++;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            float values[4];
+            random.uniform4(RESET_STREAM, i, resetCount, 0, values);
+            
+            float theta = values[0] * TWO_PI;
+            float magnitude = values[1] * radius;
+            
+            float x = cos(theta) * magnitude;
+            float y = sin(theta) * magnitude;
+            
+            particles[i].position = ofVec2f(x, y) + center;
+            particles[i].velocity = getRandom2DDirection(i);
+        }
+    });
+}
+
+// checkpoints
+
+Boolean FluidSystem2D::saveCheckpoint(string path) {
+    // only live particles are written, packed in index order
+    vector<int> aliveIndices;
+    aliveIndices.reserve(aliveCount);
     for (int i = 0; i < particles.size(); i++) {
-        float theta = ofRandom(0, TWO_PI);
-        float magnitude = ofRandom(0, radius);
-        
-        float x = cos(theta) * magnitude;
-        float y = sin(theta) * magnitude;
-        
-        particles[i].position = ofVec2f(x, y) + center;
-        particles[i].velocity = getRandom2DDirection();
+        if (aliveFlags[i]) aliveIndices.push_back(i);
     }
+    int numParticles = aliveIndices.size();
+    size_t fileSize = sizeof(CheckpointHeader) + numParticles * sizeof(CheckpointParticle);
+    
+    MappedFile file;
+    if (!file.openWrite(path, fileSize)) return false;
+    
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.headerSize = sizeof(CheckpointHeader);
+    header.recordSize = sizeof(CheckpointParticle);
+    header.particleCount = numParticles;
+    
+    header.seed = random.getSeed();
+    header.stepCount = stepCount;
+    header.resetCount = resetCount;
+    header.spawnCount = spawnCount;
+    header.flags = (circleBoundaryActive ? CHECKPOINT_CIRCLE_BOUNDARY : 0) |
+        (implicitViscosityActive ? CHECKPOINT_IMPLICIT_VISCOSITY : 0) |
+        (incrementalSortActive ? CHECKPOINT_INCREMENTAL_SORT : 0) |
+        (pairCacheActive ? CHECKPOINT_PAIR_CACHE : 0);
+    
+    header.solverMode = solverMode;
+    header.neighborMode = neighborMode;
+    header.solverIterations = solverIterations;
+    header.viscosityIterations = viscosityIterations;
+    header.systemWidth = systemWidth;
+    header.systemHeight = systemHeight;
+    header.radius = radius;
+    header.deltaTime = deltaTime;
+    header.predictionFactor = predictionFactor;
+    header.collisionDamping = collisionDamping;
+    header.gravityMultiplier = gravityMultiplier;
+    header.gravityForceX = gravityForce.x;
+    header.gravityForceY = gravityForce.y;
+    header.targetDensity = targetDensity;
+    header.pressureMultiplier = pressureMultiplier;
+    header.nearPressureMultiplier = nearPressureMultiplier;
+    header.viscosityStrength = viscosityStrength;
+    header.boundsSizeX = boundsSize.x;
+    header.boundsSizeY = boundsSize.y;
+    header.boundsSizeZ = boundsSize.z;
+    header.circleBoundaryRadius = circleBoundaryRadius;
+    header.verletSkin = verletSkin;
+    header.solverTolerance = solverTolerance;
+    header.solverRestDensity = solverRestDensity;
+    
+    memcpy(file.getData(), &header, sizeof(header));
+    CheckpointParticle *records = reinterpret_cast<CheckpointParticle *>(file.getData() + sizeof(CheckpointHeader));
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            CheckpointParticle &record = records[i];
+            const Particle &particle = particles[aliveIndices[i]];
+            for (int axis = 0; axis < 3; axis++) {
+                record.position[axis] = particle.position[axis];
+                record.velocity[axis] = particle.velocity[axis];
+            }
+            record.density = particle.density;
+            record.nearDensity = particle.nearDensity;
+        }
+    });
+    
+    return true;
+}
+
+Boolean FluidSystem2D::loadCheckpoint(string path) {
+    MappedFile file;
+    if (!file.openRead(path)) return false;
+    if (file.getSize() < sizeof(CheckpointHeader)) return false;
+    
+    CheckpointHeader header;
+    memcpy(&header, file.getData(), sizeof(header));
+    
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) return false;
+    if (header.version != CHECKPOINT_VERSION) return false;
+    if (header.headerSize < sizeof(CheckpointHeader) || header.recordSize < sizeof(CheckpointParticle)) return false;
+    if (file.getSize() < header.headerSize + size_t(header.particleCount) * header.recordSize) return false;
+    
+    setWidth(header.systemWidth);
+    setHeight(header.systemHeight);
+    setBoundsSize(ofVec3f(header.boundsSizeX, header.boundsSizeY, header.boundsSizeZ));
+    setCircleBoundary(header.flags & CHECKPOINT_CIRCLE_BOUNDARY);
+    circleBoundaryRadius = header.circleBoundaryRadius;
+    
+    setAliveRange(header.particleCount);
+    setRadius(header.radius);
+    setDeltaTime(header.deltaTime);
+    predictionFactor = header.predictionFactor;
+    setCollisionDamping(header.collisionDamping);
+    setGravityMultiplier(header.gravityMultiplier);
+    gravityForce = ofVec2f(header.gravityForceX, header.gravityForceY);
+    setTargetDensity(header.targetDensity);
+    setPressureMultiplier(header.pressureMultiplier);
+    setNearPressureMultiplier(header.nearPressureMultiplier);
+    setViscosityStrength(header.viscosityStrength);
+    
+    setSolverMode(header.solverMode);
+    setSolverIterations(header.solverIterations);
+    setSolverTolerance(header.solverTolerance);
+    
+    // files written before the solver had its own rest density hold zero here
+    setSolverRestDensity(header.solverRestDensity > 0.0 ? header.solverRestDensity : 1.0);
+    setNeighborMode(header.neighborMode);
+    setVerletSkin(header.verletSkin);
+    setImplicitViscosity(header.flags & CHECKPOINT_IMPLICIT_VISCOSITY);
+    setViscosityIterations(header.viscosityIterations);
+    setIncrementalSort(header.flags & CHECKPOINT_INCREMENTAL_SORT);
+    setPairCache(header.flags & CHECKPOINT_PAIR_CACHE);
+    
+    // counters come back too, so the run continues with the same random sequence
+    random.setSeed(header.seed);
+    stepCount = header.stepCount;
+    resetCount = header.resetCount;
+    spawnCount = header.spawnCount;
+    
+    const unsigned char *recordData = file.getData() + header.headerSize;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, header.particleCount), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            CheckpointParticle record;
+            memcpy(&record, recordData + size_t(i) * header.recordSize, sizeof(record));
+            
+            particles[i].position = ofVec3f(record.position[0], record.position[1], record.position[2]);
+            particles[i].velocity = ofVec3f(record.velocity[0], record.velocity[1], record.velocity[2]);
+            particles[i].predictedPosition = particles[i].position;
+            particles[i].lastPosition = particles[i].position;
+            particles[i].velocityChange = ofVec3f::zero();
+            particles[i].density = record.density;
+            particles[i].nearDensity = record.nearDensity;
+        }
+    });
+    
+    // neighbor lists, the sorted order and the tiles belong to the old state, and every live slot
+    // was rewritten, so anything else built from the pool starts over as well
+    verletParticleCount = 0;
+    sortedParticleCount = 0;
+    tilesDirty = true;
+    poolRevision++;
+    clearPoolChanges();
+    
+    return true;
+}
+
+Boolean FluidSystem2D::verifyCheckpoint(string path) {
+    // the second file is written from the loaded state, so any field that does not survive the trip shows up
+    string verifyPath = path + ".verify";
+    if (!saveCheckpoint(path) || !loadCheckpoint(path) || !saveCheckpoint(verifyPath)) return false;
+    
+    MappedFile saved, resaved;
+    if (!saved.openRead(path) || !resaved.openRead(verifyPath)) return false;
+    
+    Boolean identical = saved.getSize() == resaved.getSize() && memcmp(saved.getData(), resaved.getData(), saved.getSize()) == 0;
+    resaved.close();
+    remove(verifyPath.c_str());
+    
+    return identical;
 }
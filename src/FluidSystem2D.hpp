@@ -9,18 +9,34 @@
 #include <stdio.h>
 #include "ofMain.h"
 #include "ParticleSystem.hpp"
+#include "SignedDistanceField.hpp"
+#include "SubdomainSolver.hpp"
 #include "tbb/parallel_for.h"
 #include "tbb/parallel_sort.h"
+#include "tbb/parallel_reduce.h"
+#include "tbb/enumerable_thread_specific.h"
+#include "tbb/concurrent_vector.h"
 
 class FluidSystem2D : public ParticleSystem {
 public:
     FluidSystem2D();
     
     void update();
+    void stepDoubleDensity();
+    void stepPositionBased();
+    void updateNeighborLists();
 
     void resolveCollisions(int particleIndex);
-    ofVec2f pushParticlesAwayFromPoint(ofVec2f pointA, ofVec2f pointB, ofVec2f velocity);
-    ofVec2f pullParticlesToPoint(ofVec2f pointA, ofVec2f pointB);
+    
+    // arbitrary container shapes, collisions cost one sample whatever the shape
+    SignedDistanceField boundaryField;
+    Boolean sdfBoundaryActive;
+    void resolveFieldCollision(int particleIndex);
+    void setSdfBoundary(Boolean sdfBoundaryActive);
+    void setBoundaryPolygons(const vector<vector<ofVec2f>> &polygons);
+    void setBoundaryMask(const ofPixels &pixels);
+    ofVec2f pushParticlesAwayFromPoint(ofVec2f pointA, ofVec2f pointB, float inputRadius, float inputForce);
+    ofVec2f pullParticlesToPoint(ofVec2f pointA, ofVec2f pointB, float inputRadius, float inputForce);
     
     // math
     float calculatePressureFromDensity(float density);
@@ -33,22 +49,305 @@ public:
     ofVec2f calculateViscosityForce(int particleIndex);
     ofVec2f calculatePressureForce(int particleIndex);
     ofVec2f calculateExternalForce(int particleIndex);
-    ofVec2f calculateInteractiveForce(int particleIndex);
+    
+    // interaction points push or pull the particles inside their radius, the mouse is one more point.
+    // only the grid cells under each disc are visited
+    struct InteractionPoint {
+        ofVec2f position;
+        float radius, force;
+        Boolean pull;
+    };
+    vector<InteractionPoint> interactionPoints;
+    void applyInteractionForces();
+    ofVec2f calculateInteractiveForce(const InteractionPoint &point, int particleIndex);
+    template <typename Callback> void foreachParticleWithinDisc(ofVec2f discCenter, float discRadius, Callback callback);
+    void setInteractionPoints(const vector<InteractionPoint> &interactionPoints);
+    
+    // emitters fill free pool slots and sinks kill whatever enters them, so inflow and outflow
+    // only touch the particles that change. rate is in particles per step
+    struct Emitter {
+        ofVec2f position, velocity;
+        float radius, rate;
+    };
+    struct Sink {
+        ofVec2f position;
+        float radius;
+    };
+    vector<Emitter> emitters;
+    vector<Sink> sinks;
+    void updateEmittersAndSinks();
+    void setEmitters(const vector<Emitter> &emitters);
+    void setSinks(const vector<Sink> &sinks);
+    
+    // position based solver enforces incompressibility iteratively. its rest density is solverRestDensity times
+    // the density of the particles spread evenly over the bounds, targetDensity only drives the double density step.
+    // solverRelaxation softens each constraint relative to its own gradient, a scale free form of the usual epsilon.
+    // it needs stored neighbor lists, streaming falls back to them
+    enum solverModes { DOUBLE_DENSITY, POSITION_BASED } solverMode;
+    int solverIterations, solverIterationCount;
+    float solverTolerance, solverRelaxation, solverError, solverRestDensity;
+    float calculateRestDensity();
+    float calculateDensityConstraint(int particleIndex, float restDensity);
+    ofVec2f calculatePositionCorrection(int particleIndex, float restDensity);
+    ofVec2f getOverlapDirection(int particleIndex, int neighborParticleIndex);
+    void setSolverMode(int solverMode);
+    void setSolverIterations(int solverIterations);
+    void setSolverTolerance(float solverTolerance);
+    void setSolverRelaxation(float solverRelaxation);
+    void setSolverRestDensity(float solverRestDensity);
+    
+    // implicit viscosity stays stable at high strength with the normal step
+    Boolean implicitViscosityActive;
+    int viscosityIterations;
+    float viscosityResidual;
+    void applyImplicitViscosity();
+    template <typename Callback> void foreachViscosityNeighbor(int particleIndex, Callback callback);
+    void setImplicitViscosity(Boolean implicitViscosityActive);
+    void setViscosityIterations(int viscosityIterations);
+    
+    // cached pair geometry shares distances and directions across the density and force passes
+    Boolean pairCacheActive;
+    pair<float, float> cachePairGeometry(int particleIndex);
+    ofVec2f calculatePressureForceCached(int particleIndex);
+    ofVec2f calculateViscosityForceCached(int particleIndex);
+    void setPairCache(Boolean pairCacheActive);
+    
+    // streaming walks the sorted cells inside each pass and stores no neighbor lists
+    pair<float, float> calculateDensityStreaming(int particleIndex);
+    pair<ofVec2f, ofVec2f> calculateForcesStreaming(int particleIndex);
+    
+    // duration of the last simulation step and the memory held by neighbor lists, for comparing modes
+    uint64_t stepMicros;
+    size_t getNeighborListBytes();
 
     // spatial lookup functions
     unsigned int hashCell(int cellX, int cellY);
     unsigned int getKeyFromHash(unsigned int hash);
     pair<int, int> positionToCellCoordinate(ofVec2f position, float radius);
     vector<int> foreachPointWithinRadius(int particleIndex);
+    template <typename Callback> void foreachNeighbor(int particleIndex, Callback callback);
     void updateSpatialLookup();
+    Boolean updateSpatialLookupIncremental();
+    float getSearchRadius();
+    
+    // neighbor search modes
+    enum neighborModes { NEIGHBOR_LISTS, VERLET_LISTS, CELL_TILES, STREAMING, OWNED_TILES } neighborMode;
+    float verletSkin;
+    Boolean verletRebuildNeeded();
+    void setNeighborMode(int neighborMode);
+    void setVerletSkin(float verletSkin);
+    
+    // incremental sort reuses the previous frame's order
+    Boolean incrementalSortActive;
+    float incrementalSortThreshold;
+    void setIncrementalSort(Boolean incrementalSortActive);
+    
+    // cell tiles gather each 3x3 neighborhood once for every particle in the center cell
+    struct TileEntry {
+        int index;
+        ofVec2f position, predictedPosition;
+    };
+    void updateDensitiesTiled();
+    void loadTile(int cellX, int cellY, vector<TileEntry> &tile);
+    
+    // owned tiles split the bounds into blocks a few cells wide, each keeping its own particle arrays,
+    // local index and halo copies, stepped as independent tasks. nothing is sorted globally and empty
+    // tiles cost nothing. particles crossing a tile edge are handed over at the end of the step
+    int tileCells;
+    void stepTiled();
+    void setTileCells(int tileCells);
+    SubdomainSolver::Settings getSubdomainSettings();
     
     // reset functions
     void resetRandom();
     void resetGrid(float scale);
     void resetCircle(float scale);
+    
+    // checkpoints hold particle state, solver settings and the random seed
+    Boolean saveCheckpoint(string path);
+    Boolean loadCheckpoint(string path);
+    
+    // saves, loads and saves again, true when both files match byte for byte. the system goes on from the loaded state
+    Boolean verifyCheckpoint(string path);
 
 private:
     vector<ofVec2f> cellOffsets;
+    float verletSearchRadius;
+    int verletParticleCount;
+    unsigned int verletPoolRevision;
+    
+    // slots in the verlet lists, and spawns since the last sort that the lookup still files under a stale cell
+    vector<char> verletListed, unsortedFlags;
+    vector<int> unsortedSpawns;
+    tbb::concurrent_vector<int> patchIndices;
+    void patchNeighborLists();
+    
+    int sortedParticleCount;
+    vector<unsigned int> previousKeys, dirtyKeys;
+    vector<pair<int, unsigned int>> movers, stayers;
+    vector<int> blockMovers, insertionPoints;
+    
+    tbb::enumerable_thread_specific<vector<TileEntry>> tileBuffers;
+    
+    vector<ofVec2f> initialVelocities, viscosityVelocities;
+    vector<float> viscosityWeightSums;
+    
+    vector<InteractionPoint> activeInteractionPoints;
+    vector<unsigned int> discKeys;
+    
+    // where a halo copy came from, so its densities can be refreshed once the owner has them
+    struct TileHalo {
+        int sourceTile, sourceIndex;
+    };
+    struct TileMigrant {
+        int particleIndex, tile;
+    };
+    vector<SubdomainSolver> tiles;
+    vector<vector<TileHalo>> tileHalos;
+    vector<vector<TileMigrant>> tileMigrants;
+    vector<int> activeTiles;
+    int tilesX, tilesY;
+    float tileSize;
+    ofVec2f tileOrigin;
+    Boolean tilesDirty;
+    unsigned int tilePoolRevision, tileResetCount;
+    vector<int> particleTiles;
+    void rebuildTiles();
+    void patchTiles();
+    int getTileIndex(float x, float y);
+    void getTileRect(int tile, float &minX, float &minY, float &maxX, float &maxY);
+    
+    vector<float> emitterBudgets;
+    tbb::concurrent_vector<int> sinkIndices;
 };
 
+template <typename Callback>
+void FluidSystem2D::foreachNeighbor(int particleIndex, Callback callback) {
+    ofVec2f position = particles[particleIndex].position;
+    float searchRadius = getSearchRadius();
+    
+    pair<int, int> center = positionToCellCoordinate(position, searchRadius);
+    int centerX = center.first;
+    int centerY = center.second;
+    float squareRadius = searchRadius * searchRadius;
+    
+    for (auto offsetPair : cellOffsets) {
+        int offsetX = offsetPair.x;
+        int offsetY = offsetPair.y;
+        
+        unsigned int key = getKeyFromHash(hashCell(centerX + offsetX, centerY + offsetY));
+        int cellStartIndex = startIndices[key];
+        
+        for (int i = cellStartIndex; i < spatialLookup.size(); i++) {
+            if (spatialLookup[i].second != key) break;
+            
+            int otherParticleIndex = spatialLookup[i].first;
+            float squareDistance = particles[otherParticleIndex].position.squareDistance(position);
+            
+            if (squareDistance <= squareRadius) {
+                callback(otherParticleIndex);
+            }
+        }
+    }
+}
+
+template <typename Callback>
+void FluidSystem2D::foreachParticleWithinDisc(ofVec2f discCenter, float discRadius, Callback callback) {
+    // verlet mode only resorts on rebuild, particles may have drifted half the skin from their cell
+    float margin = neighborMode == VERLET_LISTS ? verletSkin * 0.5 : 0.0;
+    float searchRadius = getSearchRadius();
+    float squareRadius = discRadius * discRadius;
+    
+    float reach = discRadius + margin;
+    pair<int, int> minimumCell = positionToCellCoordinate(discCenter - ofVec2f(reach, reach), searchRadius);
+    pair<int, int> maximumCell = positionToCellCoordinate(discCenter + ofVec2f(reach, reach), searchRadius);
+    int cellsX = maximumCell.first - minimumCell.first + 1;
+    int cellsY = maximumCell.second - minimumCell.second + 1;
+    
+    auto visit = [&](int particleIndex) {
+        if (!aliveFlags[particleIndex]) return;
+        if (particles[particleIndex].position.squareDistance(discCenter) < squareRadius) {
+            callback(particleIndex);
+        }
+    };
+    
+    // owned tiles keep no global lookup, the tiles under the disc are walked instead
+    if (neighborMode == OWNED_TILES && solverMode != POSITION_BASED && !tilesDirty) {
+        tbb::parallel_for( tbb::blocked_range<int>(0, activeTiles.size()), [&](tbb::blocked_range<int> r) {
+            for (int a = r.begin(); a < r.end(); ++a) {
+                int t = activeTiles[a];
+                float minX, minY, maxX, maxY;
+                getTileRect(t, minX, minY, maxX, maxY);
+                float nearestX = ofClamp(discCenter.x, minX, maxX);
+                float nearestY = ofClamp(discCenter.y, minY, maxY);
+                if (ofVec2f(nearestX, nearestY).squareDistance(discCenter) > squareRadius) continue;
+                
+                for (int k = 0; k < tiles[t].ownedCount; k++) {
+                    visit(tiles[t].ids[k]);
+                }
+            }
+        });
+        return;
+    }
+    
+    // a disc covering more cells than there are particles is cheaper to test directly
+    if (int64_t(cellsX) * cellsY > int64_t(particles.size())) {
+        tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                visit(i);
+            }
+        });
+        return;
+    }
+    
+    // distinct cells can hash to the same key, each bucket is walked once.
+    // spawns the lookup has not sorted yet are skipped in their old cell and tested directly
+    discKeys.clear();
+    for (int x = minimumCell.first; x <= maximumCell.first; x++) {
+        for (int y = minimumCell.second; y <= maximumCell.second; y++) {
+            discKeys.push_back(getKeyFromHash(hashCell(x, y)));
+        }
+    }
+    std::sort(discKeys.begin(), discKeys.end());
+    discKeys.erase(std::unique(discKeys.begin(), discKeys.end()), discKeys.end());
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, discKeys.size()), [&](tbb::blocked_range<int> r) {
+        for (int k = r.begin(); k < r.end(); ++k) {
+            unsigned int key = discKeys[k];
+            for (int i = startIndices[key]; i < spatialLookup.size(); i++) {
+                if (spatialLookup[i].second != key) break;
+                int particleIndex = spatialLookup[i].first;
+                if (!unsortedSpawns.empty() && unsortedFlags[particleIndex]) continue;
+                visit(particleIndex);
+            }
+        }
+    });
+    
+    for (int particleIndex : unsortedSpawns) {
+        visit(particleIndex);
+    }
+}
+
+template <typename Callback>
+void FluidSystem2D::foreachViscosityNeighbor(int particleIndex, Callback callback) {
+    ofVec2f particlePosition = particles[particleIndex].predictedPosition;
+    
+    auto visit = [&](int neighborParticleIndex) {
+        if (particleIndex == neighborParticleIndex) return;
+        
+        float distance = particlePosition.distance(particles[neighborParticleIndex].predictedPosition);
+        if (distance > radius) return;
+        
+        callback(neighborParticleIndex, kernels.viscosityKernel(distance, radius));
+    };
+    
+    if (neighborMode == STREAMING && solverMode != POSITION_BASED) {
+        foreachNeighbor(particleIndex, visit);
+    } else {
+        for (int neighborParticleIndex : particles[particleIndex].indicesWithinRadius) {
+            visit(neighborParticleIndex);
+        }
+    }
+}
+
 #endif /* FluidSystem2D_hpp */
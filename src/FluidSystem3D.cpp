@@ -8,19 +8,16 @@
 FluidSystem3D::FluidSystem3D() {
     kernels.calculate3DVolumesFromRadius(radius);
     
-    for (int i = -1; i < 2; i++) {
-        for (int j = -1; j < 2; j++) {
-            for (int k = -1; k < 2; k++) {
-                cellOffsets.push_back(ofVec3f(i, j, k));
-            }
-        }
-    }
+    neighborMode = COMPACT_HASH;
 }
 
 void FluidSystem3D::update() {
     if (!pauseActive || nextFrameActive) {
+        forceField.acquire();
+        
         tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
             for (int i = r.begin(); i < r.end(); i++) {
+                if (!aliveFlags[i]) continue;
                 ofVec3f externalForce = calculateExternalForce(i);
                 particles[i].velocity += externalForce;
                 particles[i].predictedPosition = particles[i].position + particles[i].velocity * predictionFactor;
@@ -29,8 +26,12 @@ void FluidSystem3D::update() {
         
         updateSpatialLookup();
         
-        tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
-            for (int i = r.begin(); i < r.end(); i++) {
+        // both neighbor passes walk the particles in morton order, so neighbors are mostly still cached
+        const vector<int> &sortedIndices = getSortedIndices();
+        
+        tbb::parallel_for( tbb::blocked_range<int>(0, sortedIndices.size()), [&](tbb::blocked_range<int> r) {
+            for (int j = r.begin(); j < r.end(); j++) {
+                int i = sortedIndices[j];
                 particles[i].indicesWithinRadius = foreachPointWithinRadius(i);
                 pair<float, float> densities = calculateDensity(i);
                 particles[i].density = densities.first;
@@ -38,29 +39,32 @@ void FluidSystem3D::update() {
             }
         });
         
-        tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
-            for (int i = r.begin(); i < r.end(); i++) {
+        tbb::parallel_for( tbb::blocked_range<int>(0, sortedIndices.size()), [&](tbb::blocked_range<int> r) {
+            for (int j = r.begin(); j < r.end(); j++) {
+                int i = sortedIndices[j];
                 ofVec3f pressureForce = calculatePressureForce(i);
                 ofVec3f pressureAcceleration = pressureForce / particles[i].density;
-                particles[i].velocity += pressureAcceleration * deltaTime;
-                
                 ofVec3f viscosityForce = calculateViscosityForce(i);
-                particles[i].velocity += viscosityForce * deltaTime;
+                particles[i].velocityChange = (pressureAcceleration + viscosityForce) * deltaTime;
             }
         });
         
         tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
             for (int i = r.begin(); i < r.end(); i++) {
+                if (!aliveFlags[i]) continue;
+                particles[i].velocity += particles[i].velocityChange;
                 particles[i].position += particles[i].velocity * deltaTime;
                 resolveCollisions(i);
             }
         });
         
+        stepCount++;
         nextFrameActive = false;
     }
     
     tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
         for (int i = r.begin(); i < r.end(); i++) {
+            if (!aliveFlags[i]) continue;
             particles[i].update();
         }
     });
@@ -119,11 +123,15 @@ ofVec3f FluidSystem3D::calculateExternalForce(int particleIndex) {
         interactiveForce = calculateInteractiveForce(particleIndex);
     }
     
+    if (forceField.isActive()) {
+        interactiveForce += forceField.sample(particles[particleIndex].position) * deltaTime;
+    }
+    
     return interactiveForce + gravityForce * gravityMultiplier * deltaTime;
 }
 
 pair<float, float> FluidSystem3D::calculateDensity(int particleIndex) {
-    vector<int> indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+    const vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
     ofVec3f particlePosition = particles[particleIndex].predictedPosition;
     
     float density = 0.0f;
@@ -141,7 +149,7 @@ pair<float, float> FluidSystem3D::calculateDensity(int particleIndex) {
 }
 
 ofVec3f FluidSystem3D::calculatePressureForce(int particleIndex) {
-    vector<int> indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+    const vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
     ofVec3f particlePosition = particles[particleIndex].predictedPosition;
     float density = particles[particleIndex].density;
     float nearDensity = particles[particleIndex].nearDensity;
@@ -157,7 +165,7 @@ ofVec3f FluidSystem3D::calculatePressureForce(int particleIndex) {
         ofVec3f neighborPosition = particles[neighborParticleIndex].predictedPosition;
         float distance = particlePosition.distance(neighborPosition);
         ofVec3f direction = (neighborPosition - particlePosition) / distance;
-        direction = distance == 0.0 ? getRandom3DDirection() : direction;
+        direction = distance == 0.0 ? getRandom3DDirection(particleIndex, neighborParticleIndex) : direction;
         
         float slope = kernels.densityDerivative(distance, radius);
         float nearSlope = kernels.nearDensityDerivative(distance, radius);
@@ -178,7 +186,7 @@ ofVec3f FluidSystem3D::calculatePressureForce(int particleIndex) {
 }
 
 ofVec3f FluidSystem3D::calculateViscosityForce(int particleIndex) {
-    vector<int> indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
+    const vector<int> &indicesWithinRadius = particles[particleIndex].indicesWithinRadius;
     ofVec3f particlePosition = particles[particleIndex].predictedPosition;
     ofVec3f viscosityForce = ofVec3f::zero();
     
@@ -207,78 +215,52 @@ float FluidSystem3D::calculateNearPressureFromDensity(float nearDensity) {
 
 vector<int> FluidSystem3D::foreachPointWithinRadius(int particleIndex) {
     ofVec3f position = particles[particleIndex].position;
-    
-    ofVec3f center = positionToCellCoordinate(position, radius);
-    int centerX = center.x;
-    int centerY = center.y;
-    int centerZ = center.z;
     float squareRadius = radius * radius;
     
     vector<int> indicesWithinRadius;
     
-    for (auto offsetPair : cellOffsets) {
-        int offsetX = offsetPair.x;
-        int offsetY = offsetPair.y;
-        int offsetZ = offsetPair.z;
+    auto visit = [&](int otherParticleIndex) {
+        float squareDistance = particles[otherParticleIndex].position.squareDistance(position);
         
-        ofVec3f cell = ofVec3f(centerX + offsetX, centerY + offsetY, centerX + offsetZ);
-        unsigned int key = getKeyFromHash(hashCell(cell));
-        int cellStartIndex = startIndices[key];
-        
-        for (int i = cellStartIndex; i < spatialLookup.size(); i++) {
-            if (spatialLookup[i].second != key) break;
-            
-            int otherParticleIndex = spatialLookup[i].first;
-            float squareDistance = particles[otherParticleIndex].position.squareDistance(position);
-            
-            if (squareDistance <= squareRadius) {
-                indicesWithinRadius.push_back(otherParticleIndex);
-            }
+        if (squareDistance <= squareRadius) {
+            indicesWithinRadius.push_back(otherParticleIndex);
         }
+    };
+    
+    if (neighborMode == SPARSE_GRID) {
+        sparseGrid.foreachCandidate(particleIndex, visit);
+    } else {
+        spatialHash.foreachCandidate(particleIndex, visit);
     }
     
     return indicesWithinRadius;
 }
 
 void FluidSystem3D::updateSpatialLookup() {
-    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
-        for (int i = r.begin(); i < r.end(); i++) {
-            ofVec3f cell = positionToCellCoordinate(particles[i].position, radius);
-            unsigned int cellKey = getKeyFromHash(hashCell(cell));
-            spatialLookup[i] = pair<int, unsigned int> (i, cellKey);
-            startIndices[i] = INT_MAX;
-        }
-    });
-    
-    tbb::parallel_sort(spatialLookup.begin(), spatialLookup.end(), [](auto &left, auto &right) {
-        return left.second < right.second;
-    });
-    
-    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
-        for (int i = r.begin(); i < r.end(); i++) {
-            unsigned int key = spatialLookup[i].second;
-            unsigned int keyPrev = i == 0 ? UINT_MAX : spatialLookup[i - 1].second;
-            if (key != keyPrev) {
-                startIndices[key] = i;
-            }
-        }
-    });
+    if (neighborMode == SPARSE_GRID) {
+        sparseGrid.build(particles, aliveFlags, radius);
+    } else {
+        spatialHash.build(particles, aliveFlags, radius);
+    }
 }
 
-unsigned int FluidSystem3D::hashCell(ofVec3f cell) {
-    unsigned int a = u_int(cell.x * 15823);
-    unsigned int b = u_int(cell.y * 9737333);
-    unsigned int c = u_int(cell.z * 440817757);
-    
-    return a + b + c;
+const vector<int> &FluidSystem3D::getSortedIndices() {
+    if (neighborMode == SPARSE_GRID) {
+        return sparseGrid.sortedIndices;
+    }
+    return spatialHash.sortedIndices;
 }
 
-unsigned int FluidSystem3D::getKeyFromHash(unsigned int hash) {
-    return hash % u_int(spatialLookup.size());
+void FluidSystem3D::setNeighborMode(int _neighborModeInt) {
+    if (_neighborModeInt == 0) {
+        neighborMode = COMPACT_HASH;
+    } else if (_neighborModeInt == 1) {
+        neighborMode = SPARSE_GRID;
+    }
 }
 
-ofVec3f FluidSystem3D::positionToCellCoordinate(ofVec3f position, float radius) {
-    return ofVec3f(int(position.x / radius), int(position.y / radius), int(position.z / radius));
+CompactHash3D::Cell FluidSystem3D::positionToCellCoordinate(ofVec3f position, float radius) {
+    return CompactHash3D::positionToCell(position, radius);
 }
 
 void FluidSystem3D::resolveCollisions(int particleIndex) {
@@ -313,17 +295,36 @@ void FluidSystem3D::resolveCollisions(int particleIndex) {
     }
 }
 
+// surface
+
+void FluidSystem3D::updateSurface() {
+    isosurface.splat(particles, aliveFlags, radius, surfaceResolution);
+    isosurface.extract(surfaceThreshold, mesh);
+}
+
+void FluidSystem3D::draw() {
+    updateSurface();
+    mesh.draw();
+}
+
 // reset particles
 
 void FluidSystem3D::resetRandom() {
-    for (int i = 0; i < particles.size(); i++) {
-        float x = ofRandom(bounds.x, bounds.x + boundsSize.x);
-        float y = ofRandom(bounds.y, bounds.y + boundsSize.y);
-        float z = ofRandom(bounds.z, bounds.z + boundsSize.z);
-        
-        particles[i].position = ofVec3f(x, y, z);
-        particles[i].velocity = getRandom3DDirection();
-    }
+    resetCount++;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            float values[4];
+            random.uniform4(RESET_STREAM, i, resetCount, 0, values);
+            
+            float x = bounds.x + values[0] * boundsSize.x;
+            float y = bounds.y + values[1] * boundsSize.y;
+            float z = bounds.z + values[2] * boundsSize.z;
+            
+            particles[i].position = ofVec3f(x, y, z);
+            particles[i].velocity = getRandom3DDirection(i);
+        }
+    });
 }
 
 // ya this is is a fun one to figure out
@@ -337,24 +338,29 @@ void FluidSystem3D::resetGrid(float scale) {
     float xOffset = ofGetWidth() / 2.0 - width / 2.0 * scale;
     float yOffset = ofGetHeight() / 2.0 - height / 2.0 * scale;
     
-    for (int i = 0; i < rows; i++) {
-        float xSpace = width * scale / float(rows + 1);
-        float x = xSpace * (i + 1) + xOffset;
-        
-        for (int j = 0; j < cols; j++) {
-            int particleIndex = i * cols + j;
-            if (particleIndex >= particles.size()) return;
+    float xSpace = width * scale / float(rows + 1);
+    float ySpace = height * scale / float(cols + 1);
+    
+    resetCount++;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int particleIndex = r.begin(); particleIndex < r.end(); ++particleIndex) {
+            int i = particleIndex / cols;
+            int j = particleIndex % cols;
             
-            float ySpace = height * scale / float(cols + 1);
+            float x = xSpace * (i + 1) + xOffset;
             float y = ySpace * (j + 1) + yOffset;
             
-            float jitterX = xSpace * ofRandom(-0.1, 0.1);
-            float jitterY = ySpace * ofRandom(-0.1, 0.1);
+            float values[4];
+            random.uniform4(RESET_STREAM, particleIndex, resetCount, 0, values);
+            
+            float jitterX = xSpace * (values[0] * 0.2 - 0.1);
+            float jitterY = ySpace * (values[1] * 0.2 - 0.1);
             
             particles[particleIndex].position = ofVec2f(x + jitterX, y + jitterY);
-            particles[particleIndex].velocity = getRandom2DDirection();
+            particles[particleIndex].velocity = getRandom2DDirection(particleIndex);
         }
-    }
+    });
 }
 
 // generate points within sphere, from this beautiful website
@@ -369,21 +375,28 @@ void FluidSystem3D::resetCircle(float scale) {
     
     float radius = diameter / 2.0 * scale;
     
-    for (int i = 0; i < particles.size(); i++) {
-        float u = ofRandom(0.0, 1.0);
-        float v = ofRandom(0.0, 1.0);
-        float theta = u * TWO_PI;
-        float phi = acos(2.0 * v - 1.0);
-        float r = pow(ofRandom(0.0, 1.0), 0.333) * radius;
-        float sinTheta = sin(theta);
-        float cosTheta = cos(theta);
-        float sinPhi = sin(phi);
-        float cosPhi = cos(phi);
-        float x = r * sinPhi * cosTheta;
-        float y = r * sinPhi * sinTheta;
-        float z = r * cosPhi;
-        
-        particles[i].position = ofVec3f(x, y, z) + center;
-        particles[i].velocity = getRandom3DDirection();
-    }
+    resetCount++;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, particles.size()), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            float values[4];
+            random.uniform4(RESET_STREAM, i, resetCount, 0, values);
+            
+            float u = values[0];
+            float v = values[1];
+            float theta = u * TWO_PI;
+            float phi = acos(2.0 * v - 1.0);
+            float r = pow(values[2], 0.333) * radius;
+            float sinTheta = sin(theta);
+            float cosTheta = cos(theta);
+            float sinPhi = sin(phi);
+            float cosPhi = cos(phi);
+            float x = r * sinPhi * cosTheta;
+            float y = r * sinPhi * sinTheta;
+            float z = r * cosPhi;
+            
+            particles[i].position = ofVec3f(x, y, z) + center;
+            particles[i].velocity = getRandom3DDirection(i);
+        }
+    });
 }
@@ -9,6 +9,9 @@
 #include <stdio.h>
 #include "ofMain.h"
 #include "ParticleSystem.hpp"
+#include "CompactHash3D.hpp"
+#include "SparseBlockGrid3D.hpp"
+#include "MarchingCubes.hpp"
 #include "tbb/parallel_for.h"
 #include "tbb/parallel_sort.h"
 
@@ -35,20 +38,26 @@ public:
     ofVec3f calculateExternalForce(int particleIndex);
     ofVec3f calculateInteractiveForce(int particleIndex);
 
-    // spatial lookup functions
-    unsigned int hashCell(ofVec3f cell);
-    unsigned int getKeyFromHash(unsigned int hash);
-    ofVec3f positionToCellCoordinate(ofVec3f position, float radius);
+    // spatial lookup functions, cells are integers and only occupied ones are stored.
+    // the sparse grid suits a small body of fluid moving through large bounds
+    enum neighborModes { COMPACT_HASH, SPARSE_GRID } neighborMode;
+    CompactHash3D spatialHash;
+    SparseBlockGrid3D sparseGrid;
+    void setNeighborMode(int neighborMode);
+    const vector<int> &getSortedIndices();
+    CompactHash3D::Cell positionToCellCoordinate(ofVec3f position, float radius);
     vector<int> foreachPointWithinRadius(int particleIndex);
     void updateSpatialLookup();
     
+    // the 3D system is drawn as its liquid surface, using the threshold and resolution of the 2D surface mode
+    MarchingCubes isosurface;
+    void updateSurface();
+    void draw();
+    
     // reset functions
     void resetRandom();
     void resetGrid(float scale);
     void resetCircle(float scale);
-
-private:
-    vector<ofVec3f> cellOffsets;
 };
 
 #endif /* FliudSystem3D_hpp */
@@ -0,0 +1,184 @@
+//
+//  ForceField.cpp
+//  fluidSimulation
+//
+
+#include "ForceField.hpp"
+
+// noise cycles per world unit for the wind and flow presets
+#define FORCE_FIELD_NOISE_SCALE 0.005
+
+ForceField::ForceField() {
+    strength = 1.0;
+    updateRate = 30.0;
+    width = 0;
+    height = 0;
+    depth = 0;
+    sampledLayer = nullptr;
+    workerActive = false;
+}
+
+ForceField::~ForceField() {
+    stop();
+}
+
+void ForceField::setup(int _width, int _height, int _depth, ofVec3f _origin, ofVec3f _size) {
+    stop();
+    
+    width = std::max(1, _width);
+    height = std::max(1, _height);
+    depth = std::max(1, _depth);
+    origin = _origin;
+    size = _size;
+    cellSize = ofVec3f(size.x / width, size.y / height, size.z / depth);
+    inverseCellSize = ofVec3f(cellSize.x > 0.0 ? 1.0 / cellSize.x : 0.0,
+                              cellSize.y > 0.0 ? 1.0 / cellSize.y : 0.0,
+                              cellSize.z > 0.0 ? 1.0 / cellSize.z : 0.0);
+    
+    std::lock_guard<std::mutex> lock(layerMutex);
+    latestLayer.reset();
+    spareLayers.clear();
+    currentLayer.reset();
+    sampledLayer = nullptr;
+}
+
+void ForceField::setGenerator(Generator _generator, float _updateRate) {
+    stop();
+    
+    generator = _generator;
+    updateRate = std::max(1.0f, _updateRate);
+    if (!generator) return;
+    
+    // the first layer is built right away so the next step already has a field
+    std::shared_ptr<Layer> layer = getSpareLayer();
+    generator(*layer, origin, cellSize, ofGetElapsedTimef());
+    publish(layer);
+    
+    workerActive = true;
+    worker = std::thread(&ForceField::runGenerator, this);
+}
+
+void ForceField::setPreset(int preset) {
+    ofVec3f center = origin + size * 0.5;
+    float extent = std::max(size.x, size.y) * 0.5;
+    
+    if (preset == WIND) {
+        setGenerator([](Layer &layer, ofVec3f origin, ofVec3f cellSize, float time) {
+            // a steady push to the right that gusts over time and with height
+            for (int j = 0; j < layer.height; j++) {
+                float y = origin.y + (j + 0.5) * cellSize.y;
+                float gust = 1.0 + 0.5 * ofSignedNoise(y * FORCE_FIELD_NOISE_SCALE, time * 0.5, 0.0);
+                for (int i = 0; i < layer.width; i++) {
+                    int index = j * layer.width + i;
+                    layer.x[index] = 10.0 * gust;
+                    layer.y[index] = 0.0;
+                }
+            }
+        }, updateRate);
+    } else if (preset == SWIRL) {
+        setGenerator([center, extent](Layer &layer, ofVec3f origin, ofVec3f cellSize, float) {
+            // tangential around the center, strongest halfway out
+            for (int j = 0; j < layer.height; j++) {
+                for (int i = 0; i < layer.width; i++) {
+                    ofVec2f position = ofVec2f(origin.x + (i + 0.5) * cellSize.x, origin.y + (j + 0.5) * cellSize.y);
+                    ofVec2f offset = position - ofVec2f(center.x, center.y);
+                    float distance = offset.length() / std::max(extent, 1.0f);
+                    float falloff = distance * exp(-distance * distance * 2.0);
+                    
+                    int index = j * layer.width + i;
+                    layer.x[index] = -offset.y / std::max(offset.length(), 1.0f) * 40.0 * falloff;
+                    layer.y[index] = offset.x / std::max(offset.length(), 1.0f) * 40.0 * falloff;
+                }
+            }
+        }, updateRate);
+    } else if (preset == FLOW) {
+        setGenerator([](Layer &layer, ofVec3f origin, ofVec3f cellSize, float time) {
+            // curl of a noise potential, divergence free so it stirs without piling particles up.
+            // the noise is taken at cell centers in world units, so the pattern keeps its size at any resolution
+            float epsilon = 0.5;
+            for (int j = 0; j < layer.height; j++) {
+                for (int i = 0; i < layer.width; i++) {
+                    float x = (origin.x + (i + 0.5) * cellSize.x) * FORCE_FIELD_NOISE_SCALE;
+                    float y = (origin.y + (j + 0.5) * cellSize.y) * FORCE_FIELD_NOISE_SCALE;
+                    float dx = ofSignedNoise(x + epsilon, y, time * 0.2) - ofSignedNoise(x - epsilon, y, time * 0.2);
+                    float dy = ofSignedNoise(x, y + epsilon, time * 0.2) - ofSignedNoise(x, y - epsilon, time * 0.2);
+                    
+                    int index = j * layer.width + i;
+                    layer.x[index] = dy * 20.0;
+                    layer.y[index] = -dx * 20.0;
+                }
+            }
+        }, updateRate);
+    } else {
+        setGenerator(nullptr, updateRate);
+        
+        std::lock_guard<std::mutex> lock(layerMutex);
+        latestLayer.reset();
+    }
+}
+
+void ForceField::submit(const vector<float> &x, const vector<float> &y, const vector<float> &z) {
+    // externally computed fields, for example optical flow, arrive at whatever rate they are produced
+    int numCells = width * height * depth;
+    if (x.size() != numCells || y.size() != numCells) return;
+    
+    std::shared_ptr<Layer> layer = getSpareLayer();
+    layer->x = x;
+    layer->y = y;
+    if (z.size() == numCells) {
+        layer->z = z;
+    } else {
+        std::fill(layer->z.begin(), layer->z.end(), 0.0f);
+    }
+    publish(layer);
+}
+
+void ForceField::stop() {
+    if (!workerActive) return;
+    workerActive = false;
+    worker.join();
+}
+
+void ForceField::acquire() {
+    std::lock_guard<std::mutex> lock(layerMutex);
+    currentLayer = latestLayer;
+    sampledLayer = currentLayer.get();
+}
+
+void ForceField::runGenerator() {
+    auto interval = std::chrono::microseconds(int64_t(1000000.0 / updateRate));
+    auto nextUpdate = std::chrono::steady_clock::now() + interval;
+    
+    while (workerActive) {
+        std::this_thread::sleep_until(nextUpdate);
+        nextUpdate += interval;
+        
+        std::shared_ptr<Layer> layer = getSpareLayer();
+        generator(*layer, origin, cellSize, ofGetElapsedTimef());
+        publish(layer);
+    }
+}
+
+std::shared_ptr<ForceField::Layer> ForceField::getSpareLayer() {
+    std::lock_guard<std::mutex> lock(layerMutex);
+    
+    // a spare is free once neither the latest slot nor a running step holds it
+    for (auto &layer : spareLayers) {
+        if (layer.use_count() == 1) return layer;
+    }
+    
+    auto layer = std::make_shared<Layer>();
+    layer->width = width;
+    layer->height = height;
+    layer->depth = depth;
+    layer->x.assign(width * height * depth, 0.0f);
+    layer->y.assign(width * height * depth, 0.0f);
+    layer->z.assign(width * height * depth, 0.0f);
+    spareLayers.push_back(layer);
+    return layer;
+}
+
+void ForceField::publish(std::shared_ptr<Layer> layer) {
+    std::lock_guard<std::mutex> lock(layerMutex);
+    latestLayer = layer;
+}
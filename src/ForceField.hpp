@@ -0,0 +1,137 @@
+//
+//  ForceField.hpp
+//  fluidSimulation
+//
+
+#ifndef ForceField_hpp
+#define ForceField_hpp
+
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include "ofMain.h"
+#include "Platform.hpp"
+
+// low resolution grid of accelerations sampled per particle. a worker rebuilds the grid at its
+// own rate into a spare layer and swaps it in, the simulation grabs the newest layer once per step
+class ForceField {
+public:
+    ForceField();
+    ~ForceField();
+    
+    // components are stored in separate arrays, row by row. sampling is still a scalar bilinear lookup
+    // per particle, from positions in the particle structs, nothing here is vectorized
+    struct Layer {
+        int width, height, depth;
+        vector<float> x, y, z;
+    };
+    
+    enum presets { NONE, WIND, SWIRL, FLOW };
+    typedef std::function<void(Layer &layer, ofVec3f origin, ofVec3f cellSize, float time)> Generator;
+    
+    void setup(int width, int height, int depth, ofVec3f origin, ofVec3f size);
+    void setGenerator(Generator generator, float updateRate);
+    void setPreset(int preset);
+    void submit(const vector<float> &x, const vector<float> &y, const vector<float> &z);
+    void stop();
+    
+    void acquire();
+    inline Boolean isActive() const;
+    inline ofVec2f sample(ofVec2f position) const;
+    inline ofVec3f sample(ofVec3f position) const;
+    
+    float strength, updateRate;
+    
+private:
+    void runGenerator();
+    std::shared_ptr<Layer> getSpareLayer();
+    void publish(std::shared_ptr<Layer> layer);
+    
+    int width, height, depth;
+    ofVec3f origin, size, cellSize, inverseCellSize;
+    
+    std::mutex layerMutex;
+    std::shared_ptr<Layer> latestLayer;
+    vector<std::shared_ptr<Layer>> spareLayers;
+    
+    // held for the whole step so a swap never changes the field under a pass
+    std::shared_ptr<Layer> currentLayer;
+    const Layer *sampledLayer;
+    
+    Generator generator;
+    std::thread worker;
+    std::atomic<bool> workerActive;
+};
+
+inline Boolean ForceField::isActive() const {
+    return sampledLayer != nullptr && strength != 0.0;
+}
+
+inline ofVec2f ForceField::sample(ofVec2f position) const {
+    const Layer &layer = *sampledLayer;
+    
+    // samples sit at cell centers, positions outside the grid take the nearest edge
+    float gridX = ofClamp((position.x - origin.x) * inverseCellSize.x - 0.5f, 0.0f, layer.width - 1.0f);
+    float gridY = ofClamp((position.y - origin.y) * inverseCellSize.y - 0.5f, 0.0f, layer.height - 1.0f);
+    int cellX = int(gridX);
+    int cellY = int(gridY);
+    float fractionX = gridX - cellX;
+    float fractionY = gridY - cellY;
+    
+    int index00 = cellY * layer.width + cellX;
+    int index01 = index00 + std::min(1, layer.width - 1 - cellX);
+    int index10 = index00 + (cellY < layer.height - 1 ? layer.width : 0);
+    int index11 = index10 + (index01 - index00);
+    
+    float weight00 = (1.0f - fractionX) * (1.0f - fractionY);
+    float weight01 = fractionX * (1.0f - fractionY);
+    float weight10 = (1.0f - fractionX) * fractionY;
+    float weight11 = fractionX * fractionY;
+    
+    float forceX = layer.x[index00] * weight00 + layer.x[index01] * weight01 + layer.x[index10] * weight10 + layer.x[index11] * weight11;
+    float forceY = layer.y[index00] * weight00 + layer.y[index01] * weight01 + layer.y[index10] * weight10 + layer.y[index11] * weight11;
+    
+    return ofVec2f(forceX, forceY) * strength;
+}
+
+inline ofVec3f ForceField::sample(ofVec3f position) const {
+    const Layer &layer = *sampledLayer;
+    if (layer.depth <= 1) {
+        ofVec2f force = sample(ofVec2f(position.x, position.y));
+        return ofVec3f(force.x, force.y, 0.0);
+    }
+    
+    float gridX = ofClamp((position.x - origin.x) * inverseCellSize.x - 0.5f, 0.0f, layer.width - 1.0f);
+    float gridY = ofClamp((position.y - origin.y) * inverseCellSize.y - 0.5f, 0.0f, layer.height - 1.0f);
+    float gridZ = ofClamp((position.z - origin.z) * inverseCellSize.z - 0.5f, 0.0f, layer.depth - 1.0f);
+    int cellX = int(gridX);
+    int cellY = int(gridY);
+    int cellZ = int(gridZ);
+    float fraction[3] = { gridX - cellX, gridY - cellY, gridZ - cellZ };
+    
+    int stepX = std::min(1, layer.width - 1 - cellX);
+    int stepY = cellY < layer.height - 1 ? layer.width : 0;
+    int stepZ = cellZ < layer.depth - 1 ? layer.width * layer.height : 0;
+    int base = (cellZ * layer.height + cellY) * layer.width + cellX;
+    
+    ofVec3f force = ofVec3f::zero();
+    for (int corner = 0; corner < 8; corner++) {
+        int cornerX = corner & 1;
+        int cornerY = (corner >> 1) & 1;
+        int cornerZ = (corner >> 2) & 1;
+        
+        int index = base + cornerX * stepX + cornerY * stepY + cornerZ * stepZ;
+        float weight = (cornerX ? fraction[0] : 1.0f - fraction[0]) *
+            (cornerY ? fraction[1] : 1.0f - fraction[1]) *
+            (cornerZ ? fraction[2] : 1.0f - fraction[2]);
+        
+        force += ofVec3f(layer.x[index], layer.y[index], layer.z[index]) * weight;
+    }
+    
+    return force * strength;
+}
+
+#endif /* ForceField_hpp */
@@ -0,0 +1,171 @@
+//
+//  FrameReader.cpp
+//  fluidSimulation
+//
+
+#include "FrameReader.hpp"
+#include <string.h>
+
+FrameReader::FrameReader() {
+    decodedFrame = -1;
+    decodedParticleCount = 0;
+    appliedParticleCount = -1;
+    appliedPoolRevision = 0;
+}
+
+Boolean FrameReader::open(string path) {
+    close();
+    
+    if (!file.openRead(path)) return false;
+    if (file.getSize() < sizeof(RecordingHeader)) {
+        close();
+        return false;
+    }
+    
+    RecordingHeader header;
+    memcpy(&header, file.getData(), sizeof(header));
+    
+    if (memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != RECORDING_VERSION ||
+        header.chunkHeaderSize != sizeof(RecordingChunkHeader)) {
+        close();
+        return false;
+    }
+    
+    // use the index when the recording was closed cleanly, otherwise walk the chunks
+    Boolean indexed = false;
+    if (file.getSize() >= header.headerSize + sizeof(RecordingFooter)) {
+        RecordingFooter footer;
+        memcpy(&footer, file.getData() + file.getSize() - sizeof(footer), sizeof(footer));
+        
+        uint64_t indexSize = uint64_t(footer.frameCount) * sizeof(uint64_t);
+        if (footer.magic == RECORDING_FOOTER_MAGIC && footer.indexOffset + indexSize + sizeof(footer) == file.getSize()) {
+            chunkOffsets.resize(footer.frameCount);
+            memcpy(chunkOffsets.data(), file.getData() + footer.indexOffset, indexSize);
+            indexed = true;
+        }
+    }
+    
+    if (!indexed) {
+        chunkOffsets.clear();
+        uint64_t offset = header.headerSize;
+        while (offset + sizeof(RecordingChunkHeader) <= file.getSize()) {
+            RecordingChunkHeader chunk;
+            memcpy(&chunk, file.getData() + offset, sizeof(chunk));
+            if (chunk.magic != RECORDING_CHUNK_MAGIC) break;
+            if (offset + sizeof(chunk) + chunk.payloadSize > file.getSize()) break;
+            
+            chunkOffsets.push_back(offset);
+            offset += sizeof(chunk) + chunk.payloadSize;
+        }
+    }
+    
+    return true;
+}
+
+void FrameReader::close() {
+    file.close();
+    chunkOffsets.clear();
+    decodedFrame = -1;
+    decodedParticleCount = 0;
+    appliedParticleCount = -1;
+    appliedPoolRevision = 0;
+}
+
+Boolean FrameReader::isOpen() {
+    return file.isOpen();
+}
+
+int FrameReader::getFrameCount() {
+    return chunkOffsets.size();
+}
+
+const RecordingChunkHeader * FrameReader::getChunk(int frame) {
+    return reinterpret_cast<const RecordingChunkHeader *>(file.getData() + chunkOffsets[frame]);
+}
+
+Boolean FrameReader::readFrame(int frame, ParticleSystem &particleSystem) {
+    if (frame < 0 || frame >= chunkOffsets.size()) return false;
+    
+    if (frame != decodedFrame) {
+        // delta frames need every frame back to their keyframe, unless we are just one step ahead
+        int firstFrame = frame;
+        if (decodedFrame != frame - 1) {
+            while (firstFrame > 0 && getChunk(firstFrame)->encoding == RECORDING_DELTA) {
+                firstFrame--;
+            }
+        }
+        
+        for (int i = firstFrame; i <= frame; i++) {
+            if (!decodeChunk(i)) return false;
+        }
+    }
+    
+    int numParticles = decodedParticleCount;
+    // decoded particles go into the first slots, everything past them is dead.
+    // the range only needs setting again when the count changes or something else touched the pool
+    if (numParticles != appliedParticleCount || particleSystem.poolRevision != appliedPoolRevision) {
+        particleSystem.setAliveRange(numParticles);
+        appliedParticleCount = numParticles;
+        appliedPoolRevision = particleSystem.poolRevision;
+    }
+    
+    const float *positionX = channels.data();
+    const float *positionY = positionX + numParticles;
+    const float *velocityX = positionY + numParticles;
+    const float *velocityY = velocityX + numParticles;
+    const float *density = velocityY + numParticles;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            Particle &particle = particleSystem.particles[i];
+            particle.position = ofVec3f(positionX[i], positionY[i], 0.0);
+            particle.velocity = ofVec3f(velocityX[i], velocityY[i], 0.0);
+            particle.density = density[i];
+            particle.update();
+            particleSystem.updateMesh(i);
+        }
+    });
+    
+    return true;
+}
+
+Boolean FrameReader::decodeChunk(int frame) {
+    const RecordingChunkHeader *chunk = getChunk(frame);
+    const unsigned char *payload = reinterpret_cast<const unsigned char *>(chunk) + sizeof(RecordingChunkHeader);
+    const unsigned char *payloadEnd = payload + chunk->payloadSize;
+    
+    int numParticles = chunk->particleCount;
+    int numValues = numParticles * RECORDING_CHANNELS;
+    channels.resize(numValues);
+    
+    if (chunk->encoding == RECORDING_RAW) {
+        if (chunk->payloadSize < numValues * sizeof(float)) return false;
+        memcpy(channels.data(), payload, numValues * sizeof(float));
+    } else if (chunk->encoding == RECORDING_QUANTIZED) {
+        if (chunk->payloadSize < numValues * sizeof(uint16_t)) return false;
+        quantized.resize(numValues);
+        memcpy(quantized.data(), payload, numValues * sizeof(uint16_t));
+    } else if (chunk->encoding == RECORDING_DELTA) {
+        // a delta frame only makes sense on top of the frame right before it
+        if (decodedFrame != frame - 1 || decodedParticleCount != numParticles) return false;
+        for (int i = 0; i < numValues; i++) {
+            quantized[i] = uint16_t(int32_t(quantized[i]) + readDelta(payload, payloadEnd));
+        }
+    } else {
+        return false;
+    }
+    
+    if (chunk->encoding != RECORDING_RAW) {
+        tbb::parallel_for( tbb::blocked_range<int>(0, numValues), [&](tbb::blocked_range<int> r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                int channel = i / std::max(1, numParticles);
+                channels[i] = dequantizeChannel(quantized[i], chunk->minimum[channel], chunk->extent[channel]);
+            }
+        });
+    }
+    
+    decodedFrame = frame;
+    decodedParticleCount = numParticles;
+    return true;
+}
@@ -0,0 +1,43 @@
+//
+//  FrameReader.hpp
+//  fluidSimulation
+//
+
+#ifndef FrameReader_hpp
+#define FrameReader_hpp
+
+#include <stdio.h>
+#include "ParticleSystem.hpp"
+#include "MappedFile.hpp"
+#include "Recording.hpp"
+
+// maps a recording and decodes frames straight into a particle system's particles and mesh.
+// delta frames decode from the keyframe before them, stepping forward one frame reuses the last decode
+class FrameReader {
+public:
+    FrameReader();
+    
+    Boolean open(string path);
+    void close();
+    
+    Boolean isOpen();
+    int getFrameCount();
+    Boolean readFrame(int frame, ParticleSystem &particleSystem);
+    
+private:
+    const RecordingChunkHeader * getChunk(int frame);
+    Boolean decodeChunk(int frame);
+    
+    MappedFile file;
+    vector<uint64_t> chunkOffsets;
+    
+    int decodedFrame;
+    int decodedParticleCount;
+    // the alive range last set on the particle system, set again only when the count or the pool changes
+    int appliedParticleCount;
+    unsigned int appliedPoolRevision;
+    vector<uint16_t> quantized;
+    vector<float> channels;
+};
+
+#endif /* FrameReader_hpp */
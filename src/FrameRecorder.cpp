@@ -0,0 +1,251 @@
+//
+//  FrameRecorder.cpp
+//  fluidSimulation
+//
+
+#include "FrameRecorder.hpp"
+#include <string.h>
+
+FrameRecorder::FrameRecorder() {
+    file = nullptr;
+    encoding = RECORDING_DELTA;
+    keyframeInterval = 30;
+    queueCapacity = 8;
+    frameIndex = 0;
+    recordedFrames = 0;
+    droppedFrames = 0;
+    recordingActive = false;
+    fileOffset = 0;
+    framesSinceKeyframe = 0;
+}
+
+FrameRecorder::~FrameRecorder() {
+    stop();
+    
+    Frame *frame;
+    while (freeFrames.try_pop(frame)) {
+        delete frame;
+    }
+}
+
+Boolean FrameRecorder::start(string path, int _encoding, int _keyframeInterval) {
+    stop();
+    
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    
+    encoding = _encoding;
+    keyframeInterval = std::max(1, _keyframeInterval);
+    frameIndex = 0;
+    recordedFrames = 0;
+    droppedFrames = 0;
+    
+    RecordingHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    header.version = RECORDING_VERSION;
+    header.headerSize = sizeof(RecordingHeader);
+    header.chunkHeaderSize = sizeof(RecordingChunkHeader);
+    header.keyframeInterval = keyframeInterval;
+    fwrite(&header, sizeof(header), 1, file);
+    
+    chunkOffsets.clear();
+    fileOffset = sizeof(header);
+    framesSinceKeyframe = 0;
+    previousQuantized.clear();
+    
+    pendingFrames.set_capacity(queueCapacity);
+    recordingActive = true;
+    worker = std::thread(&FrameRecorder::writeFrames, this);
+    
+    return true;
+}
+
+void FrameRecorder::record(ParticleSystem &particleSystem) {
+    if (!recordingActive) return;
+    
+    Frame *frame;
+    if (!freeFrames.try_pop(frame)) {
+        frame = new Frame();
+    }
+    
+    // live particles are packed in index order, a count change forces a keyframe anyway
+    aliveIndices.clear();
+    for (int i = 0; i < particleSystem.particles.size(); i++) {
+        if (particleSystem.aliveFlags[i]) aliveIndices.push_back(i);
+    }
+    
+    int numParticles = aliveIndices.size();
+    frame->particleCount = numParticles;
+    frame->channels.resize(numParticles * RECORDING_CHANNELS);
+    
+    float *positionX = frame->channels.data();
+    float *positionY = positionX + numParticles;
+    float *velocityX = positionY + numParticles;
+    float *velocityY = velocityX + numParticles;
+    float *density = velocityY + numParticles;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            const Particle &particle = particleSystem.particles[aliveIndices[i]];
+            positionX[i] = particle.position.x;
+            positionY[i] = particle.position.y;
+            velocityX[i] = particle.velocity.x;
+            velocityY[i] = particle.velocity.y;
+            density[i] = particle.density;
+        }
+    });
+    
+    if (!pendingFrames.try_push(frame)) {
+        freeFrames.push(frame);
+        droppedFrames++;
+    }
+}
+
+void FrameRecorder::stop() {
+    if (!recordingActive) return;
+    
+    // a null frame tells the worker to finish, everything queued before it still gets written
+    pendingFrames.push(nullptr);
+    worker.join();
+    recordingActive = false;
+    
+    RecordingFooter footer;
+    footer.indexOffset = fileOffset;
+    footer.frameCount = chunkOffsets.size();
+    footer.magic = RECORDING_FOOTER_MAGIC;
+    
+    fwrite(chunkOffsets.data(), sizeof(uint64_t), chunkOffsets.size(), file);
+    fwrite(&footer, sizeof(footer), 1, file);
+    fclose(file);
+    file = nullptr;
+}
+
+Boolean FrameRecorder::isRecording() {
+    return recordingActive;
+}
+
+int FrameRecorder::getRecordedFrames() {
+    return recordedFrames;
+}
+
+int FrameRecorder::getDroppedFrames() {
+    return droppedFrames;
+}
+
+void FrameRecorder::setQueueCapacity(int _queueCapacity) {
+    queueCapacity = std::max(1, _queueCapacity);
+}
+
+// worker
+
+void FrameRecorder::writeFrames() {
+    while (true) {
+        Frame *frame;
+        pendingFrames.pop(frame);
+        if (frame == nullptr) break;
+        
+        writeFrame(frame);
+        freeFrames.push(frame);
+        recordedFrames++;
+    }
+}
+
+void FrameRecorder::writeFrame(Frame *frame) {
+    RecordingChunkHeader chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.magic = RECORDING_CHUNK_MAGIC;
+    chunk.frameIndex = frameIndex++;
+    chunk.particleCount = frame->particleCount;
+    
+    payload.clear();
+    
+    if (encoding == RECORDING_RAW) {
+        chunk.encoding = RECORDING_RAW;
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(frame->channels.data());
+        payload.assign(bytes, bytes + frame->channels.size() * sizeof(float));
+    } else if (encoding == RECORDING_DELTA && !keyframeNeeded(frame)) {
+        encodeDelta(frame, chunk);
+    } else {
+        encodeQuantized(frame, chunk);
+    }
+    
+    chunk.payloadSize = payload.size();
+    
+    chunkOffsets.push_back(fileOffset);
+    fwrite(&chunk, sizeof(chunk), 1, file);
+    fwrite(payload.data(), 1, payload.size(), file);
+    fileOffset += sizeof(chunk) + payload.size();
+}
+
+Boolean FrameRecorder::keyframeNeeded(Frame *frame) {
+    if (previousQuantized.size() != frame->channels.size()) return true;
+    if (framesSinceKeyframe >= keyframeInterval) return true;
+    
+    // a value outside the keyframe ranges would clamp, so start over with new ranges
+    int numParticles = frame->particleCount;
+    for (int channel = 0; channel < RECORDING_CHANNELS; channel++) {
+        float minimum = keyframeChunk.minimum[channel];
+        float maximum = minimum + keyframeChunk.extent[channel];
+        const float *values = frame->channels.data() + channel * numParticles;
+        
+        for (int i = 0; i < numParticles; i++) {
+            if (values[i] < minimum || values[i] > maximum) return true;
+        }
+    }
+    
+    return false;
+}
+
+void FrameRecorder::encodeQuantized(Frame *frame, RecordingChunkHeader &chunk) {
+    int numParticles = frame->particleCount;
+    chunk.encoding = RECORDING_QUANTIZED;
+    
+    for (int channel = 0; channel < RECORDING_CHANNELS; channel++) {
+        const float *values = frame->channels.data() + channel * numParticles;
+        float minimum = numParticles > 0 ? values[0] : 0.0f;
+        float maximum = minimum;
+        for (int i = 1; i < numParticles; i++) {
+            minimum = std::min(minimum, values[i]);
+            maximum = std::max(maximum, values[i]);
+        }
+        
+        // velocities and densities swing more than positions between keyframes, leave them headroom
+        float padding = channel < 2 ? 0.0f : (maximum - minimum) * 0.5f;
+        chunk.minimum[channel] = minimum - padding;
+        chunk.extent[channel] = maximum - minimum + padding * 2.0f;
+    }
+    
+    quantized.resize(frame->channels.size());
+    for (int channel = 0; channel < RECORDING_CHANNELS; channel++) {
+        int offset = channel * numParticles;
+        for (int i = 0; i < numParticles; i++) {
+            quantized[offset + i] = quantizeChannel(frame->channels[offset + i], chunk.minimum[channel], chunk.extent[channel]);
+        }
+    }
+    
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(quantized.data());
+    payload.assign(bytes, bytes + quantized.size() * sizeof(uint16_t));
+    
+    keyframeChunk = chunk;
+    previousQuantized.swap(quantized);
+    framesSinceKeyframe = 0;
+}
+
+void FrameRecorder::encodeDelta(Frame *frame, RecordingChunkHeader &chunk) {
+    int numParticles = frame->particleCount;
+    chunk.encoding = RECORDING_DELTA;
+    memcpy(chunk.minimum, keyframeChunk.minimum, sizeof(chunk.minimum));
+    memcpy(chunk.extent, keyframeChunk.extent, sizeof(chunk.extent));
+    
+    for (int channel = 0; channel < RECORDING_CHANNELS; channel++) {
+        int offset = channel * numParticles;
+        for (int i = 0; i < numParticles; i++) {
+            uint16_t value = quantizeChannel(frame->channels[offset + i], chunk.minimum[channel], chunk.extent[channel]);
+            writeDelta(payload, int32_t(value) - int32_t(previousQuantized[offset + i]));
+            previousQuantized[offset + i] = value;
+        }
+    }
+    
+    framesSinceKeyframe++;
+}
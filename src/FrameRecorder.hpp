@@ -0,0 +1,65 @@
+//
+//  FrameRecorder.hpp
+//  fluidSimulation
+//
+
+#ifndef FrameRecorder_hpp
+#define FrameRecorder_hpp
+
+#include <stdio.h>
+#include <thread>
+#include <atomic>
+#include "ParticleSystem.hpp"
+#include "Recording.hpp"
+#include "tbb/concurrent_queue.h"
+
+// copies particle state on the simulation thread and leaves encoding and writing to a worker,
+// when the worker falls behind frames are dropped instead of holding up the simulation
+class FrameRecorder {
+public:
+    FrameRecorder();
+    ~FrameRecorder();
+    
+    Boolean start(string path, int encoding, int keyframeInterval);
+    void record(ParticleSystem &particleSystem);
+    void stop();
+    
+    Boolean isRecording();
+    int getRecordedFrames();
+    int getDroppedFrames();
+    
+    void setQueueCapacity(int queueCapacity);
+    
+private:
+    struct Frame {
+        int particleCount;
+        vector<float> channels;
+    };
+    
+    void writeFrames();
+    void writeFrame(Frame *frame);
+    Boolean keyframeNeeded(Frame *frame);
+    void encodeQuantized(Frame *frame, RecordingChunkHeader &chunk);
+    void encodeDelta(Frame *frame, RecordingChunkHeader &chunk);
+    
+    FILE *file;
+    std::thread worker;
+    tbb::concurrent_bounded_queue<Frame *> pendingFrames;
+    tbb::concurrent_queue<Frame *> freeFrames;
+    
+    int encoding, keyframeInterval, queueCapacity;
+    int frameIndex;
+    vector<int> aliveIndices;
+    std::atomic<int> recordedFrames, droppedFrames;
+    Boolean recordingActive;
+    
+    // worker state, only touched on the worker thread
+    vector<uint64_t> chunkOffsets;
+    uint64_t fileOffset;
+    int framesSinceKeyframe;
+    RecordingChunkHeader keyframeChunk;
+    vector<uint16_t> previousQuantized, quantized;
+    vector<unsigned char> payload;
+};
+
+#endif /* FrameRecorder_hpp */
@@ -0,0 +1,151 @@
+//
+//  HeadlessApp.cpp
+//  fluidSimulation
+//
+
+#include "HeadlessApp.hpp"
+
+HeadlessApp::HeadlessApp(HeadlessSettings settings) {
+    this->settings = settings;
+    frame = 0;
+}
+
+Boolean HeadlessApp::parseArguments(int argc, char *argv[], HeadlessSettings &settings) {
+    Boolean headlessActive = false;
+
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        if (argument == "--headless") {
+            headlessActive = true;
+            continue;
+        }
+        if (argument == "--raw") {
+            settings.rawActive = true;
+            continue;
+        }
+        if (argument == "--no-save") {
+            settings.saveActive = false;
+            continue;
+        }
+        if (argument == "--publish") {
+            settings.publishActive = true;
+            continue;
+        }
+
+        // everything else takes a value
+        if (i + 1 >= argc) {
+            ofLogError("HeadlessApp") << "missing value for " << argument;
+            continue;
+        }
+        string value = argv[++i];
+
+        if (argument == "--frames") settings.frames = ofToInt(value);
+        else if (argument == "--steps") settings.stepsPerFrame = ofToInt(value);
+        else if (argument == "--particles") settings.numberParticles = ofToInt(value);
+        else if (argument == "--width") settings.width = ofToInt(value);
+        else if (argument == "--height") settings.height = ofToInt(value);
+        else if (argument == "--seed") settings.seed = ofToInt(value);
+        else if (argument == "--gravity") settings.gravityMultiplier = ofToFloat(value);
+        else if (argument == "--blur-mix") settings.blurMix = ofToFloat(value);
+        else if (argument == "--contrast") settings.contrastAmount = ofToFloat(value);
+        else if (argument == "--checkpoint") settings.checkpoint = value;
+        else if (argument == "--output") settings.outputDirectory = value;
+        else ofLogError("HeadlessApp") << "unknown argument " << argument;
+    }
+
+    return headlessActive;
+}
+
+//--------------------------------------------------------------
+void HeadlessApp::setup() {
+    // the gui's defaults, set the way its listeners set them
+    fluidSystem.setWidth(settings.width);
+    fluidSystem.setHeight(settings.height);
+    fluidSystem.setBoundsSize(ofVec3f(settings.width, settings.height, 0));
+    fluidSystem.setCenter(settings.width * 0.5, settings.height * 0.5);
+    fluidSystem.setCollisionDamping(0.05);
+    fluidSystem.setRadius(10.0);
+    fluidSystem.setDeltaTime(1.0 / 60.0);
+    fluidSystem.setGravityMultiplier(settings.gravityMultiplier);
+    fluidSystem.setGravityRotation(ofVec2f(0.0, 1.0));
+    fluidSystem.setTargetDensity(1.0);
+    fluidSystem.setPressureMultiplier(100);
+    fluidSystem.setNearPressureMultiplier(100);
+    fluidSystem.setViscosityStrength(0.25);
+    fluidSystem.setMode(0);
+    fluidSystem.setSeed(settings.seed);
+    fluidSystem.setNumberParticles(settings.numberParticles);
+    fluidSystem.resetRandom();
+
+    // a checkpoint brings its own system size and solver settings
+    if (!settings.checkpoint.empty() && !fluidSystem.loadCheckpoint(settings.checkpoint)) {
+        ofLogError("HeadlessApp") << "could not load " << settings.checkpoint << ", starting from the random layout";
+    }
+
+    fluidSystem.setVelocityCurve(1.0);
+    fluidSystem.setMinVelocity(0.0);
+    fluidSystem.setMaxVelocity(50.0);
+    fluidSystem.setMinSize(1.0);
+    fluidSystem.setMaxSize(25.0);
+    fluidSystem.setCoolColor(ofColor::lightSeaGreen);
+    fluidSystem.setHotColor(ofColor::lightPink);
+
+    splatRenderer.setup(fluidSystem.systemWidth, fluidSystem.systemHeight);
+    splatRenderer.setBackground(ofColor::black);
+
+    // the shader gui's defaults for what is not on the command line
+    postProcess.setBlurMix(settings.blurMix);
+    postProcess.setBlurQuality(3.0);
+    postProcess.setBlurAngles(16.0);
+    postProcess.setBlurRadius(8.0);
+    postProcess.setContrastAmount(settings.contrastAmount);
+
+    if (settings.saveActive) {
+        ofDirectory::createDirectory(settings.outputDirectory, true, true);
+    }
+
+    if (settings.publishActive) {
+        if (sharedFramePublisher.start(SHARED_FRAMES_NAME, fluidSystem.particles.size(), splatRenderer.getWidth(), splatRenderer.getHeight(), 4)) {
+            ofLogNotice("HeadlessApp") << "publishing to " << SHARED_FRAMES_NAME;
+        } else {
+            ofLogError("HeadlessApp") << "could not start publishing";
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void HeadlessApp::update() {
+    // no frame count runs until the process is stopped
+    if (settings.frames > 0 && frame >= settings.frames) {
+        ofExit();
+        return;
+    }
+
+    for (int i = 0; i < settings.stepsPerFrame; i++) {
+        fluidSystem.update();
+    }
+    writeFrame();
+    frame++;
+}
+
+void HeadlessApp::writeFrame() {
+    splatRenderer.render(fluidSystem);
+    postProcess.process(splatRenderer.getPixels(), splatRenderer.getWidth(), splatRenderer.getHeight());
+
+    if (sharedFramePublisher.isRunning()) {
+        sharedFramePublisher.publish(fluidSystem, splatRenderer.getPixels().data());
+    }
+    if (!settings.saveActive) return;
+
+    string filename = settings.outputDirectory + "/frame-" + ofToString(frame, 5, '0') + (settings.rawActive ? ".raw" : ".png");
+    Boolean written = settings.rawActive ? splatRenderer.saveRaw(ofToDataPath(filename)) : splatRenderer.savePng(ofToDataPath(filename));
+    if (!written) {
+        ofLogError("HeadlessApp") << "could not save " << filename;
+        return;
+    }
+    ofLogNotice("HeadlessApp") << "frame " << frame << " step " << fluidSystem.stepMicros / 1000.0 << "ms";
+}
+
+void HeadlessApp::exit() {
+    sharedFramePublisher.stop();
+}
@@ -0,0 +1,60 @@
+//
+//  HeadlessApp.hpp
+//  fluidSimulation
+//
+
+#ifndef HeadlessApp_hpp
+#define HeadlessApp_hpp
+
+#include <stdio.h>
+#include "ofMain.h"
+#include "Platform.hpp"
+#include "FluidSystem2D.hpp"
+#include "SplatRenderer.hpp"
+#include "PostProcess.hpp"
+#include "SharedFramePublisher.hpp"
+
+// what a headless run renders, defaults match the gui's so a frame looks like the window's
+struct HeadlessSettings {
+    int frames = 60;
+    int stepsPerFrame = 1;
+    int numberParticles = 25000;
+    int width = 1080;
+    int height = 1920;
+    int seed = 0;
+    float gravityMultiplier = 0.0;
+    float blurMix = 0.0;
+    float contrastAmount = 1.0;
+    Boolean rawActive = false;
+    Boolean saveActive = true;
+    Boolean publishActive = false;
+    string checkpoint;
+    string outputDirectory = "frames";
+};
+
+// steps the fluid and writes frames through the cpu splat renderer and post process, without a
+// window, gl context or gpu. run under ofAppNoWindow, see main.cpp for the command line.
+// with --publish it is a producer for the shared frame readers on machines without syphon
+class HeadlessApp : public ofBaseApp {
+public:
+    HeadlessApp(HeadlessSettings settings);
+
+    // false when --headless is not given, the arguments after it fill the settings
+    static Boolean parseArguments(int argc, char *argv[], HeadlessSettings &settings);
+
+    void setup();
+    void update();
+    void exit();
+
+private:
+    void writeFrame();
+
+    HeadlessSettings settings;
+    FluidSystem2D fluidSystem;
+    SplatRenderer splatRenderer;
+    PostProcess postProcess;
+    SharedFramePublisher sharedFramePublisher;
+    int frame;
+};
+
+#endif /* HeadlessApp_hpp */
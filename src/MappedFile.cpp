@@ -0,0 +1,104 @@
+//
+//  MappedFile.cpp
+//  fluidSimulation
+//
+
+#include "MappedFile.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile() {
+    fileDescriptor = -1;
+    data = nullptr;
+    size = 0;
+    writable = false;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::openRead(const std::string &path) {
+    close();
+    
+    fileDescriptor = ::open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) return false;
+    
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+        close();
+        return false;
+    }
+    
+    size = fileStat.st_size;
+    void * mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+    
+    data = static_cast<unsigned char *>(mapping);
+    writable = false;
+    return true;
+}
+
+bool MappedFile::openWrite(const std::string &path, size_t _size) {
+    close();
+    
+    fileDescriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor < 0) return false;
+    
+    // the file has to be sized before it can be mapped
+    if (_size == 0 || ftruncate(fileDescriptor, _size) != 0) {
+        close();
+        return false;
+    }
+    
+    size = _size;
+    void * mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+    
+    data = static_cast<unsigned char *>(mapping);
+    writable = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data != nullptr) {
+        if (writable) {
+            msync(data, size, MS_ASYNC);
+        }
+        munmap(data, size);
+    }
+    
+    if (fileDescriptor >= 0) {
+        ::close(fileDescriptor);
+    }
+    
+    fileDescriptor = -1;
+    data = nullptr;
+    size = 0;
+    writable = false;
+}
+
+bool MappedFile::isOpen() const {
+    return data != nullptr;
+}
+
+size_t MappedFile::getSize() const {
+    return size;
+}
+
+unsigned char * MappedFile::getData() {
+    return data;
+}
+
+const unsigned char * MappedFile::getData() const {
+    return data;
+}
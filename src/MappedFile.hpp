@@ -0,0 +1,37 @@
+//
+//  MappedFile.hpp
+//  fluidSimulation
+//
+
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <stdio.h>
+#include <string>
+
+// memory mapped file, the kernel pages data in and out so large reads and writes are plain copies
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+    
+    bool openRead(const std::string &path);
+    bool openWrite(const std::string &path, size_t size);
+    void close();
+    
+    bool isOpen() const;
+    size_t getSize() const;
+    unsigned char * getData();
+    const unsigned char * getData() const;
+    
+private:
+    int fileDescriptor;
+    unsigned char * data;
+    size_t size;
+    bool writable;
+};
+
+#endif /* MappedFile_hpp */
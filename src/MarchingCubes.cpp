@@ -0,0 +1,436 @@
+//
+//  MarchingCubes.cpp
+//  fluidSimulation
+//
+
+#include "MarchingCubes.hpp"
+#include <float.h>
+#include "tbb/parallel_for.h"
+
+// corners are numbered by their offset bits, x is 1, y is 2 and z is 4. every tetrahedron
+// walks from corner 0 to corner 7 one axis at a time, so each of its edges joins a corner to one
+// of its supersets, and the faces of neighboring cubes are cut along the same diagonals
+static const int tetrahedra[6][4] = {
+    { 0, 1, 3, 7 }, { 0, 1, 5, 7 }, { 0, 2, 3, 7 },
+    { 0, 2, 6, 7 }, { 0, 4, 5, 7 }, { 0, 4, 6, 7 }
+};
+
+MarchingCubes::MarchingCubes() {
+    width = 0;
+    height = 0;
+    depth = 0;
+    layerNodes = 0;
+    spacing = 1.0;
+    tileNodes = 8;
+    tilesX = 0;
+    tilesY = 0;
+    tilesZ = 0;
+}
+
+void MarchingCubes::setup(ofVec3f _origin, ofVec3f size, float _spacing) {
+    origin = _origin;
+    spacing = _spacing;
+    
+    width = ceil(size.x / spacing) + 1;
+    height = ceil(size.y / spacing) + 1;
+    depth = ceil(size.z / spacing) + 1;
+    while ((size_t) width * height * depth > MARCHING_CUBES_MAX_NODES) {
+        spacing *= 1.05;
+        width = ceil(size.x / spacing) + 1;
+        height = ceil(size.y / spacing) + 1;
+        depth = ceil(size.z / spacing) + 1;
+    }
+    layerNodes = width * height;
+    
+    // the buffers only ever grow, so a steady grid allocates nothing
+    int numNodes = layerNodes * depth;
+    field.resize(numNodes);
+    red.resize(numNodes);
+    green.resize(numNodes);
+    blue.resize(numNodes);
+    cubes.resize(numNodes);
+    edgeMasks.resize(numNodes);
+    firstVertices.resize(numNodes);
+}
+
+int MarchingCubes::getWidth() {
+    return width;
+}
+
+int MarchingCubes::getHeight() {
+    return height;
+}
+
+int MarchingCubes::getDepth() {
+    return depth;
+}
+
+float MarchingCubes::getSpacing() {
+    return spacing;
+}
+
+float MarchingCubes::getField(int x, int y, int z) {
+    return field[z * layerNodes + y * width + x];
+}
+
+// splat
+
+void MarchingCubes::splat(const vector<Particle> &particles, const vector<char> &aliveFlags, float radius, float _spacing) {
+    ofVec3f minimum = ofVec3f(FLT_MAX, FLT_MAX, FLT_MAX);
+    ofVec3f maximum = ofVec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    int numParticles = particles.size();
+    for (int i = 0; i < numParticles; i++) {
+        if (!aliveFlags[i]) continue;
+        const ofVec3f &position = particles[i].position;
+        minimum = ofVec3f(std::min(minimum.x, position.x), std::min(minimum.y, position.y), std::min(minimum.z, position.z));
+        maximum = ofVec3f(std::max(maximum.x, position.x), std::max(maximum.y, position.y), std::max(maximum.z, position.z));
+    }
+    
+    if (minimum.x > maximum.x) {
+        width = height = depth = layerNodes = 0;
+        return;
+    }
+    
+    // a margin wider than the radius keeps the outer nodes empty, so the surface always closes
+    float margin = radius + std::max(_spacing, 1.0f) * 2.0;
+    ofVec3f marginOffset = ofVec3f(margin, margin, margin);
+    setup(minimum - marginOffset, maximum - minimum + marginOffset * 2.0, std::max(_spacing, 1.0f));
+    
+    // tiles at least a radius across, so a particle only reaches the tiles next to its own
+    tileNodes = std::max(8, int(ceil(radius / spacing)));
+    tilesX = (width + tileNodes - 1) / tileNodes;
+    tilesY = (height + tileNodes - 1) / tileNodes;
+    tilesZ = (depth + tileNodes - 1) / tileNodes;
+    int numTiles = tilesX * tilesY * tilesZ;
+    
+    particleTiles.resize(numParticles);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            if (!aliveFlags[i]) {
+                particleTiles[i] = -1;
+                continue;
+            }
+            ofVec3f position = (particles[i].position - origin) / spacing;
+            int tileX = ofClamp(int(position.x) / tileNodes, 0, tilesX - 1);
+            int tileY = ofClamp(int(position.y) / tileNodes, 0, tilesY - 1);
+            int tileZ = ofClamp(int(position.z) / tileNodes, 0, tilesZ - 1);
+            particleTiles[i] = (tileZ * tilesY + tileY) * tilesX + tileX;
+        }
+    });
+    
+    // counting sort of the particles by tile, copied out so the gather reads them in order
+    tileStarts.assign(numTiles + 1, 0);
+    for (int i = 0; i < numParticles; i++) {
+        if (particleTiles[i] >= 0) tileStarts[particleTiles[i] + 1]++;
+    }
+    for (int t = 0; t < numTiles; t++) {
+        tileStarts[t + 1] += tileStarts[t];
+    }
+    splatPoints.resize(tileStarts[numTiles]);
+    tileFill.assign(tileStarts.begin(), tileStarts.end() - 1);
+    for (int i = 0; i < numParticles; i++) {
+        if (particleTiles[i] < 0) continue;
+        SplatPoint &point = splatPoints[tileFill[particleTiles[i]]++];
+        point.x = particles[i].position.x - origin.x;
+        point.y = particles[i].position.y - origin.y;
+        point.z = particles[i].position.z - origin.z;
+        point.startX = ceil((point.x - radius) / spacing);
+        point.startY = ceil((point.y - radius) / spacing);
+        point.startZ = ceil((point.z - radius) / spacing);
+        point.endX = floor((point.x + radius) / spacing);
+        point.endY = floor((point.y + radius) / spacing);
+        point.endZ = floor((point.z + radius) / spacing);
+        point.color = particles[i].particleColor;
+    }
+    
+    // each tile gathers the particles around it and writes only its own nodes
+    float squareRadius = radius * radius;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numTiles), [&](tbb::blocked_range<int> r) {
+        for (int t = r.begin(); t < r.end(); ++t) {
+            int tileX = t % tilesX;
+            int tileY = t / tilesX % tilesY;
+            int tileZ = t / (tilesX * tilesY);
+            int minX = tileX * tileNodes;
+            int minY = tileY * tileNodes;
+            int minZ = tileZ * tileNodes;
+            int maxX = std::min(minX + tileNodes, width) - 1;
+            int maxY = std::min(minY + tileNodes, height) - 1;
+            int maxZ = std::min(minZ + tileNodes, depth) - 1;
+            
+            for (int z = minZ; z <= maxZ; z++) {
+                for (int y = minY; y <= maxY; y++) {
+                    int row = z * layerNodes + y * width;
+                    std::fill(field.begin() + row + minX, field.begin() + row + maxX + 1, 0.0f);
+                    std::fill(red.begin() + row + minX, red.begin() + row + maxX + 1, 0.0f);
+                    std::fill(green.begin() + row + minX, green.begin() + row + maxX + 1, 0.0f);
+                    std::fill(blue.begin() + row + minX, blue.begin() + row + maxX + 1, 0.0f);
+                }
+            }
+            
+            for (int offsetZ = -1; offsetZ < 2; offsetZ++) {
+                int neighborZ = tileZ + offsetZ;
+                if (neighborZ < 0 || neighborZ >= tilesZ) continue;
+                
+                for (int offsetY = -1; offsetY < 2; offsetY++) {
+                    int neighborY = tileY + offsetY;
+                    if (neighborY < 0 || neighborY >= tilesY) continue;
+                    
+                    for (int offsetX = -1; offsetX < 2; offsetX++) {
+                        int neighborX = tileX + offsetX;
+                        if (neighborX < 0 || neighborX >= tilesX) continue;
+                        
+                        int neighbor = (neighborZ * tilesY + neighborY) * tilesX + neighborX;
+                        for (int k = tileStarts[neighbor]; k < tileStarts[neighbor + 1]; k++) {
+                            const SplatPoint &point = splatPoints[k];
+                            
+                            int startX = std::max(minX, point.startX);
+                            int endX = std::min(maxX, point.endX);
+                            int startY = std::max(minY, point.startY);
+                            int endY = std::min(maxY, point.endY);
+                            int startZ = std::max(minZ, point.startZ);
+                            int endZ = std::min(maxZ, point.endZ);
+                            if (startX > endX || startY > endY || startZ > endZ) continue;
+                            
+                            const ofFloatColor &color = point.color;
+                            
+                            for (int z = startZ; z <= endZ; z++) {
+                                float dz = z * spacing - point.z;
+                                
+                                for (int y = startY; y <= endY; y++) {
+                                    float dy = y * spacing - point.y;
+                                    float squareDistanceYZ = dy * dy + dz * dz;
+                                    if (squareDistanceYZ >= squareRadius) continue;
+                                    int row = z * layerNodes + y * width;
+                                    
+                                    for (int x = startX; x <= endX; x++) {
+                                        float dx = x * spacing - point.x;
+                                        float squareDistance = dx * dx + squareDistanceYZ;
+                                        if (squareDistance >= squareRadius) continue;
+                                        
+                                        // peaks at one under an isolated particle and falls smoothly to zero at the radius
+                                        float q = 1.0 - squareDistance / squareRadius;
+                                        float weight = q * q * q;
+                                        
+                                        int node = row + x;
+                                        field[node] += weight;
+                                        red[node] += weight * color.r;
+                                        green[node] += weight * color.g;
+                                        blue[node] += weight * color.b;
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+// extract
+
+void MarchingCubes::extract(float threshold, ofMesh &mesh) {
+    mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+    auto &meshVertices = mesh.getVertices();
+    auto &meshColors = mesh.getColors();
+    auto &meshNormals = mesh.getNormals();
+    auto &meshIndices = mesh.getIndices();
+    
+    // a threshold of zero would take in the empty margin
+    threshold = std::max(threshold, 1e-6f);
+    for (int c = 0; c < 8; c++) {
+        cornerOffsets[c] = (c & 1) + (c >> 1 & 1) * width + (c >> 2 & 1) * layerNodes;
+    }
+    
+    if (depth < 2) {
+        meshVertices.clear();
+        meshColors.clear();
+        meshNormals.clear();
+        meshIndices.clear();
+        return;
+    }
+    
+    // classify every cube once. the edges a node owns all start at corner 0 of the cube the node is
+    // corner 0 of, so its crossed edges are the corners on the other side. the last row, column and
+    // layer have no cube, they lie in the empty margin and never cross
+    layerVertexOffsets.assign(depth + 1, 0);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, depth), [&](tbb::blocked_range<int> r) {
+        for (int z = r.begin(); z < r.end(); ++z) {
+            int count = 0;
+            for (int y = 0; y < height; y++) {
+                int row = z * layerNodes + y * width;
+                if (z == depth - 1 || y == height - 1) {
+                    std::fill(cubes.begin() + row, cubes.begin() + row + width, 0);
+                    std::fill(edgeMasks.begin() + row, edgeMasks.begin() + row + width, 0);
+                    continue;
+                }
+                
+                for (int x = 0; x < width - 1; x++) {
+                    int node = row + x;
+                    int cube = 0;
+                    for (int c = 0; c < 8; c++) {
+                        if (field[node + cornerOffsets[c]] >= threshold) cube |= 1 << c;
+                    }
+                    
+                    int mask = (cube & 1 ? ~cube : cube) >> 1 & 0x7f;
+                    cubes[node] = cube;
+                    edgeMasks[node] = mask;
+                    count += __builtin_popcount(mask);
+                }
+                cubes[row + width - 1] = 0;
+                edgeMasks[row + width - 1] = 0;
+            }
+            layerVertexOffsets[z + 1] = count;
+        }
+    });
+    
+    for (int z = 0; z < depth; z++) {
+        layerVertexOffsets[z + 1] += layerVertexOffsets[z];
+    }
+    
+    int numVertices = layerVertexOffsets[depth];
+    meshVertices.resize(numVertices);
+    meshColors.resize(numVertices);
+    meshNormals.resize(numVertices);
+    
+    // one vertex per crossed edge, written straight into the mesh
+    tbb::parallel_for( tbb::blocked_range<int>(0, depth), [&](tbb::blocked_range<int> r) {
+        for (int z = r.begin(); z < r.end(); ++z) {
+            int vertex = layerVertexOffsets[z];
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    int node = z * layerNodes + y * width + x;
+                    firstVertices[node] = vertex;
+                    int mask = edgeMasks[node];
+                    if (mask == 0) continue;
+                    
+                    ofVec3f gradient = getGradient(x, y, z);
+                    ofFloatColor color = getColor(node);
+                    
+                    for (int direction = 1; direction < 8; direction++) {
+                        if (!(mask & 1 << (direction - 1))) continue;
+                        
+                        int offsetX = direction & 1;
+                        int offsetY = direction >> 1 & 1;
+                        int offsetZ = direction >> 2 & 1;
+                        int neighbor = node + offsetX + offsetY * width + offsetZ * layerNodes;
+                        float t = ofClamp((threshold - field[node]) / (field[neighbor] - field[node]), 0.0, 1.0);
+                        
+                        ofVec3f position = ofVec3f(x + offsetX * t, y + offsetY * t, z + offsetZ * t);
+                        ofVec3f neighborGradient = getGradient(x + offsetX, y + offsetY, z + offsetZ);
+                        
+                        // the field falls off outwards, so the normal is against the gradient
+                        meshVertices[vertex] = origin + position * spacing;
+                        meshNormals[vertex] = -(gradient + (neighborGradient - gradient) * t).getNormalized();
+                        meshColors[vertex] = color.getLerped(getColor(neighbor), t);
+                        vertex++;
+                    }
+                }
+            }
+        }
+    });
+    
+    // triangles per layer of cubes, every tetrahedron cut by the surface gives one or two
+    int cellLayers = depth - 1;
+    layerIndices.resize(cellLayers);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, cellLayers), [&](tbb::blocked_range<int> r) {
+        for (int z = r.begin(); z < r.end(); ++z) {
+            vector<ofIndexType> &indices = layerIndices[z];
+            indices.clear();
+            
+            for (int y = 0; y < height - 1; y++) {
+                for (int x = 0; x < width - 1; x++) {
+                    int node = z * layerNodes + y * width + x;
+                    int cube = cubes[node];
+                    if (cube == 0 || cube == 255) continue;
+                    
+                    for (int t = 0; t < 6; t++) {
+                        const int *corners = tetrahedra[t];
+                        int inside[4], outside[4];
+                        int insideCount = 0;
+                        int outsideCount = 0;
+                        for (int c = 0; c < 4; c++) {
+                            if (cube & 1 << corners[c]) {
+                                inside[insideCount++] = corners[c];
+                            } else {
+                                outside[outsideCount++] = corners[c];
+                            }
+                        }
+                        if (insideCount == 0 || outsideCount == 0) continue;
+                        
+                        // the corners of a tetrahedron form a chain, the smaller one of an edge owns it
+                        auto edgeVertex = [&](int a, int b) {
+                            int lower = (a & b) == a ? a : b;
+                            return getEdgeVertex(node + cornerOffsets[lower], a ^ b);
+                        };
+                        
+                        // outward points from the inside corners to the outside ones
+                        ofVec3f outward = ofVec3f::zero();
+                        for (int c = 0; c < outsideCount; c++) {
+                            outward += ofVec3f(outside[c] & 1, outside[c] >> 1 & 1, outside[c] >> 2 & 1) / outsideCount;
+                        }
+                        for (int c = 0; c < insideCount; c++) {
+                            outward -= ofVec3f(inside[c] & 1, inside[c] >> 1 & 1, inside[c] >> 2 & 1) / insideCount;
+                        }
+                        
+                        auto addTriangle = [&](int a, int b, int c) {
+                            ofVec3f normal = ofVec3f(meshVertices[b] - meshVertices[a]).cross(meshVertices[c] - meshVertices[a]);
+                            if (normal.dot(outward) < 0.0) std::swap(b, c);
+                            indices.push_back(a);
+                            indices.push_back(b);
+                            indices.push_back(c);
+                        };
+                        
+                        if (insideCount == 1 || outsideCount == 1) {
+                            // one corner cut off
+                            int lone = insideCount == 1 ? inside[0] : outside[0];
+                            int *others = insideCount == 1 ? outside : inside;
+                            addTriangle(edgeVertex(lone, others[0]), edgeVertex(lone, others[1]), edgeVertex(lone, others[2]));
+                        } else {
+                            // two against two cuts a quad, its corners in order around the tetrahedron
+                            int a = edgeVertex(inside[0], outside[0]);
+                            int b = edgeVertex(inside[0], outside[1]);
+                            int c = edgeVertex(inside[1], outside[1]);
+                            int d = edgeVertex(inside[1], outside[0]);
+                            addTriangle(a, b, c);
+                            addTriangle(a, c, d);
+                        }
+                    }
+                }
+            }
+        }
+    });
+    
+    layerIndexOffsets.assign(cellLayers + 1, 0);
+    for (int z = 0; z < cellLayers; z++) {
+        layerIndexOffsets[z + 1] = layerIndexOffsets[z] + layerIndices[z].size();
+    }
+    meshIndices.resize(layerIndexOffsets[cellLayers]);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, cellLayers), [&](tbb::blocked_range<int> r) {
+        for (int z = r.begin(); z < r.end(); ++z) {
+            std::copy(layerIndices[z].begin(), layerIndices[z].end(), meshIndices.begin() + layerIndexOffsets[z]);
+        }
+    });
+}
+
+ofVec3f MarchingCubes::getGradient(int x, int y, int z) {
+    // central differences, one sided on the border
+    int node = z * layerNodes + y * width + x;
+    int left = x > 0 ? node - 1 : node;
+    int right = x < width - 1 ? node + 1 : node;
+    int down = y > 0 ? node - width : node;
+    int up = y < height - 1 ? node + width : node;
+    int back = z > 0 ? node - layerNodes : node;
+    int front = z < depth - 1 ? node + layerNodes : node;
+    return ofVec3f(field[right] - field[left], field[up] - field[down], field[front] - field[back]);
+}
+
+ofFloatColor MarchingCubes::getColor(int node) {
+    if (field[node] <= 0.0) return ofFloatColor(0.0, 0.0, 0.0, 1.0);
+    return ofFloatColor(red[node] / field[node], green[node] / field[node], blue[node] / field[node], 1.0);
+}
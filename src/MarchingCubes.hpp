@@ -0,0 +1,72 @@
+//
+//  MarchingCubes.hpp
+//  fluidSimulation
+//
+
+#ifndef MarchingCubes_hpp
+#define MarchingCubes_hpp
+
+#include <stdio.h>
+#include "ofMain.h"
+#include "Particle.hpp"
+
+#define MARCHING_CUBES_MAX_NODES (1 << 21)
+
+// liquid surface for the 3D system. particles are splatted onto a dense grid around the alive particles,
+// and every cube is cut into six tetrahedra along its diagonal, which needs no case table and never
+// leaves holes. a vertex is made once per crossed grid edge, so neighboring cubes share it and
+// the mesh is closed. splat, vertices and triangles each run over independent layers of the grid
+class MarchingCubes {
+public:
+    MarchingCubes();
+
+    // the grid follows the particles every frame, spacing grows when it would pass the node limit
+    void splat(const vector<Particle> &particles, const vector<char> &aliveFlags, float radius, float spacing);
+
+    // writes the surface as indexed triangles with normals into the mesh, its buffers are reused between frames
+    void extract(float threshold, ofMesh &mesh);
+
+    int getWidth();
+    int getHeight();
+    int getDepth();
+    float getSpacing();
+    float getField(int x, int y, int z);
+
+private:
+    // a particle with the range of nodes it reaches, found once when it is binned
+    struct SplatPoint {
+        float x, y, z;
+        int startX, startY, startZ, endX, endY, endZ;
+        ofFloatColor color;
+    };
+
+    void setup(ofVec3f origin, ofVec3f size, float spacing);
+    inline int getEdgeVertex(int node, int direction);
+    ofVec3f getGradient(int x, int y, int z);
+    ofFloatColor getColor(int node);
+
+    int width, height, depth, layerNodes;
+    ofVec3f origin;
+    float spacing;
+
+    // weighted color sums next to the field, divided out per vertex
+    vector<float> field, red, green, blue;
+
+    int tileNodes, tilesX, tilesY, tilesZ;
+    vector<int> tileStarts, tileFill, particleTiles;
+    vector<SplatPoint> splatPoints;
+
+    // each node owns the seven edges towards its larger neighbors. a bit is set per crossed edge,
+    // the edge's vertex is the node's first vertex plus the set bits below it
+    int cornerOffsets[8];
+    vector<unsigned char> cubes, edgeMasks;
+    vector<int> firstVertices, layerVertexOffsets, layerIndexOffsets;
+    vector<vector<ofIndexType>> layerIndices;
+};
+
+inline int MarchingCubes::getEdgeVertex(int node, int direction) {
+    int below = edgeMasks[node] & ((1 << (direction - 1)) - 1);
+    return firstVertices[node] + __builtin_popcount(below);
+}
+
+#endif /* MarchingCubes_hpp */
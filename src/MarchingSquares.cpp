@@ -0,0 +1,307 @@
+//
+//  MarchingSquares.cpp
+//  fluidSimulation
+//
+
+#include "MarchingSquares.hpp"
+#include "tbb/parallel_for.h"
+
+MarchingSquares::MarchingSquares() {
+    width = 0;
+    height = 0;
+    tileNodes = 16;
+    tilesX = 0;
+    tilesY = 0;
+    bandRows = 16;
+}
+
+void MarchingSquares::setup(int _width, int _height, ofVec2f _origin, ofVec2f _size) {
+    // called every frame, the grid is only reallocated when it changes
+    if (_width == width && _height == height && _origin == origin && _size == size) return;
+    
+    width = std::max(_width, 2);
+    height = std::max(_height, 2);
+    origin = _origin;
+    size = _size;
+    cellSize = ofVec2f(size.x / (width - 1), size.y / (height - 1));
+    
+    field.assign(width * height, 0.0);
+    red.assign(width * height, 0.0);
+    green.assign(width * height, 0.0);
+    blue.assign(width * height, 0.0);
+}
+
+int MarchingSquares::getWidth() {
+    return width;
+}
+
+int MarchingSquares::getHeight() {
+    return height;
+}
+
+float MarchingSquares::getField(int x, int y) {
+    return field[y * width + x];
+}
+
+// splat
+
+void MarchingSquares::splat(const vector<Particle> &particles, const vector<char> &aliveFlags, float radius) {
+    // tiles at least a radius across, so a particle only reaches the tiles next to its own
+    tileNodes = std::max(16, int(ceil(radius / std::min(cellSize.x, cellSize.y))));
+    tilesX = (width + tileNodes - 1) / tileNodes;
+    tilesY = (height + tileNodes - 1) / tileNodes;
+    int numTiles = tilesX * tilesY;
+    
+    int numParticles = particles.size();
+    particleTiles.resize(numParticles);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            if (!aliveFlags[i]) {
+                particleTiles[i] = -1;
+                continue;
+            }
+            int nodeX = floor((particles[i].position.x - origin.x) / cellSize.x);
+            int nodeY = floor((particles[i].position.y - origin.y) / cellSize.y);
+            int tileX = ofClamp(nodeX / tileNodes, 0, tilesX - 1);
+            int tileY = ofClamp(nodeY / tileNodes, 0, tilesY - 1);
+            particleTiles[i] = tileY * tilesX + tileX;
+        }
+    });
+    
+    // counting sort of the particles by tile
+    tileStarts.assign(numTiles + 1, 0);
+    for (int i = 0; i < numParticles; i++) {
+        if (particleTiles[i] >= 0) tileStarts[particleTiles[i] + 1]++;
+    }
+    for (int t = 0; t < numTiles; t++) {
+        tileStarts[t + 1] += tileStarts[t];
+    }
+    splatPoints.resize(tileStarts[numTiles]);
+    tileFill.assign(tileStarts.begin(), tileStarts.end() - 1);
+    for (int i = 0; i < numParticles; i++) {
+        if (particleTiles[i] < 0) continue;
+        SplatPoint &point = splatPoints[tileFill[particleTiles[i]]++];
+        point.x = particles[i].position.x - origin.x;
+        point.y = particles[i].position.y - origin.y;
+        point.color = particles[i].particleColor;
+    }
+    
+    // each tile gathers the particles around it and writes only its own nodes
+    float squareRadius = radius * radius;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numTiles), [&](tbb::blocked_range<int> r) {
+        for (int t = r.begin(); t < r.end(); ++t) {
+            int tileX = t % tilesX;
+            int tileY = t / tilesX;
+            int minX = tileX * tileNodes;
+            int minY = tileY * tileNodes;
+            int maxX = std::min(minX + tileNodes, width) - 1;
+            int maxY = std::min(minY + tileNodes, height) - 1;
+            
+            for (int y = minY; y <= maxY; y++) {
+                for (int x = minX; x <= maxX; x++) {
+                    int node = y * width + x;
+                    field[node] = 0.0;
+                    red[node] = 0.0;
+                    green[node] = 0.0;
+                    blue[node] = 0.0;
+                }
+            }
+            
+            for (int offsetY = -1; offsetY < 2; offsetY++) {
+                int neighborY = tileY + offsetY;
+                if (neighborY < 0 || neighborY >= tilesY) continue;
+                
+                for (int offsetX = -1; offsetX < 2; offsetX++) {
+                    int neighborX = tileX + offsetX;
+                    if (neighborX < 0 || neighborX >= tilesX) continue;
+                    
+                    int neighbor = neighborY * tilesX + neighborX;
+                    for (int k = tileStarts[neighbor]; k < tileStarts[neighbor + 1]; k++) {
+                        const SplatPoint &point = splatPoints[k];
+                        float px = point.x;
+                        float py = point.y;
+                        
+                        int startX = std::max(minX, int(ceil((px - radius) / cellSize.x)));
+                        int endX = std::min(maxX, int(floor((px + radius) / cellSize.x)));
+                        int startY = std::max(minY, int(ceil((py - radius) / cellSize.y)));
+                        int endY = std::min(maxY, int(floor((py + radius) / cellSize.y)));
+                        if (startX > endX || startY > endY) continue;
+                        
+                        const ofFloatColor &color = point.color;
+                        
+                        for (int y = startY; y <= endY; y++) {
+                            float dy = y * cellSize.y - py;
+                            
+                            for (int x = startX; x <= endX; x++) {
+                                float dx = x * cellSize.x - px;
+                                float squareDistance = dx * dx + dy * dy;
+                                if (squareDistance >= squareRadius) continue;
+                                
+                                // peaks at one under an isolated particle and falls smoothly to zero at the radius
+                                float q = 1.0 - squareDistance / squareRadius;
+                                float weight = q * q * q;
+                                
+                                int node = y * width + x;
+                                field[node] += weight;
+                                red[node] += weight * color.r;
+                                green[node] += weight * color.g;
+                                blue[node] += weight * color.b;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+// extract
+
+void MarchingSquares::extract(float threshold, ofMesh &mesh) {
+    int cellRows = height - 1;
+    int numBands = (cellRows + bandRows - 1) / bandRows;
+    bands.resize(numBands);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numBands), [&](tbb::blocked_range<int> r) {
+        for (int b = r.begin(); b < r.end(); ++b) {
+            Band &band = bands[b];
+            int firstRow = b * bandRows;
+            int lastRow = std::min(firstRow + bandRows, cellRows);
+            int rows = lastRow - firstRow;
+            
+            band.vertices.clear();
+            band.colors.clear();
+            band.indices.clear();
+            band.cornerVertices.assign((rows + 1) * width, -1);
+            band.edgeXVertices.assign((rows + 1) * width, -1);
+            band.edgeYVertices.assign(rows * width, -1);
+            
+            for (int y = firstRow; y < lastRow; y++) {
+                for (int x = 0; x < width - 1; x++) {
+                    // corners counterclockwise from the top left, with the edge after each
+                    int cornerX[4] = { x, x + 1, x + 1, x };
+                    int cornerY[4] = { y, y, y + 1, y + 1 };
+                    Boolean inside[4];
+                    int insideCount = 0;
+                    for (int c = 0; c < 4; c++) {
+                        inside[c] = field[cornerY[c] * width + cornerX[c]] >= threshold;
+                        insideCount += inside[c];
+                    }
+                    if (insideCount == 0) continue;
+                    
+                    // the two saddles are split when the cell center is outside
+                    Boolean saddle = insideCount == 2 && inside[0] == inside[2];
+                    if (saddle) {
+                        float centerValue = 0.0;
+                        for (int c = 0; c < 4; c++) {
+                            centerValue += field[cornerY[c] * width + cornerX[c]] * 0.25;
+                        }
+                        saddle = centerValue < threshold;
+                    }
+                    
+                    if (saddle) {
+                        for (int c = 0; c < 4; c++) {
+                            if (!inside[c]) continue;
+                            int previous = (c + 3) % 4;
+                            int next = (c + 1) % 4;
+                            band.indices.push_back(addEdge(band, cornerX[previous], cornerY[previous], cornerX[c], cornerY[c], firstRow, threshold));
+                            band.indices.push_back(addCorner(band, cornerX[c], cornerY[c], firstRow));
+                            band.indices.push_back(addEdge(band, cornerX[c], cornerY[c], cornerX[next], cornerY[next], firstRow, threshold));
+                        }
+                        continue;
+                    }
+                    
+                    // walking the border keeps the inside corners and the crossings in order,
+                    // the polygon is convex so a fan fills it
+                    int polygon[8];
+                    int polygonSize = 0;
+                    for (int c = 0; c < 4; c++) {
+                        int next = (c + 1) % 4;
+                        if (inside[c]) {
+                            polygon[polygonSize++] = addCorner(band, cornerX[c], cornerY[c], firstRow);
+                        }
+                        if (inside[c] != inside[next]) {
+                            polygon[polygonSize++] = addEdge(band, cornerX[c], cornerY[c], cornerX[next], cornerY[next], firstRow, threshold);
+                        }
+                    }
+                    
+                    for (int k = 1; k < polygonSize - 1; k++) {
+                        band.indices.push_back(polygon[0]);
+                        band.indices.push_back(polygon[k]);
+                        band.indices.push_back(polygon[k + 1]);
+                    }
+                }
+            }
+        }
+    });
+    
+    // bands are joined into the mesh in order, rows on a seam are stored once per band
+    vertexOffsets.assign(numBands + 1, 0);
+    indexOffsets.assign(numBands + 1, 0);
+    for (int b = 0; b < numBands; b++) {
+        vertexOffsets[b + 1] = vertexOffsets[b] + bands[b].vertices.size();
+        indexOffsets[b + 1] = indexOffsets[b] + bands[b].indices.size();
+    }
+    
+    mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+    auto &meshVertices = mesh.getVertices();
+    auto &meshColors = mesh.getColors();
+    auto &meshIndices = mesh.getIndices();
+    meshVertices.resize(vertexOffsets[numBands]);
+    meshColors.resize(vertexOffsets[numBands]);
+    meshIndices.resize(indexOffsets[numBands]);
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numBands), [&](tbb::blocked_range<int> r) {
+        for (int b = r.begin(); b < r.end(); ++b) {
+            const Band &band = bands[b];
+            for (int v = 0; v < band.vertices.size(); v++) {
+                meshVertices[vertexOffsets[b] + v] = band.vertices[v];
+                meshColors[vertexOffsets[b] + v] = band.colors[v];
+            }
+            for (int i = 0; i < band.indices.size(); i++) {
+                meshIndices[indexOffsets[b] + i] = band.indices[i] + vertexOffsets[b];
+            }
+        }
+    });
+}
+
+int MarchingSquares::addCorner(Band &band, int x, int y, int firstRow) {
+    int &vertex = band.cornerVertices[(y - firstRow) * width + x];
+    if (vertex == -1) {
+        vertex = band.vertices.size();
+        band.vertices.push_back(ofVec3f(origin.x + x * cellSize.x, origin.y + y * cellSize.y, 0.0));
+        band.colors.push_back(getColor(y * width + x));
+    }
+    return vertex;
+}
+
+int MarchingSquares::addEdge(Band &band, int x, int y, int nextX, int nextY, int firstRow, float threshold) {
+    // edges are keyed by their top or left end
+    int startX = std::min(x, nextX);
+    int startY = std::min(y, nextY);
+    int endX = std::max(x, nextX);
+    int endY = std::max(y, nextY);
+    
+    vector<int> &edgeVertices = startY == endY ? band.edgeXVertices : band.edgeYVertices;
+    int &vertex = edgeVertices[(startY - firstRow) * width + startX];
+    if (vertex == -1) {
+        int startNode = startY * width + startX;
+        int endNode = endY * width + endX;
+        float t = ofClamp((threshold - field[startNode]) / (field[endNode] - field[startNode]), 0.0, 1.0);
+        
+        ofVec3f start = ofVec3f(origin.x + startX * cellSize.x, origin.y + startY * cellSize.y, 0.0);
+        ofVec3f end = ofVec3f(origin.x + endX * cellSize.x, origin.y + endY * cellSize.y, 0.0);
+        
+        vertex = band.vertices.size();
+        band.vertices.push_back(start + (end - start) * t);
+        band.colors.push_back(getColor(startNode).getLerped(getColor(endNode), t));
+    }
+    return vertex;
+}
+
+ofFloatColor MarchingSquares::getColor(int node) {
+    if (field[node] <= 0.0) return ofFloatColor(0.0, 0.0, 0.0, 1.0);
+    return ofFloatColor(red[node] / field[node], green[node] / field[node], blue[node] / field[node], 1.0);
+}
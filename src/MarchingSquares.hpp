@@ -0,0 +1,64 @@
+//
+//  MarchingSquares.hpp
+//  fluidSimulation
+//
+
+#ifndef MarchingSquares_hpp
+#define MarchingSquares_hpp
+
+#include <stdio.h>
+#include "ofMain.h"
+#include "Platform.hpp"
+#include "Particle.hpp"
+
+// liquid surface for the 2D draw mode. particles are splatted onto a grid of fixed resolution
+// and the region above the threshold is filled with marching squares, so the cost follows
+// the grid and not the particle count. both passes run over independent tiles of the grid,
+// vertices are shared between the cells of a band of rows
+class MarchingSquares {
+public:
+    MarchingSquares();
+
+    void setup(int width, int height, ofVec2f origin, ofVec2f size);
+    void splat(const vector<Particle> &particles, const vector<char> &aliveFlags, float radius);
+    
+    // writes the filled region as indexed triangles into the mesh, its buffers are reused between frames
+    void extract(float threshold, ofMesh &mesh);
+
+    int getWidth();
+    int getHeight();
+    float getField(int x, int y);
+
+private:
+    struct Band {
+        vector<ofVec3f> vertices;
+        vector<ofFloatColor> colors;
+        vector<ofIndexType> indices;
+        vector<int> cornerVertices, edgeXVertices, edgeYVertices;
+    };
+
+    int addCorner(Band &band, int x, int y, int firstRow);
+    int addEdge(Band &band, int x, int y, int nextX, int nextY, int firstRow, float threshold);
+    ofFloatColor getColor(int node);
+
+    int width, height;
+    ofVec2f origin, size, cellSize;
+
+    // weighted color sums next to the field, divided out per vertex
+    vector<float> field, red, green, blue;
+
+    // particles are copied into tile order once, each tile then reads its neighbors' copies
+    struct SplatPoint {
+        float x, y;
+        ofFloatColor color;
+    };
+    int tileNodes, tilesX, tilesY;
+    vector<int> tileStarts, tileFill, particleTiles;
+    vector<SplatPoint> splatPoints;
+
+    int bandRows;
+    vector<Band> bands;
+    vector<int> vertexOffsets, indexOffsets;
+};
+
+#endif /* MarchingSquares_hpp */
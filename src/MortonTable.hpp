@@ -0,0 +1,81 @@
+//
+//  MortonTable.hpp
+//  fluidSimulation
+//
+
+#ifndef MortonTable_hpp
+#define MortonTable_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ofMain.h"
+
+// open addressing table from a morton code to an index, used by the 3D spatial indexes to find
+// their cells and blocks. it is refilled from scratch every build and kept at most half full,
+// so probes stay short
+class MortonTable {
+public:
+    MortonTable();
+    
+    // empties the table and sizes it for count keys
+    void reset(size_t count);
+    void insert(uint64_t key, int value);
+    
+    // -1 when the key is missing
+    int find(uint64_t key) const;
+    
+    size_t getMemoryBytes() const;
+    
+private:
+    static uint64_t getSlot(uint64_t key, uint64_t mask);
+    
+    // the key sits next to its value, so a probe reads one cache line
+    struct Slot {
+        uint64_t key;
+        int value;
+    };
+    vector<Slot> slots;
+    uint64_t mask;
+};
+
+inline MortonTable::MortonTable() {
+    mask = 0;
+}
+
+inline uint64_t MortonTable::getSlot(uint64_t key, uint64_t mask) {
+    return (key * 0x9e3779b97f4a7c15ull >> 32) & mask;
+}
+
+inline void MortonTable::reset(size_t count) {
+    size_t size = 16;
+    while (size < count * 2) {
+        size *= 2;
+    }
+    mask = size - 1;
+    slots.assign(size, Slot { UINT64_MAX, -1 });
+}
+
+inline void MortonTable::insert(uint64_t key, int value) {
+    uint64_t slot = getSlot(key, mask);
+    while (slots[slot].value != -1) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = Slot { key, value };
+}
+
+inline int MortonTable::find(uint64_t key) const {
+    if (slots.empty()) return -1;
+    
+    uint64_t slot = getSlot(key, mask);
+    while (slots[slot].value != -1) {
+        if (slots[slot].key == key) return slots[slot].value;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+inline size_t MortonTable::getMemoryBytes() const {
+    return slots.capacity() * sizeof(Slot);
+}
+
+#endif /* MortonTable_hpp */
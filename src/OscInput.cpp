@@ -0,0 +1,145 @@
+//
+//  OscInput.cpp
+//  fluidSimulation
+//
+
+#include "OscInput.hpp"
+#include <string.h>
+
+// trackers send floats, anything numeric is taken
+static float getArgumentAsFloat(const osc::ReceivedMessageArgument &argument) {
+    if (argument.IsFloat()) return argument.AsFloatUnchecked();
+    if (argument.IsInt32()) return argument.AsInt32Unchecked();
+    if (argument.IsDouble()) return argument.AsDoubleUnchecked();
+    return 0.0;
+}
+
+OscInput::OscInput() {
+    writeIndex = 0;
+    readIndex = 0;
+    droppedEvents = 0;
+    
+    systemWidth = ofGetWidth();
+    systemHeight = ofGetHeight();
+    simulateActive = false;
+    reportedDroppedEvents = 0;
+}
+
+void OscInput::setSystemSize(float _systemWidth, float _systemHeight) {
+    systemWidth = _systemWidth;
+    systemHeight = _systemHeight;
+}
+
+int OscInput::getDroppedEvents() {
+    return droppedEvents;
+}
+
+// listening thread
+
+void OscInput::ProcessMessage(const osc::ReceivedMessage &m, const osc::IpEndpointName &remoteEndpoint) {
+    int type;
+    const char *address = m.AddressPattern();
+    if (strcmp(address, "/simulateMouse") == 0) {
+        type = SIMULATE_MOUSE;
+    } else if (strcmp(address, "/interactionPoints") == 0) {
+        type = INTERACTION_POINTS;
+    } else if (strcmp(address, "/simulateActive") == 0) {
+        type = SIMULATE_ACTIVE;
+    } else {
+        return;
+    }
+    
+    // the network thread never waits on the simulation
+    uint64_t write = writeIndex.load(std::memory_order_relaxed);
+    if (write - readIndex.load(std::memory_order_acquire) >= OSC_INPUT_QUEUE_SIZE) {
+        droppedEvents++;
+        return;
+    }
+    
+    Event &event = events[write & (OSC_INPUT_QUEUE_SIZE - 1)];
+    event.type = type;
+    event.timeMicros = ofGetElapsedTimeMicros();
+    event.points.clear();
+    
+    osc::ReceivedMessageArgumentIterator argument = m.ArgumentsBegin();
+    int argumentCount = m.ArgumentCount();
+    
+    if (type == SIMULATE_MOUSE) {
+        if (argumentCount < 2) return;
+        event.x = getArgumentAsFloat(*argument);
+        ++argument;
+        event.y = getArgumentAsFloat(*argument);
+    } else if (type == SIMULATE_ACTIVE) {
+        if (argumentCount < 1) return;
+        event.active = getArgumentAsFloat(*argument) == 1.0;
+    } else {
+        // every tracked person as x, y, radius, force, a trailing partial point is ignored
+        for (int i = 0; i + 3 < argumentCount; i += 4) {
+            ofVec4f point;
+            for (int j = 0; j < 4; j++) {
+                point[j] = getArgumentAsFloat(*argument);
+                ++argument;
+            }
+            event.points.push_back(point);
+        }
+    }
+    
+    writeIndex.store(write + 1, std::memory_order_release);
+}
+
+// simulation thread
+
+void OscInput::applyEvents(FluidSystem2D &fluidSystem, uint64_t stepMicros) {
+    uint64_t read = readIndex.load(std::memory_order_relaxed);
+    uint64_t write = writeIndex.load(std::memory_order_acquire);
+    
+    Boolean pressed = false;
+    Boolean pointsChanged = false;
+    
+    for (; read < write; read++) {
+        Event &event = events[read & (OSC_INPUT_QUEUE_SIZE - 1)];
+        if (event.timeMicros > stepMicros) break;
+        
+        if (event.type == SIMULATE_MOUSE) {
+            // a press and its release inside one step would cancel out, so the release waits a step
+            if (pressed && !simulateActive) break;
+            
+            float x = ofMap(event.x, -1.0, 1.0, 0, systemWidth);
+            float y = ofMap(event.y, -1.0, 1.0, 0, systemHeight);
+            pressed = pressed || (simulateActive && !fluidSystem.mouseInputActive);
+            fluidSystem.mouseInput(x, y, 0, simulateActive);
+        }
+        
+        // each list replaces the last, only the newest one of the step reaches the system
+        if (event.type == INTERACTION_POINTS) {
+            interactionPoints.resize(event.points.size());
+            for (int i = 0; i < event.points.size(); i++) {
+                const ofVec4f &point = event.points[i];
+                interactionPoints[i].position.x = ofMap(point.x, -1.0, 1.0, 0, systemWidth);
+                interactionPoints[i].position.y = ofMap(point.y, -1.0, 1.0, 0, systemHeight);
+                interactionPoints[i].radius = point.z;
+                interactionPoints[i].force = fabs(point.w);
+                interactionPoints[i].pull = point.w < 0.0;
+            }
+            pointsChanged = true;
+        }
+        
+        if (event.type == SIMULATE_ACTIVE) {
+            simulateActive = event.active;
+        }
+    }
+    
+    // hands the slots back to the listening thread
+    readIndex.store(read, std::memory_order_release);
+    
+    if (pointsChanged) {
+        fluidSystem.setInteractionPoints(interactionPoints);
+    }
+    
+    // a full ring means the simulation fell behind the trackers, say so once per burst
+    int dropped = droppedEvents;
+    if (dropped != reportedDroppedEvents) {
+        ofLogWarning("OscInput") << "dropped " << dropped - reportedDroppedEvents << " events, " << dropped << " in total";
+        reportedDroppedEvents = dropped;
+    }
+}
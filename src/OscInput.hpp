@@ -0,0 +1,63 @@
+//
+//  OscInput.hpp
+//  fluidSimulation
+//
+
+#ifndef OscInput_hpp
+#define OscInput_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include "ofxOsc.h"
+#include "FluidSystem2D.hpp"
+
+// power of two, events past it are dropped until the simulation catches up
+#define OSC_INPUT_QUEUE_SIZE 1024
+
+// messages are parsed on the receiver's own listening thread, as they arrive, into a single producer
+// single consumer ring of timestamped events, so the main thread no longer parses them. they still
+// reach the system once per frame, when ofApp::update drains the ring before the step
+class OscInput : public ofxOscReceiver {
+public:
+    OscInput();
+
+    // applies the events that arrived before stepMicros in order, the rest wait for the next step
+    void applyEvents(FluidSystem2D &fluidSystem, uint64_t stepMicros);
+    void setSystemSize(float systemWidth, float systemHeight);
+
+    // total since setup, applyEvents also logs each time it grows
+    int getDroppedEvents();
+
+protected:
+    // runs on the listening thread
+    void ProcessMessage(const osc::ReceivedMessage &m, const osc::IpEndpointName &remoteEndpoint) override;
+
+private:
+    enum EventType {
+        SIMULATE_MOUSE,
+        INTERACTION_POINTS,
+        SIMULATE_ACTIVE
+    };
+
+    // points are x, y, radius, force as sent, mapped into the system on the simulation thread.
+    // slots keep their vectors so a refill only allocates when a longer list comes in
+    struct Event {
+        int type;
+        uint64_t timeMicros;
+        float x, y;
+        Boolean active;
+        vector<ofVec4f> points;
+    };
+
+    Event events[OSC_INPUT_QUEUE_SIZE];
+    std::atomic<uint64_t> writeIndex, readIndex;
+    std::atomic<int> droppedEvents;
+
+    // simulation thread state
+    float systemWidth, systemHeight;
+    Boolean simulateActive;
+    int reportedDroppedEvents;
+    vector<FluidSystem2D::InteractionPoint> interactionPoints;
+};
+
+#endif /* OscInput_hpp */
@@ -8,6 +8,10 @@
 Particle::Particle(ofVec3f _position, float _radius) {
     position = _position;
     predictedPosition = _position;
+    verletPosition = _position;
+    lastPosition = _position;
+    deltaPosition = ofVec3f::zero();
+    velocityChange = ofVec3f::zero();
     radius = _radius;
     lineThickness = 1;
     magnitude = 0;
@@ -15,6 +19,9 @@ Particle::Particle(ofVec3f _position, float _radius) {
     velocity = ofVec3f::zero();
     nearDensity = 0.0;
     density = 0.0;
+    pressure = 0.0;
+    nearPressure = 0.0;
+    lambda = 0.0;
     particleColor = ofColor::black;
     
     minVelocity = 0.0;
@@ -232,6 +239,30 @@ void Particle::setRadius(float _radius) {
     radius = _radius;
 }
 
+void Particle::respawn(ofVec3f _position, ofVec3f _velocity) {
+    // only the simulation state starts over, the shape meshes and gui settings are kept
+    position = _position;
+    predictedPosition = _position;
+    verletPosition = _position;
+    lastPosition = _position;
+    deltaPosition = ofVec3f::zero();
+    velocityChange = ofVec3f::zero();
+    velocity = _velocity;
+    
+    density = 0.0;
+    nearDensity = 0.0;
+    pressure = 0.0;
+    nearPressure = 0.0;
+    lambda = 0.0;
+    
+    lerpedMagnitude = 0.0;
+    lerpedTheta = 0.0;
+    
+    // the old neighbor list is kept, the system still needs it to take this slot out of its neighbors' lists
+    neighborDistances.clear();
+    neighborDirections.clear();
+}
+
 void Particle::draw() {
     // do nothing
 }
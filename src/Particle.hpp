@@ -15,6 +15,7 @@ public:
 
     // member variables for fluid calculations
     float radius, density, nearDensity;
+    float pressure, nearPressure, lambda;
     
     // gui parameters
     float lineThickness, lineLength;
@@ -28,6 +29,8 @@ public:
     int circleResolution, rectangleResolution;
     
     ofVec3f position, velocity, predictedPosition;
+    ofVec3f verletPosition, lastPosition, deltaPosition;
+    ofVec3f velocityChange;
     ofColor particleColor, coolColor, hotColor;
     
     ofMesh circleMesh, rectangleMesh, vectorMesh, lineMesh;
@@ -40,11 +43,14 @@ public:
     enum shapeModes { CIRCLE, RECTANGLE, VECTOR, LINE } shapeMode;
 
     vector <int> indicesWithinRadius;
+    vector <float> neighborDistances;
+    vector <ofVec2f> neighborDirections;
     
     ofMesh getShapeMesh();
     
     void setMode(int mode);
     void setRadius(float radius);
+    void respawn(ofVec3f position, ofVec3f velocity);
     void setVertices();
     void setSizes();
     void setSmoothedVelocity();
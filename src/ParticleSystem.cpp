@@ -16,13 +16,28 @@ ParticleSystem::ParticleSystem() {
     gravityMultiplier = 1.0;
     collisionDamping = 0.25;
     pauseActive = false;
+    nextFrameActive = false;
+    exportFrameActive = false;
+    mouseInputActive = false;
+    circleBoundaryActive = false;
     gravityForce = ofVec2f(1.0, 0.0);
     mouseForce = 1.0;
     circleBoundaryRadius = 455;
     
+    stepCount = 0;
+    resetCount = 0;
+    spawnCount = 0;
+    
+    aliveCount = 0;
+    poolRevision = 0;
+    poolLogRevision = 0;
+    
     rectangleResolution = 4;
     circleResolution = 22;
     
+    surfaceThreshold = 0.5;
+    surfaceResolution = 4.0;
+    
     systemWidth = ofGetWidth();
     systemHeight = ofGetHeight();
 }
@@ -104,6 +119,9 @@ void ParticleSystem::updateMesh(int particleIndex) {
         case POINTS:
             updatePoint(particleIndex);
             break;
+        case SURFACE:
+            // the surface is rebuilt from all particles at once in draw
+            break;
     }
 }
 
@@ -138,49 +156,230 @@ void ParticleSystem::updatePoint(int particleIndex) {
     mesh.setColor(particleIndex, particles[particleIndex].particleColor);
 }
 
+void ParticleSystem::hideMesh(int particleIndex) {
+    if (drawMode == SURFACE) return;
+    
+    // collapse the slot to one transparent point, degenerate triangles and lines draw nothing
+    int verticesPerParticle = 1;
+    if (drawMode == CIRCLES || drawMode == RECTANGLES || drawMode == VECTORS) {
+        verticesPerParticle = shapeResolution + 1;
+    } else if (drawMode == LINES) {
+        verticesPerParticle = 2;
+    }
+    
+    int meshIndex = verticesPerParticle * particleIndex;
+    if (meshIndex + verticesPerParticle > mesh.getNumVertices()) return;
+    
+    for (int j = 0; j < verticesPerParticle; j++) {
+        mesh.setVertex(meshIndex + j, ofVec3f::zero());
+        mesh.setColor(meshIndex + j, ofColor(0, 0));
+    }
+}
+
 void ParticleSystem::draw() {
+    if (drawMode == SURFACE) {
+        updateSurface();
+    }
     mesh.draw();
 }
 
+void ParticleSystem::updateSurface() {
+    // the grid covers the bounds and a radius around them, so particles on the walls stay round
+    ofVec2f origin = ofVec2f(xBounds.x - radius, yBounds.x - radius);
+    ofVec2f size = ofVec2f(xBounds.y - xBounds.x, yBounds.y - yBounds.x) + ofVec2f(radius, radius) * 2.0;
+    float spacing = std::max(surfaceResolution, 1.0f);
+    
+    surface.setup(ceil(size.x / spacing) + 1, ceil(size.y / spacing) + 1, origin, size);
+    surface.splat(particles, aliveFlags, radius);
+    surface.extract(surfaceThreshold, mesh);
+}
+
+void ParticleSystem::setSurfaceThreshold(float _surfaceThreshold) {
+    surfaceThreshold = _surfaceThreshold;
+}
+
+void ParticleSystem::setSurfaceResolution(float _surfaceResolution) {
+    surfaceResolution = _surfaceResolution;
+}
+
 // create particles
 void ParticleSystem::addParticle() {
+    if (freeIndices.empty()) return;
     ofVec2f position;
     
+    float values[4];
+    random.uniform4(SPAWN_STREAM, freeIndices.back(), spawnCount++, 0, values);
+    
     if (circleBoundaryActive) {
         ofVec2f center = ofVec2f(systemWidth / 2.0, systemHeight / 2.0);
         
-        float theta = ofRandom(0, TWO_PI);
-        float magnitude = ofRandom(0, circleBoundaryRadius);
+        float theta = values[0] * TWO_PI;
+        float magnitude = values[1] * circleBoundaryRadius;
         
         float x = cos(theta) * magnitude;
         float y = sin(theta) * magnitude;
         
         position = ofVec2f(x, y) + center;
     } else {
-        float x = ofRandom(bounds.x, bounds.x + boundsSize.x);
-        float y = ofRandom(bounds.y, bounds.y + boundsSize.y);
+        float x = bounds.x + values[0] * boundsSize.x;
+        float y = bounds.y + values[1] * boundsSize.y;
         
         position = ofVec2f(x, y);
     }
     
-    particles.push_back(Particle(position, 1.0));
+    spawnParticle(position, ofVec3f::zero());
+}
+
+int ParticleSystem::spawnParticle(ofVec3f position, ofVec3f velocity) {
+    if (freeIndices.empty()) return -1;
+    
+    int particleIndex = freeIndices.back();
+    freeIndices.pop_back();
+    
+    particles[particleIndex].respawn(position, velocity);
+    aliveFlags[particleIndex] = true;
+    aliveCount++;
+    logPoolChange(particleIndex, true);
+    
+    return particleIndex;
+}
+
+void ParticleSystem::killParticle(int particleIndex) {
+    if (!aliveFlags[particleIndex]) return;
+    
+    aliveFlags[particleIndex] = false;
+    freeIndices.push_back(particleIndex);
+    aliveCount--;
+    logPoolChange(particleIndex, false);
+    
+    hideMesh(particleIndex);
+}
+
+void ParticleSystem::logPoolChange(int particleIndex, Boolean spawned) {
+    // a log longer than the pool is no cheaper to patch from than a rebuild
+    if (poolChanges.size() >= particles.size()) {
+        clearPoolChanges();
+    }
+    
+    PoolChange change;
+    change.particleIndex = particleIndex;
+    change.spawned = spawned;
+    poolChanges.push_back(change);
+    poolRevision++;
+}
+
+void ParticleSystem::clearPoolChanges() {
+    poolChanges.clear();
+    poolLogRevision = poolRevision;
 }
 
-ofVec2f ParticleSystem::getRandom2DDirection() {
-    ofVec2f randomDirection = ofVec2f(1.0, 0.0).rotateRad(ofRandom(0, TWO_PI));
-    return randomDirection;
+void ParticleSystem::setCapacity(int capacity) {
+    int previousCapacity = particles.size();
+    if (capacity <= previousCapacity) return;
+    
+    // the only place particles are constructed, growing is the one change that still rebuilds the mesh
+    particles.reserve(capacity);
+    while (particles.size() < capacity) {
+        particles.push_back(Particle(ofVec3f::zero(), 1.0));
+    }
+    aliveFlags.resize(capacity, false);
+    
+    // new slots go under the existing free ones, lower indices are handed out first
+    vector<int> newIndices;
+    for (int i = capacity - 1; i >= previousCapacity; i--) {
+        newIndices.push_back(i);
+    }
+    freeIndices.insert(freeIndices.begin(), newIndices.begin(), newIndices.end());
+    
+    spatialLookup.resize(capacity);
+    startIndices.resize(capacity);
+    setMode(drawModeInt);
+    poolRevision++;
+    clearPoolChanges();
 }
 
-ofVec3f ParticleSystem::getRandom3DDirection() {
-    ofVec3f unitVector = ofVec3f(1.0, 0.0, 0.0);
+void ParticleSystem::setAliveRange(int number) {
+    // loaders write straight into the first slots, so they have to be the live ones
+    setCapacity(number);
     
-    float rX = ofRandom(0, TWO_PI);
-    float rY = ofRandom(0, TWO_PI);
-    float rZ = ofRandom(0, TWO_PI);
+    // nothing to do when the free list already holds exactly the slots past the range, lowest last
+    int capacity = particles.size();
+    if (aliveCount == number && freeIndices.size() == capacity - number) {
+        Boolean inOrder = true;
+        for (int k = 0; k < freeIndices.size() && inOrder; k++) {
+            inOrder = freeIndices[k] == capacity - 1 - k;
+        }
+        if (inOrder) return;
+    }
     
-    ofVec3f randomDirection = unitVector.rotateRad(rX, rY, rZ);
+    // only slots that change state are touched, the dead ones past the range are already hidden
+    freeIndices.clear();
+    for (int i = capacity - 1; i >= 0; i--) {
+        Boolean alive = i < number;
+        if (!alive) {
+            freeIndices.push_back(i);
+        }
+        if (aliveFlags[i] == alive) continue;
+        
+        aliveFlags[i] = alive;
+        if (!alive) {
+            hideMesh(i);
+        }
+    }
+    aliveCount = number;
+    poolRevision++;
+    clearPoolChanges();
+}
+
+ofVec2f ParticleSystem::getRandom2DDirection(int particleIndex) {
+    float theta = random.uniform(RESET_STREAM, particleIndex, resetCount, 1) * TWO_PI;
+    return ofVec2f(cos(theta), sin(theta));
+}
+
+ofVec2f ParticleSystem::getRandom2DDirection(int particleIndex, int neighborIndex) {
+    // keyed by the pair and the step, so the same overlap resolves the same way on any thread
+    float theta = random.uniform(OVERLAP_STREAM, particleIndex, neighborIndex, stepCount) * TWO_PI;
+    return ofVec2f(cos(theta), sin(theta));
+}
+
+ofVec3f ParticleSystem::getRandom3DDirection(int particleIndex) {
+    float values[4];
+    random.uniform4(RESET_STREAM, particleIndex, resetCount, 1, values);
+    return getUnitSphereDirection(values[0], values[1]);
+}
+
+ofVec3f ParticleSystem::getRandom3DDirection(int particleIndex, int neighborIndex) {
+    float values[4];
+    random.uniform4(OVERLAP_STREAM, particleIndex, neighborIndex, stepCount, values);
+    return getUnitSphereDirection(values[0], values[1]);
+}
+
+ofVec3f ParticleSystem::getUnitSphereDirection(float u, float v) {
+    float z = 1.0 - 2.0 * u;
+    float r = sqrt(std::max(0.0f, 1.0f - z * z));
+    float phi = v * TWO_PI;
+    return ofVec3f(r * cos(phi), r * sin(phi), z);
+}
+
+void ParticleSystem::setSeed(unsigned int seed) {
+    random.setSeed(seed);
+    resetCount = 0;
+    spawnCount = 0;
+    stepCount = 0;
+}
+
+void ParticleSystem::setForceField(int preset) {
+    // about 64 cells across the long side is plenty for smooth large scale forcing
+    int longSide = std::max(systemWidth, systemHeight);
+    int width = std::max(1, 64 * systemWidth / std::max(1, longSide));
+    int height = std::max(1, 64 * systemHeight / std::max(1, longSide));
     
-    return randomDirection;
+    forceField.setup(width, height, 1, ofVec3f::zero(), ofVec3f(systemWidth, systemHeight, 0));
+    forceField.setPreset(preset);
+}
+
+void ParticleSystem::setForceFieldStrength(float strength) {
+    forceField.strength = strength;
 }
 
 void ParticleSystem::pause(Boolean _pauseActive) {
@@ -208,21 +407,18 @@ void ParticleSystem::mouseInput(int x, int y) {
 
 // setters
 void ParticleSystem::setNumberParticles(int number) {
+    // capacity only grows, and by half again so dragging the slider up does not rebuild every frame
     if (number > particles.size()) {
-        while (particles.size() < number) {
-            addParticle();
-        }
-        spatialLookup.resize(particles.size());
-        startIndices.resize(particles.size());
-        setMode(drawModeInt);
+        setCapacity(std::max(number, int(particles.size() * 3 / 2)));
     }
-    if (number < particles.size()) {
-        while (particles.size() > number) {
-            particles.pop_back();
-        }
-        spatialLookup.resize(particles.size());
-        startIndices.resize(particles.size());
-        setMode(drawModeInt);
+    
+    while (aliveCount < number) {
+        addParticle();
+    }
+    
+    // the newest slots go first so the survivors keep their indices
+    for (int i = particles.size() - 1; i >= 0 && aliveCount > number; i--) {
+        killParticle(i);
     }
 }
 
@@ -354,8 +550,9 @@ void ParticleSystem::setMode(int _drawModeInt) {
         initializePointsMesh(particles.size());
     }
     else if (_drawModeInt == 5) {
-        // drawMode = SVG;
-        // initializePointsMesh(particles.size());
+        drawMode = SURFACE;
+        mesh.clear();
+        mesh.setMode(OF_PRIMITIVE_TRIANGLES);
     }
     
     for (int i = 0; i < particles.size(); i++) {
@@ -363,6 +560,10 @@ void ParticleSystem::setMode(int _drawModeInt) {
     }
     
     drawModeInt = _drawModeInt;
+    
+    for (int i = 0; i < particles.size(); i++) {
+        if (!aliveFlags[i]) hideMesh(i);
+    }
 }
 
 void ParticleSystem::setCenter(float _centerX, float _centerY) {
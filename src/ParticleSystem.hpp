@@ -7,8 +7,12 @@
 #define ParticleSystem_hpp
 
 #include <stdio.h>
+#include "Platform.hpp"
 #include "Particle.hpp"
 #include "Kernels.hpp"
+#include "Random.hpp"
+#include "ForceField.hpp"
+#include "MarchingSquares.hpp"
 #include "tbb/parallel_for.h"
 
 class ParticleSystem {
@@ -21,7 +25,7 @@ public:
     float targetDensity, nearPressureMultiplier, pressureMultiplier, gravityMultiplier, timeScalar, viscosityStrength;
     int mouseButton, mouseRadius;
 
-    enum drawModes { CIRCLES, RECTANGLES, VECTORS, LINES, POINTS } drawMode;
+    enum drawModes { CIRCLES, RECTANGLES, VECTORS, LINES, POINTS, SURFACE } drawMode;
     int circleResolution, rectangleResolution, shapeResolution, drawModeInt;;
     
     ofMesh mesh;
@@ -44,9 +48,52 @@ public:
     float circleBoundaryRadius;
     Boolean circleBoundaryActive;
 
+    // surface mode splats the particles onto a grid spaced surfaceResolution pixels apart
+    // and fills everything above surfaceThreshold, one isolated particle peaks at 1
+    MarchingSquares surface;
+    float surfaceThreshold, surfaceResolution;
+    void updateSurface();
+    void setSurfaceThreshold(float surfaceThreshold);
+    void setSurfaceResolution(float surfaceResolution);
+
+    // pooled particles, dead slots stay allocated so the count can change without rebuilding anything.
+    // dead particles are skipped by every pass and sort to the end of the spatial lookup
+    vector<char> aliveFlags;
+    vector<int> freeIndices;
+    int aliveCount;
+    unsigned int poolRevision;
+    void setCapacity(int capacity);
+    void setAliveRange(int number);
+    int spawnParticle(ofVec3f position, ofVec3f velocity);
+    void killParticle(int particleIndex);
+    void hideMesh(int particleIndex);
+    
+    // spawns and kills in order since poolLogRevision, one per revision, so structures built from the pool
+    // can patch just the particles that changed. capacity changes and alive ranges clear it, as does
+    // running past the capacity, and anything built before poolLogRevision has to be rebuilt
+    struct PoolChange {
+        int particleIndex;
+        Boolean spawned;
+    };
+    vector<PoolChange> poolChanges;
+    unsigned int poolLogRevision;
+    void logPoolChange(int particleIndex, Boolean spawned);
+    void clearPoolChanges();
+    
     vector<pair<int, unsigned int>> spatialLookup;
     vector<int> startIndices;
     
+    // seeded random numbers keyed by particle, step and reset
+    enum randomStreams { RESET_STREAM, SPAWN_STREAM, OVERLAP_STREAM };
+    Random random;
+    unsigned int stepCount, resetCount, spawnCount;
+    void setSeed(unsigned int seed);
+    
+    // baked accelerations sampled in the external force pass
+    ForceField forceField;
+    void setForceField(int preset);
+    void setForceFieldStrength(float strength);
+    
     // setters
     void setDeltaTime(float deltaTime);
     void setRadius(float radius);
@@ -79,10 +126,11 @@ public:
     
     // creation functions
     void addParticle();
-    void addParticle(ofVec3f position);
-    void addParticle(ofVec3f position, float radius);
-    ofVec2f getRandom2DDirection();
-    ofVec3f getRandom3DDirection();
+    ofVec2f getRandom2DDirection(int particleIndex);
+    ofVec2f getRandom2DDirection(int particleIndex, int neighborIndex);
+    ofVec3f getRandom3DDirection(int particleIndex);
+    ofVec3f getRandom3DDirection(int particleIndex, int neighborIndex);
+    ofVec3f getUnitSphereDirection(float u, float v);
     
     // interactions
     void mouseInput(int x, int y);
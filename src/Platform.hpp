@@ -0,0 +1,15 @@
+//
+//  Platform.hpp
+//  fluidSimulation
+//
+
+#ifndef Platform_hpp
+#define Platform_hpp
+
+// Boolean comes from MacTypes.h through openFrameworks on apple platforms,
+// everywhere else it is defined the same way here so the sources build unchanged
+#ifndef __APPLE__
+typedef unsigned char Boolean;
+#endif
+
+#endif /* Platform_hpp */
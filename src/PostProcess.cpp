@@ -0,0 +1,380 @@
+//
+//  PostProcess.cpp
+//  fluidSimulation
+//
+
+#include "PostProcess.hpp"
+#include "tbb/parallel_for.h"
+#include <fstream>
+
+PostProcess::PostProcess() {
+    blurMix = 0.0;
+    blurQuality = 3.0;
+    blurAngles = 16.0;
+    blurRadius = 8.0;
+    contrastAmount = 1.0;
+    exactActive = false;
+    width = 0;
+    height = 0;
+    blurVariance = 0.0;
+    factor = 1;
+    lowWidth = 0;
+    lowHeight = 0;
+}
+
+void PostProcess::setBlurMix(float _blurMix) {
+    blurMix = _blurMix;
+}
+
+void PostProcess::setBlurQuality(float _blurQuality) {
+    blurQuality = _blurQuality;
+}
+
+void PostProcess::setBlurAngles(float _blurAngles) {
+    blurAngles = _blurAngles;
+}
+
+void PostProcess::setBlurRadius(float _blurRadius) {
+    blurRadius = _blurRadius;
+}
+
+void PostProcess::setContrastAmount(float _contrastAmount) {
+    contrastAmount = _contrastAmount;
+}
+
+void PostProcess::setExact(Boolean _exactActive) {
+    exactActive = _exactActive;
+}
+
+// process
+
+void PostProcess::process(vector<unsigned char> &pixels, int _width, int _height) {
+    width = _width;
+    height = _height;
+    if (width <= 0 || height <= 0 || pixels.size() < width * height * 4) return;
+    
+    Boolean blurActive = blurMix != 0.0;
+    if (blurActive) {
+        findTaps();
+        if (exactActive) {
+            blurExact(pixels);
+        } else {
+            blurApproximate(pixels);
+        }
+    }
+    
+    // contrast only ever sees 8 bit levels, so it is a table
+    unsigned char contrastTable[256];
+    for (int level = 0; level < 256; level++) {
+        float value = level / 255.0 * contrastAmount + (1.0 - contrastAmount) * 0.5;
+        contrastTable[level] = roundf(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+    }
+    
+    // the shader adds the center to the taps and divides by quality times angles minus 15
+    float divisor = blurQuality * blurAngles - 15.0;
+    if (divisor == 0.0) divisor = 1e-6;
+    float inverseDivisor = 1.0 / divisor;
+    float numTaps = taps.size();
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, height), [&](tbb::blocked_range<int> r) {
+        vector<float> rowBuffer;
+        for (int y = r.begin(); y < r.end(); ++y) {
+            unsigned char *row = pixels.data() + y * width * 4;
+            
+            if (!blurActive) {
+                for (int x = 0; x < width * 4; x++) {
+                    if (x % 4 != 3) row[x] = contrastTable[row[x]];
+                }
+                continue;
+            }
+            
+            // blurred channels of the row one after the other
+            const float *blurredRow;
+            if (exactActive) {
+                blurredRow = blurred.data() + y * width * 3;
+            } else {
+                rowBuffer.resize(width * 3);
+                upsampleRow(y, rowBuffer.data());
+                blurredRow = rowBuffer.data();
+            }
+            
+            for (int c = 0; c < 3; c++) {
+                const float *channel = blurredRow + c * width;
+                for (int x = 0; x < width; x++) {
+                    float value = row[x * 4 + c] * (1.0f / 255.0f);
+                    float color = (value + channel[x] * numTaps) * inverseDivisor;
+                    value = value + (color - value) * blurMix;
+                    int level = std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f;
+                    row[x * 4 + c] = contrastTable[level];
+                }
+            }
+        }
+    });
+}
+
+void PostProcess::findTaps() {
+    // the same float loops as blur.frag, so rounding drops or adds the same rings and angles
+    taps.clear();
+    float twoPi = 6.28318530718f;
+    for (float theta = 0.0; theta < twoPi; theta += twoPi / blurAngles) {
+        for (float i = 1.0f / blurQuality; i <= 1.0f; i += 1.0f / blurQuality) {
+            taps.push_back(ofVec2f(cos(theta), sin(theta)) * blurRadius * i);
+        }
+    }
+    
+    blurVariance = 0.0;
+    for (const ofVec2f &tap : taps) {
+        blurVariance += tap.lengthSquared() * 0.5;
+    }
+    blurVariance /= std::max(int(taps.size()), 1);
+}
+
+// exact
+
+void PostProcess::blurExact(const vector<unsigned char> &pixels) {
+    blurred.resize(width * height * 3);
+    
+    // bilinear taps around the pixel center, clamped to the edge like the fbo texture
+    tbb::parallel_for( tbb::blocked_range<int>(0, height), [&](tbb::blocked_range<int> r) {
+        for (int y = r.begin(); y < r.end(); ++y) {
+            for (int x = 0; x < width; x++) {
+                float sum[3] = { 0.0, 0.0, 0.0 };
+                
+                for (const ofVec2f &tap : taps) {
+                    float sampleX = std::min(std::max(x + tap.x, 0.0f), width - 1.0f);
+                    float sampleY = std::min(std::max(y + tap.y, 0.0f), height - 1.0f);
+                    int x0 = sampleX;
+                    int y0 = sampleY;
+                    int x1 = std::min(x0 + 1, width - 1);
+                    int y1 = std::min(y0 + 1, height - 1);
+                    float fx = sampleX - x0;
+                    float fy = sampleY - y0;
+                    
+                    for (int c = 0; c < 3; c++) {
+                        float top = pixels[(y0 * width + x0) * 4 + c] * (1.0 - fx) + pixels[(y0 * width + x1) * 4 + c] * fx;
+                        float bottom = pixels[(y1 * width + x0) * 4 + c] * (1.0 - fx) + pixels[(y1 * width + x1) * 4 + c] * fx;
+                        sum[c] += top * (1.0 - fy) + bottom * fy;
+                    }
+                }
+                
+                float normalization = 1.0 / (255.0 * std::max(int(taps.size()), 1));
+                for (int c = 0; c < 3; c++) {
+                    blurred[(y * 3 + c) * width + x] = sum[c] * normalization;
+                }
+            }
+        }
+    });
+}
+
+// approximate
+
+void PostProcess::blurApproximate(const vector<unsigned char> &pixels) {
+    // downsample while the blur stays a few pixels wide at the lower resolution
+    float sigma = sqrt(blurVariance);
+    factor = ofClamp(int(sigma / 2.0), 1, 4);
+    lowWidth = (width + factor - 1) / factor;
+    lowHeight = (height + factor - 1) / factor;
+    float lowVariance = blurVariance / (factor * factor);
+    
+    for (int c = 0; c < 3; c++) {
+        planes[c].resize(lowWidth * lowHeight);
+    }
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, lowHeight), [&](tbb::blocked_range<int> r) {
+        for (int y = r.begin(); y < r.end(); ++y) {
+            for (int x = 0; x < lowWidth; x++) {
+                float sum[3] = { 0.0, 0.0, 0.0 };
+                int count = 0;
+                for (int sourceY = y * factor; sourceY < std::min((y + 1) * factor, height); sourceY++) {
+                    for (int sourceX = x * factor; sourceX < std::min((x + 1) * factor, width); sourceX++) {
+                        const unsigned char *pixel = pixels.data() + (sourceY * width + sourceX) * 4;
+                        sum[0] += pixel[0];
+                        sum[1] += pixel[1];
+                        sum[2] += pixel[2];
+                        count++;
+                    }
+                }
+                for (int c = 0; c < 3; c++) {
+                    planes[c][y * lowWidth + x] = sum[c] / (255.0 * count);
+                }
+            }
+        }
+    });
+    
+    // three boxes per axis, two widths mixed so their variances add up to the taps'
+    int passes = 3;
+    float idealWidth = sqrt(12.0 * lowVariance / passes + 1.0);
+    int lowerWidth = floor(idealWidth);
+    if (lowerWidth % 2 == 0) lowerWidth--;
+    lowerWidth = std::max(lowerWidth, 1);
+    int lowerPasses = round((12.0 * lowVariance - passes * lowerWidth * lowerWidth - 4 * passes * lowerWidth - 3 * passes) / (-4.0 * lowerWidth - 4.0));
+    lowerPasses = ofClamp(lowerPasses, 0, passes);
+    
+    for (int c = 0; c < 3; c++) {
+        for (int pass = 0; pass < passes; pass++) {
+            int boxWidth = pass < lowerPasses ? lowerWidth : lowerWidth + 2;
+            boxBlur(planes[c], lowWidth, lowHeight, boxWidth / 2);
+        }
+    }
+    
+    // where each full resolution column reads the low resolution rows
+    sampleColumns.resize(width);
+    sampleWeights.resize(width);
+    for (int x = 0; x < width; x++) {
+        float sampleX = std::min(std::max((x + 0.5f) / factor - 0.5f, 0.0f), lowWidth - 1.0f);
+        sampleColumns[x] = sampleX;
+        sampleWeights[x] = sampleX - sampleColumns[x];
+    }
+}
+
+void PostProcess::upsampleRow(int y, float *output) {
+    // low resolution samples sit at the centers of their blocks
+    float sampleY = std::min(std::max((y + 0.5f) / factor - 0.5f, 0.0f), lowHeight - 1.0f);
+    int y0 = sampleY;
+    int y1 = std::min(y0 + 1, lowHeight - 1);
+    float fy = sampleY - y0;
+    
+    for (int c = 0; c < 3; c++) {
+        const float *top = planes[c].data() + y0 * lowWidth;
+        const float *bottom = planes[c].data() + y1 * lowWidth;
+        float *channel = output + c * width;
+        
+        for (int x = 0; x < width; x++) {
+            int x0 = sampleColumns[x];
+            int x1 = std::min(x0 + 1, lowWidth - 1);
+            float fx = sampleWeights[x];
+            float upper = top[x0] + (top[x1] - top[x0]) * fx;
+            float lower = bottom[x0] + (bottom[x1] - bottom[x0]) * fx;
+            channel[x] = upper + (lower - upper) * fy;
+        }
+    }
+}
+
+void PostProcess::boxBlur(vector<float> &plane, int planeWidth, int planeHeight, int radius) {
+    if (radius <= 0) return;
+    float scale = 1.0 / (2 * radius + 1);
+    scratch.resize(plane.size());
+    
+    // horizontal, a running sum per row with the edge pixels repeated
+    tbb::parallel_for( tbb::blocked_range<int>(0, planeHeight), [&](tbb::blocked_range<int> r) {
+        for (int y = r.begin(); y < r.end(); ++y) {
+            const float *row = plane.data() + y * planeWidth;
+            float *output = scratch.data() + y * planeWidth;
+            
+            float sum = 0.0;
+            for (int k = -radius; k <= radius; k++) {
+                sum += row[std::min(std::max(k, 0), planeWidth - 1)];
+            }
+            for (int x = 0; x < planeWidth; x++) {
+                output[x] = sum * scale;
+                sum += row[std::min(x + radius + 1, planeWidth - 1)] - row[std::max(x - radius, 0)];
+            }
+        }
+    });
+    
+    // vertical, running sums for a strip of columns move down the rows together so the inner loop vectorizes
+    int stripWidth = 256;
+    int numStrips = (planeWidth + stripWidth - 1) / stripWidth;
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, numStrips), [&](tbb::blocked_range<int> r) {
+        vector<float> sums(stripWidth);
+        for (int s = r.begin(); s < r.end(); ++s) {
+            int startX = s * stripWidth;
+            int columns = std::min(stripWidth, planeWidth - startX);
+            
+            std::fill(sums.begin(), sums.end(), 0.0f);
+            for (int k = -radius; k <= radius; k++) {
+                const float *row = scratch.data() + std::min(std::max(k, 0), planeHeight - 1) * planeWidth + startX;
+                for (int x = 0; x < columns; x++) {
+                    sums[x] += row[x];
+                }
+            }
+            
+            for (int y = 0; y < planeHeight; y++) {
+                float *output = plane.data() + y * planeWidth + startX;
+                const float *entering = scratch.data() + std::min(y + radius + 1, planeHeight - 1) * planeWidth + startX;
+                const float *leaving = scratch.data() + std::max(y - radius, 0) * planeWidth + startX;
+                for (int x = 0; x < columns; x++) {
+                    output[x] = sums[x] * scale;
+                    sums[x] += entering[x] - leaving[x];
+                }
+            }
+        }
+    });
+}
+
+// reference check
+
+static Boolean loadReference(string path, vector<unsigned char> &pixels, int &width, int &height) {
+    ofPixels image;
+    if (!ofLoadImage(image, path)) return false;
+    image.setImageType(OF_IMAGE_COLOR_ALPHA);
+    
+    width = image.getWidth();
+    height = image.getHeight();
+    pixels.assign(image.getData(), image.getData() + size_t(width) * height * 4);
+    return true;
+}
+
+Boolean PostProcess::verifyReferences(string directory) {
+    // the first entry is the input, every other line is a file and the blur mix, quality, angles, radius and contrast
+    ifstream list(directory + "/references.txt");
+    if (!list) return false;
+    
+    vector<unsigned char> input;
+    int width = 0;
+    int height = 0;
+    string line;
+    
+    while (getline(list, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        
+        istringstream fields(line);
+        string filename;
+        fields >> filename;
+        
+        if (input.empty()) {
+            if (!loadReference(directory + "/" + filename, input, width, height)) return false;
+            continue;
+        }
+        
+        float mix, quality, angles, radius, contrast;
+        if (!(fields >> mix >> quality >> angles >> radius >> contrast)) return false;
+        
+        vector<unsigned char> reference;
+        int referenceWidth, referenceHeight;
+        if (!loadReference(directory + "/" + filename, reference, referenceWidth, referenceHeight)) return false;
+        if (referenceWidth != width || referenceHeight != height) return false;
+        
+        PostProcess postProcess;
+        postProcess.setBlurMix(mix);
+        postProcess.setBlurQuality(quality);
+        postProcess.setBlurAngles(angles);
+        postProcess.setBlurRadius(radius);
+        postProcess.setContrastAmount(contrast);
+        
+        std::stringstream strm;
+        strm << filename << " mix " << mix << " quality " << quality << " angles " << angles << " radius " << radius << " contrast " << contrast;
+        
+        for (int exact = 1; exact >= 0; exact--) {
+            vector<unsigned char> pixels = input;
+            postProcess.setExact(exact);
+            postProcess.process(pixels, width, height);
+            
+            // levels off in the color channels, alpha is passed through
+            double sum = 0.0;
+            int largest = 0;
+            for (size_t i = 0; i < pixels.size(); i++) {
+                if (i % 4 == 3) continue;
+                int difference = abs(int(pixels[i]) - int(reference[i]));
+                sum += difference;
+                largest = std::max(largest, difference);
+            }
+            strm << (exact ? ", exact" : ", approximate") << " mean " << sum / (pixels.size() / 4 * 3) << " max " << largest;
+        }
+        
+        ofLogNotice("PostProcess") << strm.str();
+    }
+    
+    return !input.empty();
+}
@@ -0,0 +1,61 @@
+//
+//  PostProcess.hpp
+//  fluidSimulation
+//
+
+#ifndef PostProcess_hpp
+#define PostProcess_hpp
+
+#include <stdio.h>
+#include "ofMain.h"
+#include "Platform.hpp"
+
+// the blur and contrast shaders of the gpu path run on rgba pixels, for frames rendered without a gpu.
+// the blur's ring of taps is approximated by a gaussian of the same spread, made of three box passes
+// per axis on a downsampled copy, so the cost does not grow with the radius. the exact mode
+// takes every tap of the shader and is kept for offline frames and for checking the approximation
+class PostProcess {
+public:
+    PostProcess();
+
+    void setBlurMix(float blurMix);
+    void setBlurQuality(float blurQuality);
+    void setBlurAngles(float blurAngles);
+    void setBlurRadius(float blurRadius);
+    void setContrastAmount(float contrastAmount);
+    void setExact(Boolean exactActive);
+
+    // blur then contrast in place, rounding to 8 bits between them like the fbos. alpha is kept
+    void process(vector<unsigned char> &pixels, int width, int height);
+
+    // runs the input frame listed in directory/references.txt through both modes with each listed setting,
+    // and logs the mean and largest level difference against the shader output stored for it.
+    // false when a file is missing or unreadable
+    static Boolean verifyReferences(string directory);
+
+private:
+    void findTaps();
+    void blurExact(const vector<unsigned char> &pixels);
+    void blurApproximate(const vector<unsigned char> &pixels);
+    void upsampleRow(int y, float *output);
+    void boxBlur(vector<float> &plane, int width, int height, int radius);
+
+    float blurMix, blurQuality, blurAngles, blurRadius, contrastAmount;
+    Boolean exactActive;
+    int width, height;
+
+    // tap offsets as the shader's float loops produce them
+    vector<ofVec2f> taps;
+    float blurVariance;
+
+    // exact mode keeps the blurred mean of the taps per row and channel, the approximation keeps
+    // downsampled planes and interpolates a row at a time while writing the pixels
+    vector<float> blurred;
+    int factor, lowWidth, lowHeight;
+    vector<float> planes[3];
+    vector<float> scratch;
+    vector<int> sampleColumns;
+    vector<float> sampleWeights;
+};
+
+#endif /* PostProcess_hpp */
@@ -0,0 +1,20 @@
+//
+//  Random.cpp
+//  fluidSimulation
+//
+
+#include "Random.hpp"
+
+Random::Random() {
+    setSeed(0);
+}
+
+void Random::setSeed(uint64_t _seed) {
+    seed = _seed;
+    key0 = uint32_t(seed);
+    key1 = uint32_t(seed >> 32);
+}
+
+uint64_t Random::getSeed() const {
+    return seed;
+}
@@ -0,0 +1,83 @@
+//
+//  Random.hpp
+//  fluidSimulation
+//
+
+#ifndef Random_hpp
+#define Random_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+
+// counter based generator (philox 4x32-10), the same seed and counter always give
+// the same numbers, so it can be called from any thread without shared state
+class Random {
+public:
+    Random();
+    
+    void setSeed(uint64_t seed);
+    uint64_t getSeed() const;
+    
+    inline void generate(uint32_t stream, uint32_t a, uint32_t b, uint32_t c, uint32_t out[4]) const;
+    inline void uniform4(uint32_t stream, uint32_t a, uint32_t b, uint32_t c, float out[4]) const;
+    inline float uniform(uint32_t stream, uint32_t a, uint32_t b, uint32_t c) const;
+    
+private:
+    uint64_t seed;
+    uint32_t key0, key1;
+};
+
+inline void Random::generate(uint32_t stream, uint32_t a, uint32_t b, uint32_t c, uint32_t out[4]) const {
+    const uint32_t multiplier0 = 0xD2511F53;
+    const uint32_t multiplier1 = 0xCD9E8D57;
+    const uint32_t weyl0 = 0x9E3779B9;
+    const uint32_t weyl1 = 0xBB67AE85;
+    
+    uint32_t counter0 = a;
+    uint32_t counter1 = b;
+    uint32_t counter2 = c;
+    uint32_t counter3 = stream;
+    uint32_t k0 = key0;
+    uint32_t k1 = key1;
+    
+    for (int round = 0; round < 10; round++) {
+        uint64_t product0 = uint64_t(multiplier0) * counter0;
+        uint64_t product1 = uint64_t(multiplier1) * counter2;
+        
+        uint32_t next0 = uint32_t(product1 >> 32) ^ counter1 ^ k0;
+        uint32_t next1 = uint32_t(product1);
+        uint32_t next2 = uint32_t(product0 >> 32) ^ counter3 ^ k1;
+        uint32_t next3 = uint32_t(product0);
+        
+        counter0 = next0;
+        counter1 = next1;
+        counter2 = next2;
+        counter3 = next3;
+        
+        k0 += weyl0;
+        k1 += weyl1;
+    }
+    
+    out[0] = counter0;
+    out[1] = counter1;
+    out[2] = counter2;
+    out[3] = counter3;
+}
+
+inline void Random::uniform4(uint32_t stream, uint32_t a, uint32_t b, uint32_t c, float out[4]) const {
+    uint32_t bits[4];
+    generate(stream, a, b, c, bits);
+    
+    // top 24 bits give every float in [0, 1) the same spacing
+    for (int i = 0; i < 4; i++) {
+        out[i] = (bits[i] >> 8) * (1.0f / 16777216.0f);
+    }
+}
+
+inline float Random::uniform(uint32_t stream, uint32_t a, uint32_t b, uint32_t c) const {
+    uint32_t bits[4];
+    generate(stream, a, b, c, bits);
+    return (bits[0] >> 8) * (1.0f / 16777216.0f);
+}
+
+#endif /* Random_hpp */
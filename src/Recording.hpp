@@ -0,0 +1,91 @@
+//
+//  Recording.hpp
+//  fluidSimulation
+//
+
+#ifndef Recording_hpp
+#define Recording_hpp
+
+#include <stdint.h>
+#include <vector>
+
+// frame recording layout. a file header, then one chunk per frame appended as the run goes,
+// then an index of chunk offsets and a footer once recording stops. a file cut short still
+// reads, the reader falls back to walking the chunks when the footer is missing
+#define RECORDING_MAGIC "FLUIDREC"
+#define RECORDING_VERSION 1
+#define RECORDING_CHUNK_MAGIC 0x4d524846
+#define RECORDING_FOOTER_MAGIC 0x58444946
+
+// channels are stored one after another, x positions for every particle then y positions and so on
+#define RECORDING_CHANNELS 5
+
+enum recordingEncodings {
+    RECORDING_RAW,
+    RECORDING_QUANTIZED,
+    RECORDING_DELTA
+};
+
+struct RecordingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t chunkHeaderSize;
+    uint32_t keyframeInterval;
+};
+
+// quantized chunks map every channel onto 16 bits between a minimum and an extent.
+// delta chunks reuse the ranges of the keyframe before them
+struct RecordingChunkHeader {
+    uint32_t magic;
+    uint32_t frameIndex;
+    uint32_t particleCount;
+    uint32_t encoding;
+    uint64_t payloadSize;
+    float minimum[RECORDING_CHANNELS];
+    float extent[RECORDING_CHANNELS];
+};
+
+struct RecordingFooter {
+    uint64_t indexOffset;
+    uint32_t frameCount;
+    uint32_t magic;
+};
+
+static_assert(sizeof(RecordingHeader) == 24, "recording header layout changed");
+static_assert(sizeof(RecordingChunkHeader) == 64, "recording chunk layout changed");
+static_assert(sizeof(RecordingFooter) == 16, "recording footer layout changed");
+
+inline uint16_t quantizeChannel(float value, float minimum, float extent) {
+    float normalized = extent > 0.0f ? (value - minimum) / extent : 0.0f;
+    normalized = normalized < 0.0f ? 0.0f : (normalized > 1.0f ? 1.0f : normalized);
+    return uint16_t(normalized * 65535.0f + 0.5f);
+}
+
+inline float dequantizeChannel(uint16_t value, float minimum, float extent) {
+    return minimum + value * (extent / 65535.0f);
+}
+
+// deltas between frames are small, zigzag varints store most of them in a byte or two
+inline void writeDelta(std::vector<unsigned char> &buffer, int32_t delta) {
+    uint32_t zigzag = (uint32_t(delta) << 1) ^ uint32_t(delta >> 31);
+    while (zigzag >= 0x80) {
+        buffer.push_back(uint8_t(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    buffer.push_back(uint8_t(zigzag));
+}
+
+inline int32_t readDelta(const unsigned char *&cursor, const unsigned char *end) {
+    uint32_t zigzag = 0;
+    int shift = 0;
+    while (cursor < end && shift < 35) {
+        uint8_t byte = *cursor++;
+        zigzag |= uint32_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+        shift += 7;
+    }
+    return int32_t(zigzag >> 1) ^ -int32_t(zigzag & 1);
+}
+
+#endif /* Recording_hpp */
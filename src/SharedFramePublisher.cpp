@@ -0,0 +1,154 @@
+//
+//  SharedFramePublisher.cpp
+//  fluidSimulation
+//
+
+#include "SharedFramePublisher.hpp"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+SharedFramePublisher::SharedFramePublisher() {
+    segment = nullptr;
+    segmentSize = 0;
+    header = nullptr;
+    publishedCount = 0;
+}
+
+SharedFramePublisher::~SharedFramePublisher() {
+    stop();
+}
+
+Boolean SharedFramePublisher::start(string _name, int particleCapacity, int frameWidth, int frameHeight, int slotCount) {
+    stop();
+    
+    name = _name;
+    particleCapacity = std::max(particleCapacity, 0);
+    frameWidth = std::max(frameWidth, 0);
+    frameHeight = std::max(frameHeight, 0);
+    slotCount = std::max(slotCount, 2);
+    
+    // slots and the data inside them start on cache lines, frames on pages
+    size_t headerSize = (sizeof(SharedFramesHeader) + 63) & ~size_t(63);
+    size_t particlesOffset = (sizeof(SharedFramesSlot) + 63) & ~size_t(63);
+    size_t frameOffset = (particlesOffset + size_t(particleCapacity) * sizeof(SharedFramesParticle) + 4095) & ~size_t(4095);
+    size_t slotSize = (frameOffset + size_t(frameWidth) * frameHeight * 4 + 4095) & ~size_t(4095);
+    segmentSize = headerSize + slotCount * slotSize;
+    
+    // a segment left behind by a crashed run is replaced, readers still holding it keep their mapping
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        ofLogError("SharedFramePublisher") << "could not create shared memory " << name;
+        return false;
+    }
+    
+    if (ftruncate(fd, segmentSize) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    
+    void *mapping = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+    
+    // fresh shared memory is zero filled, so every slot starts with no publish in it
+    segment = static_cast<unsigned char *>(mapping);
+    header = reinterpret_cast<SharedFramesHeader *>(segment);
+    header->version = SHARED_FRAMES_VERSION;
+    header->headerSize = headerSize;
+    header->slotCount = slotCount;
+    header->slotSize = slotSize;
+    header->segmentSize = segmentSize;
+    header->particlesOffset = particlesOffset;
+    header->frameOffset = frameOffset;
+    header->particleCapacity = particleCapacity;
+    header->particleSize = sizeof(SharedFramesParticle);
+    header->frameWidth = frameWidth;
+    header->frameHeight = frameHeight;
+    header->writerActive = 1;
+    publishedCount = 0;
+    
+    // the magic goes last, a reader seeing it sees the rest of the header
+    __atomic_store_n(&header->magic, uint32_t(SHARED_FRAMES_MAGIC), __ATOMIC_RELEASE);
+    
+    return true;
+}
+
+void SharedFramePublisher::stop() {
+    if (segment == nullptr) return;
+    
+    __atomic_store_n(&header->writerActive, uint32_t(0), __ATOMIC_RELEASE);
+    munmap(segment, segmentSize);
+    shm_unlink(name.c_str());
+    
+    segment = nullptr;
+    header = nullptr;
+    segmentSize = 0;
+}
+
+Boolean SharedFramePublisher::isRunning() {
+    return segment != nullptr;
+}
+
+uint64_t SharedFramePublisher::getPublishedCount() {
+    return publishedCount;
+}
+
+unsigned char * SharedFramePublisher::getSlot(uint64_t publish) {
+    return segment + header->headerSize + (publish % header->slotCount) * header->slotSize;
+}
+
+// publish
+
+void SharedFramePublisher::publish(ParticleSystem &particleSystem, const unsigned char *framePixels) {
+    if (segment == nullptr) return;
+    
+    uint64_t publish = publishedCount;
+    unsigned char *slotData = getSlot(publish);
+    SharedFramesSlot *slot = reinterpret_cast<SharedFramesSlot *>(slotData);
+    
+    // odd while the slot is written, readers that started on it will see the change
+    __atomic_store_n(&slot->sequence, publish * 2 + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    
+    SharedFramesParticle *output = reinterpret_cast<SharedFramesParticle *>(slotData + header->particlesOffset);
+    int capacity = header->particleCapacity;
+    int count = 0;
+    
+    for (int i = 0; i < particleSystem.particles.size() && count < capacity; i++) {
+        if (!particleSystem.aliveFlags[i]) continue;
+        const Particle &particle = particleSystem.particles[i];
+        SharedFramesParticle &shared = output[count++];
+        
+        shared.position[0] = particle.position.x;
+        shared.position[1] = particle.position.y;
+        shared.position[2] = particle.position.z;
+        shared.velocity[0] = particle.velocity.x;
+        shared.velocity[1] = particle.velocity.y;
+        shared.velocity[2] = particle.velocity.z;
+        shared.density = particle.density;
+        shared.size = particle.size;
+        shared.color = sharedFramesPackColor(particle.particleColor.r, particle.particleColor.g, particle.particleColor.b, particle.particleColor.a);
+        shared.index = i;
+    }
+    
+    Boolean hasFrame = framePixels != nullptr && header->frameWidth > 0 && header->frameHeight > 0;
+    if (hasFrame) {
+        memcpy(slotData + header->frameOffset, framePixels, size_t(header->frameWidth) * header->frameHeight * 4);
+    }
+    
+    slot->step = particleSystem.stepCount;
+    slot->timeMicros = ofGetElapsedTimeMicros();
+    slot->particleCount = count;
+    slot->hasFrame = hasFrame;
+    
+    __atomic_store_n(&slot->sequence, publish * 2 + 2, __ATOMIC_RELEASE);
+    publishedCount = publish + 1;
+    __atomic_store_n(&header->publishedCount, publishedCount, __ATOMIC_RELEASE);
+}
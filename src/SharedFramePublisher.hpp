@@ -0,0 +1,40 @@
+//
+//  SharedFramePublisher.hpp
+//  fluidSimulation
+//
+
+#ifndef SharedFramePublisher_hpp
+#define SharedFramePublisher_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ParticleSystem.hpp"
+#include "SharedFrames.h"
+
+// publishes every step's particles, and frames when there are any, into named shared memory for
+// local consumers on machines without syphon. the data goes straight into a ring slot and readers
+// use it in place, see SharedFrames.h for the layout and reader/ for the c library that reads it
+class SharedFramePublisher {
+public:
+    SharedFramePublisher();
+    ~SharedFramePublisher();
+
+    // particles past the capacity are left out, frames must be frameWidth by frameHeight rgba
+    Boolean start(string name, int particleCapacity, int frameWidth, int frameHeight, int slotCount);
+    void stop();
+    Boolean isRunning();
+
+    void publish(ParticleSystem &particleSystem, const unsigned char *framePixels);
+    uint64_t getPublishedCount();
+
+private:
+    unsigned char * getSlot(uint64_t publish);
+
+    string name;
+    unsigned char *segment;
+    size_t segmentSize;
+    SharedFramesHeader *header;
+    uint64_t publishedCount;
+};
+
+#endif /* SharedFramePublisher_hpp */
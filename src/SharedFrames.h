@@ -0,0 +1,74 @@
+//
+//  SharedFrames.h
+//  fluidSimulation
+//
+
+#ifndef SharedFrames_h
+#define SharedFrames_h
+
+#include <stdint.h>
+
+// layout of the shared memory the simulation publishes into, plain c so the reader in reader/ shares it.
+// a header, then a ring of slots. each slot holds one step, its particles and optionally an rgba frame.
+// the writer fills slot n % slotCount: its sequence goes odd, the data is written, the sequence goes
+// to 2n + 2, and then publishedCount to n + 1. a reader takes the slot of the newest publish, reads it
+// in place, and trusts what it read only if the sequence has not changed in the meantime
+#define SHARED_FRAMES_NAME "/fluidSimulation"
+#define SHARED_FRAMES_MAGIC 0x53464c46
+#define SHARED_FRAMES_VERSION 1
+
+struct SharedFramesHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t slotCount;
+    uint64_t slotSize;
+    uint64_t segmentSize;
+
+    // offsets inside a slot, the frame is tightly packed rgba rows from the top
+    uint64_t particlesOffset;
+    uint64_t frameOffset;
+    uint32_t particleCapacity;
+    uint32_t particleSize;
+    uint32_t frameWidth;
+    uint32_t frameHeight;
+
+    // written with release stores and read with acquire loads
+    uint64_t publishedCount;
+    uint32_t writerActive;
+    uint32_t padding;
+};
+
+struct SharedFramesSlot {
+    uint64_t sequence;
+    uint64_t step;
+    uint64_t timeMicros;
+    uint32_t particleCount;
+    uint32_t hasFrame;
+};
+
+// index is the particle's pool slot, stable for as long as the particle lives
+struct SharedFramesParticle {
+    float position[3];
+    float velocity[3];
+    float density;
+    float size;
+    uint32_t color;
+    uint32_t index;
+};
+
+#ifdef __cplusplus
+static_assert(sizeof(SharedFramesHeader) == 80, "shared frames header layout changed");
+static_assert(sizeof(SharedFramesSlot) == 32, "shared frames slot layout changed");
+static_assert(sizeof(SharedFramesParticle) == 40, "shared frames particle layout changed");
+#endif
+
+// colors are packed as r, g, b, a bytes in memory order
+static inline uint32_t sharedFramesPackColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    uint8_t bytes[4] = { r, g, b, a };
+    uint32_t color;
+    __builtin_memcpy(&color, bytes, 4);
+    return color;
+}
+
+#endif /* SharedFrames_h */
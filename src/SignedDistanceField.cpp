@@ -0,0 +1,228 @@
+//
+//  SignedDistanceField.cpp
+//  fluidSimulation
+//
+
+#include "SignedDistanceField.hpp"
+
+SignedDistanceField::SignedDistanceField() {
+    width = 0;
+    height = 0;
+    sampledGrid = nullptr;
+    buildActive = false;
+}
+
+SignedDistanceField::~SignedDistanceField() {
+    if (builder.joinable()) {
+        builder.join();
+    }
+}
+
+void SignedDistanceField::setup(int _width, int _height, ofVec2f _origin, ofVec2f _size) {
+    if (builder.joinable()) {
+        builder.join();
+    }
+    
+    int newWidth = std::max(2, _width);
+    int newHeight = std::max(2, _height);
+    Boolean resized = newWidth != width || newHeight != height;
+    
+    width = newWidth;
+    height = newHeight;
+    origin = _origin;
+    size = _size;
+    cellSize = ofVec2f(size.x / width, size.y / height);
+    inverseCellSize = ofVec2f(1.0 / cellSize.x, 1.0 / cellSize.y);
+    
+    // the old shape stays in use while the new one builds, unless it no longer fits the grid
+    if (resized) {
+        std::lock_guard<std::mutex> lock(gridMutex);
+        latestGrid.reset();
+    }
+}
+
+void SignedDistanceField::buildFromPolygons(const vector<vector<ofVec2f>> &polygons) {
+    startBuild([this, polygons](vector<unsigned char> &mask) {
+        // even odd scanlines through the cell centers, holes in letters come out right
+        vector<float> crossings;
+        for (int j = 0; j < height; j++) {
+            float y = origin.y + (j + 0.5) * cellSize.y;
+            crossings.clear();
+            
+            for (const vector<ofVec2f> &polygon : polygons) {
+                int numPoints = polygon.size();
+                for (int k = 0; k < numPoints; k++) {
+                    ofVec2f a = polygon[k];
+                    ofVec2f b = polygon[(k + 1) % numPoints];
+                    if ((a.y <= y) == (b.y <= y)) continue;
+                    crossings.push_back(a.x + (y - a.y) / (b.y - a.y) * (b.x - a.x));
+                }
+            }
+            
+            std::sort(crossings.begin(), crossings.end());
+            for (int k = 0; k + 1 < crossings.size(); k += 2) {
+                int start = std::max(0, int(ceil((crossings[k] - origin.x) * inverseCellSize.x - 0.5)));
+                int end = std::min(width - 1, int(floor((crossings[k + 1] - origin.x) * inverseCellSize.x - 0.5)));
+                for (int i = start; i <= end; i++) {
+                    mask[j * width + i] = 1;
+                }
+            }
+        }
+    });
+}
+
+void SignedDistanceField::buildFromMask(const ofPixels &pixels, float threshold) {
+    // bright pixels hold fluid, the image is stretched over the field
+    ofPixels maskPixels = pixels;
+    startBuild([this, maskPixels, threshold](vector<unsigned char> &mask) {
+        int pixelWidth = maskPixels.getWidth();
+        int pixelHeight = maskPixels.getHeight();
+        int channels = maskPixels.getNumChannels();
+        const unsigned char *data = maskPixels.getData();
+        if (pixelWidth == 0 || pixelHeight == 0 || data == nullptr) return;
+        
+        for (int j = 0; j < height; j++) {
+            int pixelY = std::min(pixelHeight - 1, int((j + 0.5) / height * pixelHeight));
+            for (int i = 0; i < width; i++) {
+                int pixelX = std::min(pixelWidth - 1, int((i + 0.5) / width * pixelWidth));
+                const unsigned char *pixel = data + (size_t(pixelY) * pixelWidth + pixelX) * channels;
+                
+                float brightness = 0.0;
+                for (int c = 0; c < std::min(channels, 3); c++) {
+                    brightness += pixel[c];
+                }
+                brightness /= std::min(channels, 3) * 255.0;
+                
+                mask[j * width + i] = brightness > threshold;
+            }
+        }
+    });
+}
+
+Boolean SignedDistanceField::isBuilding() {
+    return buildActive;
+}
+
+void SignedDistanceField::acquire() {
+    std::lock_guard<std::mutex> lock(gridMutex);
+    currentGrid = latestGrid;
+    sampledGrid = currentGrid.get();
+}
+
+void SignedDistanceField::startBuild(std::function<void(vector<unsigned char> &mask)> rasterize) {
+    // a newer shape waits for the running build, the last one submitted ends up in use
+    if (builder.joinable()) {
+        builder.join();
+    }
+    
+    buildActive = true;
+    builder = std::thread([this, rasterize]() {
+        vector<unsigned char> mask(width * height, 0);
+        rasterize(mask);
+        build(mask);
+        buildActive = false;
+    });
+}
+
+void SignedDistanceField::build(vector<unsigned char> &mask) {
+    int numCells = width * height;
+    float infinity = 1e20;
+    
+    // squared distance from every cell to the nearest fluid cell, and to the nearest solid cell
+    vector<float> toFluid(numCells), toSolid(numCells);
+    for (int i = 0; i < numCells; i++) {
+        toFluid[i] = mask[i] ? 0.0 : infinity;
+        toSolid[i] = mask[i] ? infinity : 0.0;
+    }
+    transformRows(toFluid, width, height);
+    transformRows(toSolid, width, height);
+    
+    auto grid = std::make_shared<Grid>();
+    grid->width = width;
+    grid->height = height;
+    grid->distance.resize(numCells);
+    grid->gradientX.resize(numCells);
+    grid->gradientY.resize(numCells);
+    
+    // the surface sits half a cell between a fluid center and a solid center
+    float cellLength = (cellSize.x + cellSize.y) * 0.5;
+    for (int i = 0; i < numCells; i++) {
+        if (mask[i]) {
+            grid->distance[i] = -(sqrt(toSolid[i]) - 0.5) * cellLength;
+        } else {
+            grid->distance[i] = (sqrt(toFluid[i]) - 0.5) * cellLength;
+        }
+    }
+    
+    // an empty or full mask has no surface, keep the distances bounded
+    float bound = float(width + height) * cellLength;
+    for (int i = 0; i < numCells; i++) {
+        grid->distance[i] = ofClamp(grid->distance[i], -bound, bound);
+    }
+    
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            int left = j * width + std::max(0, i - 1);
+            int right = j * width + std::min(width - 1, i + 1);
+            int up = std::max(0, j - 1) * width + i;
+            int down = std::min(height - 1, j + 1) * width + i;
+            
+            ofVec2f gradient = ofVec2f((grid->distance[right] - grid->distance[left]) / cellSize.x,
+                                       (grid->distance[down] - grid->distance[up]) / cellSize.y);
+            float length = gradient.length();
+            gradient = length > 0.0 ? gradient / length : ofVec2f::zero();
+            
+            grid->gradientX[j * width + i] = gradient.x;
+            grid->gradientY[j * width + i] = gradient.y;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(gridMutex);
+    latestGrid = grid;
+}
+
+// exact squared euclidean distance transform, one pass down the columns and one along the rows
+// (felzenszwalb and huttenlocher, lower envelope of parabolas)
+void SignedDistanceField::transformRows(vector<float> &squareDistance, int width, int height) {
+    int longest = std::max(width, height);
+    vector<float> values(longest), output(longest), boundaries(longest + 1);
+    vector<int> vertices(longest);
+    
+    auto transform = [&](int count) {
+        int k = 0;
+        vertices[0] = 0;
+        boundaries[0] = -1e20;
+        boundaries[1] = 1e20;
+        
+        for (int q = 1; q < count; q++) {
+            float s = ((values[q] + q * q) - (values[vertices[k]] + vertices[k] * vertices[k])) / (2.0 * q - 2.0 * vertices[k]);
+            while (s <= boundaries[k]) {
+                k--;
+                s = ((values[q] + q * q) - (values[vertices[k]] + vertices[k] * vertices[k])) / (2.0 * q - 2.0 * vertices[k]);
+            }
+            k++;
+            vertices[k] = q;
+            boundaries[k] = s;
+            boundaries[k + 1] = 1e20;
+        }
+        
+        k = 0;
+        for (int q = 0; q < count; q++) {
+            while (boundaries[k + 1] < q) k++;
+            float offset = q - vertices[k];
+            output[q] = offset * offset + values[vertices[k]];
+        }
+    };
+    
+    for (int i = 0; i < width; i++) {
+        for (int j = 0; j < height; j++) values[j] = squareDistance[j * width + i];
+        transform(height);
+        for (int j = 0; j < height; j++) squareDistance[j * width + i] = output[j];
+    }
+    
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) values[i] = squareDistance[j * width + i];
+        transform(width);
+        for (int i = 0; i < width; i++) squareDistance[j * width + i] = output[i];
+    }
+}
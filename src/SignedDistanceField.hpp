@@ -0,0 +1,85 @@
+//
+//  SignedDistanceField.hpp
+//  fluidSimulation
+//
+
+#ifndef SignedDistanceField_hpp
+#define SignedDistanceField_hpp
+
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include "ofMain.h"
+#include "Platform.hpp"
+
+// container shape baked into a grid of distances, negative where the fluid may go.
+// shapes are rasterized and transformed on a worker, the finished grid is swapped in
+// and held by the simulation for a whole step, like the force field layers
+class SignedDistanceField {
+public:
+    SignedDistanceField();
+    ~SignedDistanceField();
+    
+    void setup(int width, int height, ofVec2f origin, ofVec2f size);
+    void buildFromPolygons(const vector<vector<ofVec2f>> &polygons);
+    void buildFromMask(const ofPixels &pixels, float threshold);
+    Boolean isBuilding();
+    
+    void acquire();
+    inline Boolean isReady() const;
+    inline float sample(ofVec2f position, ofVec2f &gradient) const;
+    
+private:
+    struct Grid {
+        int width, height;
+        vector<float> distance, gradientX, gradientY;
+    };
+    
+    void startBuild(std::function<void(vector<unsigned char> &mask)> rasterize);
+    void build(vector<unsigned char> &mask);
+    void transformRows(vector<float> &squareDistance, int width, int height);
+    
+    int width, height;
+    ofVec2f origin, size, cellSize, inverseCellSize;
+    
+    std::mutex gridMutex;
+    std::shared_ptr<Grid> latestGrid, currentGrid;
+    const Grid *sampledGrid;
+    
+    std::thread builder;
+    std::atomic<bool> buildActive;
+};
+
+inline Boolean SignedDistanceField::isReady() const {
+    return sampledGrid != nullptr;
+}
+
+inline float SignedDistanceField::sample(ofVec2f position, ofVec2f &gradient) const {
+    const Grid &grid = *sampledGrid;
+    
+    float gridX = ofClamp((position.x - origin.x) * inverseCellSize.x - 0.5f, 0.0f, grid.width - 1.0f);
+    float gridY = ofClamp((position.y - origin.y) * inverseCellSize.y - 0.5f, 0.0f, grid.height - 1.0f);
+    int cellX = int(gridX);
+    int cellY = int(gridY);
+    float fractionX = gridX - cellX;
+    float fractionY = gridY - cellY;
+    
+    int index00 = cellY * grid.width + cellX;
+    int index01 = index00 + std::min(1, grid.width - 1 - cellX);
+    int index10 = index00 + (cellY < grid.height - 1 ? grid.width : 0);
+    int index11 = index10 + (index01 - index00);
+    
+    float weight00 = (1.0f - fractionX) * (1.0f - fractionY);
+    float weight01 = fractionX * (1.0f - fractionY);
+    float weight10 = (1.0f - fractionX) * fractionY;
+    float weight11 = fractionX * fractionY;
+    
+    gradient.x = grid.gradientX[index00] * weight00 + grid.gradientX[index01] * weight01 + grid.gradientX[index10] * weight10 + grid.gradientX[index11] * weight11;
+    gradient.y = grid.gradientY[index00] * weight00 + grid.gradientY[index01] * weight01 + grid.gradientY[index10] * weight10 + grid.gradientY[index11] * weight11;
+    
+    return grid.distance[index00] * weight00 + grid.distance[index01] * weight01 + grid.distance[index10] * weight10 + grid.distance[index11] * weight11;
+}
+
+#endif /* SignedDistanceField_hpp */
@@ -0,0 +1,127 @@
+//
+//  SparseBlockGrid3D.cpp
+//  fluidSimulation
+//
+
+#include "SparseBlockGrid3D.hpp"
+#include "tbb/parallel_for.h"
+#include "tbb/parallel_sort.h"
+
+SparseBlockGrid3D::SparseBlockGrid3D() {
+    buildStamp = 0;
+}
+
+void SparseBlockGrid3D::build(const vector<Particle> &particles, const vector<char> &aliveFlags, float cellSize) {
+    int numParticles = particles.size();
+    entries.resize(numParticles);
+    particleBlocks.assign(numParticles, -1);
+    particleCells.resize(numParticles);
+    
+    // the morton code of a cell is the code of its block followed by 9 bits for the cell inside it,
+    // so one sort orders the particles by block and then cell. dead particles sort to the back
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            if (!aliveFlags[i]) {
+                entries[i] = pair<uint64_t, int> (UINT64_MAX, i);
+                continue;
+            }
+            
+            uint64_t key = CompactHash3D::getMortonKey(CompactHash3D::positionToCell(particles[i].position, cellSize));
+            particleCells[i] = key & (BLOCK_CELLS - 1);
+            entries[i] = pair<uint64_t, int> (key, i);
+        }
+    });
+    
+    tbb::parallel_sort(entries.begin(), entries.end());
+    
+    int numEntries = numParticles;
+    while (numEntries > 0 && entries[numEntries - 1].first == UINT64_MAX) {
+        numEntries--;
+    }
+    sortedIndices.resize(numEntries);
+    
+    // blocks are looked up once per run, a run that has no block yet takes one from the pool
+    buildStamp++;
+    vector<int> runBlocks;
+    vector<int> runStarts;
+    
+    for (int e = 0; e < numEntries; e++) {
+        sortedIndices[e] = entries[e].second;
+        
+        uint64_t key = entries[e].first >> 9;
+        if (e > 0 && key == entries[e - 1].first >> 9) continue;
+        
+        int block = table.find(key);
+        if (block == -1) {
+            block = allocateBlock();
+            CompactHash3D::Cell cell = CompactHash3D::positionToCell(particles[entries[e].second].position, cellSize);
+            blocks[block].coordinate = { cell.x >> 3, cell.y >> 3, cell.z >> 3 };
+            blocks[block].key = key;
+        }
+        blocks[block].stamp = buildStamp;
+        runBlocks.push_back(block);
+        runStarts.push_back(e);
+    }
+    runStarts.push_back(numEntries);
+    
+    // blocks no particle landed in go back to the pool
+    for (int block : activeBlocks) {
+        if (blocks[block].stamp != buildStamp) {
+            freeBlocks.push_back(block);
+        }
+    }
+    activeBlocks = runBlocks;
+    table.reset(activeBlocks.size());
+    for (int block : activeBlocks) {
+        table.insert(blocks[block].key, block);
+    }
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, activeBlocks.size()), [&](tbb::blocked_range<int> r) {
+        for (int a = r.begin(); a < r.end(); ++a) {
+            Block &block = blocks[activeBlocks[a]];
+            
+            // the run is sorted by cell, so each start is the first entry at or past that cell
+            int e = runStarts[a];
+            for (int cell = 0; cell <= BLOCK_CELLS; cell++) {
+                while (e < runStarts[a + 1] && int(entries[e].first & (BLOCK_CELLS - 1)) < cell) {
+                    e++;
+                }
+                block.cellStarts[cell] = e;
+            }
+            
+            for (e = runStarts[a]; e < runStarts[a + 1]; e++) {
+                particleBlocks[entries[e].second] = activeBlocks[a];
+            }
+            
+            for (int offsetX = -1; offsetX < 2; offsetX++) {
+                for (int offsetY = -1; offsetY < 2; offsetY++) {
+                    for (int offsetZ = -1; offsetZ < 2; offsetZ++) {
+                        CompactHash3D::Cell neighbor = { (block.coordinate.x + offsetX) * BLOCK_SIZE, (block.coordinate.y + offsetY) * BLOCK_SIZE,
+                                                         (block.coordinate.z + offsetZ) * BLOCK_SIZE };
+                        block.neighbors[(offsetX + 1) * 9 + (offsetY + 1) * 3 + offsetZ + 1] = table.find(CompactHash3D::getMortonKey(neighbor) >> 9);
+                    }
+                }
+            }
+        }
+    });
+}
+
+int SparseBlockGrid3D::allocateBlock() {
+    if (!freeBlocks.empty()) {
+        int block = freeBlocks.back();
+        freeBlocks.pop_back();
+        return block;
+    }
+    blocks.push_back(Block());
+    return blocks.size() - 1;
+}
+
+int SparseBlockGrid3D::getNumBlocks() const {
+    return activeBlocks.size();
+}
+
+size_t SparseBlockGrid3D::getMemoryBytes() const {
+    return blocks.capacity() * sizeof(Block) + table.getMemoryBytes()
+        + entries.capacity() * sizeof(pair<uint64_t, int>) + sortedIndices.capacity() * sizeof(int)
+        + particleBlocks.capacity() * sizeof(int) + particleCells.capacity() * sizeof(short);
+}
@@ -0,0 +1,104 @@
+//
+//  SparseBlockGrid3D.hpp
+//  fluidSimulation
+//
+
+#ifndef SparseBlockGrid3D_hpp
+#define SparseBlockGrid3D_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ofMain.h"
+#include "Particle.hpp"
+#include "CompactHash3D.hpp"
+#include "MortonTable.hpp"
+
+#define BLOCK_SIZE 8
+#define BLOCK_CELLS (BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE)
+
+// spatial index for a small body of fluid in large bounds. cells are grouped into 8x8x8 blocks,
+// a block is taken from a pool the first time a particle enters it and handed back once it is empty,
+// so memory follows the occupied volume. blocks are found through a hash of their morton code,
+// and each block keeps its 26 neighbors, so a query only looks them up by index
+class SparseBlockGrid3D {
+public:
+    SparseBlockGrid3D();
+    
+    void build(const vector<Particle> &particles, const vector<char> &aliveFlags, float cellSize);
+    
+    // every particle in the 27 cells around the particle's own
+    template <typename Callback> void foreachCandidate(int particleIndex, Callback callback) const;
+    
+    // alive particles sorted by block and then cell
+    vector<int> sortedIndices;
+    int getNumBlocks() const;
+    size_t getMemoryBytes() const;
+    
+private:
+    struct Block {
+        CompactHash3D::Cell coordinate;
+        uint64_t key;
+        unsigned int stamp;
+        int neighbors[27];
+        int cellStarts[BLOCK_CELLS + 1];
+    };
+    
+    static inline int encodeLocalCell(int x, int y, int z);
+    int allocateBlock();
+    
+    vector<Block> blocks;
+    vector<int> freeBlocks, activeBlocks;
+    MortonTable table;
+    unsigned int buildStamp;
+    
+    vector<pair<uint64_t, int>> entries;
+    vector<int> particleBlocks;
+    vector<short> particleCells;
+};
+
+template <typename Callback>
+void SparseBlockGrid3D::foreachCandidate(int particleIndex, Callback callback) const {
+    int block = particleBlocks[particleIndex];
+    if (block < 0) return;
+    
+    // the local cell is the low 9 bits of the morton code, x y and z bits interleaved
+    int cell = particleCells[particleIndex];
+    int cellX = (cell & 1) | (cell >> 2 & 2) | (cell >> 4 & 4);
+    int cellY = (cell >> 1 & 1) | (cell >> 3 & 2) | (cell >> 5 & 4);
+    int cellZ = (cell >> 2 & 1) | (cell >> 4 & 2) | (cell >> 6 & 4);
+    
+    for (int offsetX = -1; offsetX < 2; offsetX++) {
+        int x = cellX + offsetX;
+        int blockX = x < 0 ? 0 : (x < BLOCK_SIZE ? 1 : 2);
+        x = (x + BLOCK_SIZE) % BLOCK_SIZE;
+        
+        for (int offsetY = -1; offsetY < 2; offsetY++) {
+            int y = cellY + offsetY;
+            int blockY = y < 0 ? 0 : (y < BLOCK_SIZE ? 1 : 2);
+            y = (y + BLOCK_SIZE) % BLOCK_SIZE;
+            
+            for (int offsetZ = -1; offsetZ < 2; offsetZ++) {
+                int z = cellZ + offsetZ;
+                int blockZ = z < 0 ? 0 : (z < BLOCK_SIZE ? 1 : 2);
+                z = (z + BLOCK_SIZE) % BLOCK_SIZE;
+                
+                int neighborBlock = blocks[block].neighbors[blockX * 9 + blockY * 3 + blockZ];
+                if (neighborBlock < 0) continue;
+                
+                const int *cellStarts = blocks[neighborBlock].cellStarts;
+                int neighborCell = encodeLocalCell(x, y, z);
+                for (int e = cellStarts[neighborCell]; e < cellStarts[neighborCell + 1]; e++) {
+                    callback(sortedIndices[e]);
+                }
+            }
+        }
+    }
+}
+
+inline int SparseBlockGrid3D::encodeLocalCell(int x, int y, int z) {
+    return (x & 1) | (y & 1) << 1 | (z & 1) << 2
+        | (x & 2) << 2 | (y & 2) << 3 | (z & 2) << 4
+        | (x & 4) << 4 | (y & 4) << 5 | (z & 4) << 6;
+}
+
+#endif /* SparseBlockGrid3D_hpp */
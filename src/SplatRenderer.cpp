@@ -0,0 +1,253 @@
+//
+//  SplatRenderer.cpp
+//  fluidSimulation
+//
+
+#include "SplatRenderer.hpp"
+#include "tbb/parallel_for.h"
+
+SplatRenderer::SplatRenderer() {
+    width = 0;
+    height = 0;
+    tilesX = 0;
+    tilesY = 0;
+    background = ofFloatColor(0.0, 0.0, 0.0, 1.0);
+}
+
+void SplatRenderer::setup(int _width, int _height) {
+    width = std::max(_width, 1);
+    height = std::max(_height, 1);
+    tilesX = (width + SPLAT_TILE_SIZE - 1) / SPLAT_TILE_SIZE;
+    tilesY = (height + SPLAT_TILE_SIZE - 1) / SPLAT_TILE_SIZE;
+    pixels.assign(width * height * 4, 0);
+}
+
+void SplatRenderer::setBackground(ofColor _background) {
+    background = _background;
+}
+
+vector<unsigned char> &SplatRenderer::getPixels() {
+    return pixels;
+}
+
+int SplatRenderer::getWidth() {
+    return width;
+}
+
+int SplatRenderer::getHeight() {
+    return height;
+}
+
+// render
+
+void SplatRenderer::render(ParticleSystem &particleSystem) {
+    if (width == 0) return;
+    
+    float scale = std::min(width / float(particleSystem.systemWidth), height / float(particleSystem.systemHeight));
+    float offsetX = (width - particleSystem.systemWidth * scale) * 0.5;
+    float offsetY = (height - particleSystem.systemHeight * scale) * 0.5;
+    ParticleSystem::drawModes drawMode = particleSystem.drawMode;
+    
+    int numParticles = particleSystem.particles.size();
+    splats.resize(numParticles);
+    
+    // circles and points are discs, lines and vectors are segments through the particle,
+    // the remaining modes fall back to discs of the particle's size
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            const Particle &particle = particleSystem.particles[i];
+            Splat &splat = splats[i];
+            
+            ofFloatColor color = particle.particleColor;
+            splat.red = color.r;
+            splat.green = color.g;
+            splat.blue = color.b;
+            splat.alpha = particleSystem.aliveFlags[i] ? color.a : 0.0;
+            splat.x0 = particle.position.x * scale + offsetX;
+            splat.y0 = particle.position.y * scale + offsetY;
+            splat.x1 = splat.x0;
+            splat.y1 = splat.y0;
+            splat.segment = false;
+            
+            if (drawMode == ParticleSystem::LINES) {
+                ofVec3f start = particle.lineMesh.getVertex(0) * scale;
+                ofVec3f end = particle.lineMesh.getVertex(1) * scale;
+                splat.x1 = splat.x0 + end.x;
+                splat.y1 = splat.y0 + end.y;
+                splat.x0 += start.x;
+                splat.y0 += start.y;
+                splat.size = 0.5;
+                splat.segment = true;
+            } else if (drawMode == ParticleSystem::VECTORS) {
+                splat.x1 = splat.x0 + particle.xOffset * scale;
+                splat.y1 = splat.y0 + particle.yOffset * scale;
+                splat.x0 -= particle.xOffset * scale;
+                splat.y0 -= particle.yOffset * scale;
+                splat.size = std::max(particle.lineThickness * 0.5f * scale, 0.5f);
+                splat.segment = true;
+            } else if (drawMode == ParticleSystem::POINTS) {
+                splat.size = 1.5;
+            } else {
+                splat.size = particle.size * scale;
+            }
+            
+            if (splat.size <= 0.0) splat.alpha = 0.0;
+        }
+    });
+    
+    binSplats();
+    
+    tbb::parallel_for( tbb::blocked_range<int>(0, tilesX * tilesY), [&](tbb::blocked_range<int> r) {
+        // one tile of float channels per task, the pixels are only written once the tile is finished
+        vector<float> tileBuffer(SPLAT_TILE_SIZE * SPLAT_TILE_SIZE * 3);
+        for (int t = r.begin(); t < r.end(); ++t) {
+            float *tileRed = tileBuffer.data();
+            float *tileGreen = tileRed + SPLAT_TILE_SIZE * SPLAT_TILE_SIZE;
+            float *tileBlue = tileGreen + SPLAT_TILE_SIZE * SPLAT_TILE_SIZE;
+            renderTile(t, tileRed, tileGreen, tileBlue);
+        }
+    });
+}
+
+void SplatRenderer::binSplats() {
+    // counting sort of splats by the tiles their bounds touch, each tile keeps particle order
+    int numTiles = tilesX * tilesY;
+    tileStarts.assign(numTiles + 1, 0);
+    
+    auto foreachTile = [&](const Splat &splat, auto callback) {
+        float reach = splat.size + 1.0;
+        int minX = std::max(0, int(floor((std::min(splat.x0, splat.x1) - reach) / SPLAT_TILE_SIZE)));
+        int maxX = std::min(tilesX - 1, int(floor((std::max(splat.x0, splat.x1) + reach) / SPLAT_TILE_SIZE)));
+        int minY = std::max(0, int(floor((std::min(splat.y0, splat.y1) - reach) / SPLAT_TILE_SIZE)));
+        int maxY = std::min(tilesY - 1, int(floor((std::max(splat.y0, splat.y1) + reach) / SPLAT_TILE_SIZE)));
+        for (int tileY = minY; tileY <= maxY; tileY++) {
+            for (int tileX = minX; tileX <= maxX; tileX++) {
+                callback(tileY * tilesX + tileX);
+            }
+        }
+    };
+    
+    for (const Splat &splat : splats) {
+        if (splat.alpha <= 0.0) continue;
+        foreachTile(splat, [&](int tile) { tileStarts[tile + 1]++; });
+    }
+    for (int t = 0; t < numTiles; t++) {
+        tileStarts[t + 1] += tileStarts[t];
+    }
+    
+    tileSplats.resize(tileStarts[numTiles]);
+    tileFill.assign(tileStarts.begin(), tileStarts.end() - 1);
+    for (int i = 0; i < splats.size(); i++) {
+        if (splats[i].alpha <= 0.0) continue;
+        foreachTile(splats[i], [&](int tile) { tileSplats[tileFill[tile]++] = i; });
+    }
+}
+
+void SplatRenderer::renderTile(int tile, float *tileRed, float *tileGreen, float *tileBlue) {
+    int originX = tile % tilesX * SPLAT_TILE_SIZE;
+    int originY = tile / tilesX * SPLAT_TILE_SIZE;
+    int tileWidth = std::min(SPLAT_TILE_SIZE, width - originX);
+    int tileHeight = std::min(SPLAT_TILE_SIZE, height - originY);
+    
+    std::fill(tileRed, tileRed + SPLAT_TILE_SIZE * SPLAT_TILE_SIZE, background.r);
+    std::fill(tileGreen, tileGreen + SPLAT_TILE_SIZE * SPLAT_TILE_SIZE, background.g);
+    std::fill(tileBlue, tileBlue + SPLAT_TILE_SIZE * SPLAT_TILE_SIZE, background.b);
+    
+    for (int k = tileStarts[tile]; k < tileStarts[tile + 1]; k++) {
+        const Splat &splat = splats[tileSplats[k]];
+        
+        // tile local coordinates, pixel centers sit on the halves
+        float x0 = splat.x0 - originX - 0.5;
+        float y0 = splat.y0 - originY - 0.5;
+        float x1 = splat.x1 - originX - 0.5;
+        float y1 = splat.y1 - originY - 0.5;
+        float reach = splat.size + 0.5;
+        
+        int startX = std::max(0, int(ceil(std::min(x0, x1) - reach)));
+        int endX = std::min(tileWidth - 1, int(floor(std::max(x0, x1) + reach)));
+        int startY = std::max(0, int(ceil(std::min(y0, y1) - reach)));
+        int endY = std::min(tileHeight - 1, int(floor(std::max(y0, y1) + reach)));
+        if (startX > endX || startY > endY) continue;
+        
+        float red = splat.red;
+        float green = splat.green;
+        float blue = splat.blue;
+        float alpha = splat.alpha;
+        
+        // spans are branch free so the compiler can vectorize them, coverage is one pixel of falloff at the edge
+        if (splat.segment) {
+            float segmentX = x1 - x0;
+            float segmentY = y1 - y0;
+            float squareLength = segmentX * segmentX + segmentY * segmentY;
+            float inverseLength = squareLength > 0.0 ? 1.0 / squareLength : 0.0;
+            
+            for (int y = startY; y <= endY; y++) {
+                float dy = y - y0;
+                float *rowRed = tileRed + y * SPLAT_TILE_SIZE;
+                float *rowGreen = tileGreen + y * SPLAT_TILE_SIZE;
+                float *rowBlue = tileBlue + y * SPLAT_TILE_SIZE;
+                
+                for (int x = startX; x <= endX; x++) {
+                    float dx = x - x0;
+                    float t = std::min(std::max((dx * segmentX + dy * segmentY) * inverseLength, 0.0f), 1.0f);
+                    float ex = dx - segmentX * t;
+                    float ey = dy - segmentY * t;
+                    float distance = sqrtf(ex * ex + ey * ey);
+                    float coverage = std::min(std::max(reach - distance, 0.0f), 1.0f) * alpha;
+                    rowRed[x] += (red - rowRed[x]) * coverage;
+                    rowGreen[x] += (green - rowGreen[x]) * coverage;
+                    rowBlue[x] += (blue - rowBlue[x]) * coverage;
+                }
+            }
+        } else {
+            for (int y = startY; y <= endY; y++) {
+                float dy = y - y0;
+                float squareDy = dy * dy;
+                float *rowRed = tileRed + y * SPLAT_TILE_SIZE;
+                float *rowGreen = tileGreen + y * SPLAT_TILE_SIZE;
+                float *rowBlue = tileBlue + y * SPLAT_TILE_SIZE;
+                
+                for (int x = startX; x <= endX; x++) {
+                    float dx = x - x0;
+                    float distance = sqrtf(dx * dx + squareDy);
+                    float coverage = std::min(std::max(reach - distance, 0.0f), 1.0f) * alpha;
+                    rowRed[x] += (red - rowRed[x]) * coverage;
+                    rowGreen[x] += (green - rowGreen[x]) * coverage;
+                    rowBlue[x] += (blue - rowBlue[x]) * coverage;
+                }
+            }
+        }
+    }
+    
+    for (int y = 0; y < tileHeight; y++) {
+        unsigned char *row = pixels.data() + ((originY + y) * width + originX) * 4;
+        for (int x = 0; x < tileWidth; x++) {
+            int k = y * SPLAT_TILE_SIZE + x;
+            row[x * 4] = std::min(std::max(tileRed[k], 0.0f), 1.0f) * 255.0 + 0.5;
+            row[x * 4 + 1] = std::min(std::max(tileGreen[k], 0.0f), 1.0f) * 255.0 + 0.5;
+            row[x * 4 + 2] = std::min(std::max(tileBlue[k], 0.0f), 1.0f) * 255.0 + 0.5;
+            row[x * 4 + 3] = 255;
+        }
+    }
+}
+
+// output
+
+Boolean SplatRenderer::savePng(string path) {
+    if (width == 0) return false;
+    
+    ofPixels image;
+    image.setFromPixels(pixels.data(), width, height, OF_PIXELS_RGBA);
+    return ofSaveImage(image, path);
+}
+
+Boolean SplatRenderer::saveRaw(string path) {
+    if (width == 0) return false;
+    
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    
+    Boolean written = fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+    fclose(file);
+    return written;
+}
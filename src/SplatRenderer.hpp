@@ -0,0 +1,56 @@
+//
+//  SplatRenderer.hpp
+//  fluidSimulation
+//
+
+#ifndef SplatRenderer_hpp
+#define SplatRenderer_hpp
+
+#include <stdio.h>
+#include "ofMain.h"
+#include "ParticleSystem.hpp"
+
+#define SPLAT_TILE_SIZE 64
+
+// software rasterizer for machines without a gpu, previews, archives and thumbnails.
+// particles are drawn as antialiased discs, or as segments in the lines mode, and blended over
+// the background in particle order like the gl meshes. the frame is cut into tiles that are
+// drawn in parallel, each tile blends only the splats that overlap it
+class SplatRenderer {
+public:
+    SplatRenderer();
+
+    void setup(int width, int height);
+    void setBackground(ofColor background);
+
+    // the system's bounds are scaled to fit the frame and centered
+    void render(ParticleSystem &particleSystem);
+
+    // rgba rows from the top, post processing works on them in place
+    vector<unsigned char> &getPixels();
+    int getWidth();
+    int getHeight();
+
+    Boolean savePng(string path);
+    Boolean saveRaw(string path);
+
+private:
+    // a disc at the first point, or a segment between both, with the half width as size
+    struct Splat {
+        float x0, y0, x1, y1, size;
+        float red, green, blue, alpha;
+        Boolean segment;
+    };
+
+    void binSplats();
+    void renderTile(int tile, float *tileRed, float *tileGreen, float *tileBlue);
+
+    int width, height, tilesX, tilesY;
+    ofFloatColor background;
+    vector<unsigned char> pixels;
+
+    vector<Splat> splats;
+    vector<int> tileStarts, tileFill, tileSplats;
+};
+
+#endif /* SplatRenderer_hpp */
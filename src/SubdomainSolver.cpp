@@ -0,0 +1,320 @@
+//
+//  SubdomainSolver.cpp
+//  fluidSimulation
+//
+
+#include "SubdomainSolver.hpp"
+#include "ParticleSystem.hpp"
+#include <string.h>
+#include <float.h>
+
+SubdomainSolver::SubdomainSolver() {
+    memset(&settings, 0, sizeof(settings));
+    settings.radius = 1.0;
+    kernels.calculate3DVolumesFromRadius(settings.radius);
+
+    stripMinX = -FLT_MAX;
+    stripMaxX = FLT_MAX;
+    ownedCount = 0;
+
+    cellMinX = 0;
+    cellMinY = 0;
+    cellsX = 0;
+    cellsY = 0;
+}
+
+void SubdomainSolver::setSettings(const Settings &_settings) {
+    if (_settings.radius != settings.radius) {
+        kernels.calculate3DVolumesFromRadius(_settings.radius);
+    }
+    if (_settings.seed != settings.seed) {
+        random.setSeed(_settings.seed);
+    }
+    settings = _settings;
+}
+
+void SubdomainSolver::setStrip(float _stripMinX, float _stripMaxX) {
+    stripMinX = _stripMinX;
+    stripMaxX = _stripMaxX;
+}
+
+void SubdomainSolver::clear() {
+    resize(0);
+    ownedCount = 0;
+}
+
+void SubdomainSolver::resize(int count) {
+    ids.resize(count);
+    positionX.resize(count);
+    positionY.resize(count);
+    velocityX.resize(count);
+    velocityY.resize(count);
+    predictedX.resize(count);
+    predictedY.resize(count);
+    density.resize(count);
+    nearDensity.resize(count);
+}
+
+void SubdomainSolver::addParticle(int id, float _positionX, float _positionY, float _velocityX, float _velocityY) {
+    // owned particles are kept in front of the halo
+    clearHalo();
+
+    ids.push_back(id);
+    positionX.push_back(_positionX);
+    positionY.push_back(_positionY);
+    velocityX.push_back(_velocityX);
+    velocityY.push_back(_velocityY);
+    predictedX.push_back(_positionX);
+    predictedY.push_back(_positionY);
+    density.push_back(0.0);
+    nearDensity.push_back(0.0);
+    ownedCount++;
+}
+
+void SubdomainSolver::addHalo(int id, float _positionX, float _positionY, float _velocityX, float _velocityY, float _predictedX, float _predictedY) {
+    ids.push_back(id);
+    positionX.push_back(_positionX);
+    positionY.push_back(_positionY);
+    velocityX.push_back(_velocityX);
+    velocityY.push_back(_velocityY);
+    predictedX.push_back(_predictedX);
+    predictedY.push_back(_predictedY);
+    density.push_back(0.0);
+    nearDensity.push_back(0.0);
+}
+
+void SubdomainSolver::clearHalo() {
+    resize(ownedCount);
+}
+
+void SubdomainSolver::removeParticle(int particleIndex) {
+    // the last owned particle takes the slot, order does not matter since neighbors are visited by id
+    clearHalo();
+
+    int last = ownedCount - 1;
+    ids[particleIndex] = ids[last];
+    positionX[particleIndex] = positionX[last];
+    positionY[particleIndex] = positionY[last];
+    velocityX[particleIndex] = velocityX[last];
+    velocityY[particleIndex] = velocityY[last];
+    predictedX[particleIndex] = predictedX[last];
+    predictedY[particleIndex] = predictedY[last];
+    density[particleIndex] = density[last];
+    nearDensity[particleIndex] = nearDensity[last];
+
+    ownedCount--;
+    resize(ownedCount);
+}
+
+void SubdomainSolver::step() {
+    predict();
+    findNeighbors();
+    computeDensities();
+    computeForces();
+    integrate();
+}
+
+void SubdomainSolver::predict() {
+    for (int i = 0; i < ownedCount; i++) {
+        velocityX[i] += settings.gravityX * settings.deltaTime;
+        velocityY[i] += settings.gravityY * settings.deltaTime;
+        predictedX[i] = positionX[i] + velocityX[i] * settings.predictionFactor;
+        predictedY[i] = positionY[i] + velocityY[i] * settings.predictionFactor;
+    }
+}
+
+void SubdomainSolver::findNeighbors() {
+    int count = ids.size();
+    float radius = settings.radius;
+    float squareRadius = radius * radius;
+
+    // a dense grid over owned and halo particles, sorted by cell and then id
+    cellMinX = INT_MAX;
+    cellMinY = INT_MAX;
+    int cellMaxX = INT_MIN;
+    int cellMaxY = INT_MIN;
+    for (int i = 0; i < count; i++) {
+        int cellX = floor(positionX[i] / radius);
+        int cellY = floor(positionY[i] / radius);
+        cellMinX = std::min(cellMinX, cellX);
+        cellMinY = std::min(cellMinY, cellY);
+        cellMaxX = std::max(cellMaxX, cellX);
+        cellMaxY = std::max(cellMaxY, cellY);
+    }
+
+    neighborStarts.assign(ownedCount + 1, 0);
+    neighbors.clear();
+    if (count == 0) return;
+
+    cellsX = cellMaxX - cellMinX + 1;
+    cellsY = cellMaxY - cellMinY + 1;
+
+    cellEntries.resize(count);
+    for (int i = 0; i < count; i++) {
+        int cellX = int(floor(positionX[i] / radius)) - cellMinX;
+        int cellY = int(floor(positionY[i] / radius)) - cellMinY;
+        uint64_t cell = uint64_t(cellY) * cellsX + cellX;
+        cellEntries[i] = (cell << 32) | uint32_t(i);
+    }
+
+    // within a cell entries go by id, so the sums do not depend on which strip a neighbor came from
+    std::sort(cellEntries.begin(), cellEntries.end(), [&](uint64_t left, uint64_t right) {
+        uint64_t leftCell = left >> 32;
+        uint64_t rightCell = right >> 32;
+        if (leftCell != rightCell) return leftCell < rightCell;
+        return ids[uint32_t(left)] < ids[uint32_t(right)];
+    });
+
+    cellStarts.assign(size_t(cellsX) * cellsY + 1, 0);
+    for (uint64_t entry : cellEntries) {
+        cellStarts[(entry >> 32) + 1]++;
+    }
+    for (size_t c = 1; c < cellStarts.size(); c++) {
+        cellStarts[c] += cellStarts[c - 1];
+    }
+
+    // same offset order as FluidSystem2D, x outer and y inner
+    for (int i = 0; i < ownedCount; i++) {
+        int cellX = int(floor(positionX[i] / radius)) - cellMinX;
+        int cellY = int(floor(positionY[i] / radius)) - cellMinY;
+
+        for (int offsetX = -1; offsetX < 2; offsetX++) {
+            int x = cellX + offsetX;
+            if (x < 0 || x >= cellsX) continue;
+
+            for (int offsetY = -1; offsetY < 2; offsetY++) {
+                int y = cellY + offsetY;
+                if (y < 0 || y >= cellsY) continue;
+
+                int cell = y * cellsX + x;
+                for (int e = cellStarts[cell]; e < cellStarts[cell + 1]; e++) {
+                    int j = uint32_t(cellEntries[e]);
+                    float dx = positionX[i] - positionX[j];
+                    float dy = positionY[i] - positionY[j];
+                    if (dx * dx + dy * dy <= squareRadius) {
+                        neighbors.push_back(j);
+                    }
+                }
+            }
+        }
+        neighborStarts[i + 1] = neighbors.size();
+    }
+}
+
+void SubdomainSolver::computeDensities() {
+    float radius = settings.radius;
+
+    for (int i = 0; i < ownedCount; i++) {
+        float particleDensity = 0.0f;
+        float particleNearDensity = 0.0f;
+
+        for (int n = neighborStarts[i]; n < neighborStarts[i + 1]; n++) {
+            int j = neighbors[n];
+            float dx = predictedX[i] - predictedX[j];
+            float dy = predictedY[i] - predictedY[j];
+            float distance = sqrt(dx * dx + dy * dy);
+            if (distance > radius) continue;
+
+            particleDensity += kernels.densityKernel(distance, radius);
+            particleNearDensity += kernels.nearDensityKernel(distance, radius);
+        }
+
+        density[i] = particleDensity;
+        nearDensity[i] = particleNearDensity;
+    }
+}
+
+void SubdomainSolver::computeForces() {
+    float radius = settings.radius;
+    velocityChangeX.resize(ownedCount);
+    velocityChangeY.resize(ownedCount);
+
+    for (int i = 0; i < ownedCount; i++) {
+        float pressure = calculatePressureFromDensity(density[i]);
+        float nearPressure = calculateNearPressureFromDensity(nearDensity[i]);
+
+        float pressureX = 0.0f;
+        float pressureY = 0.0f;
+        float viscosityX = 0.0f;
+        float viscosityY = 0.0f;
+
+        for (int n = neighborStarts[i]; n < neighborStarts[i + 1]; n++) {
+            int j = neighbors[n];
+            if (i == j) continue;
+
+            float dx = predictedX[j] - predictedX[i];
+            float dy = predictedY[j] - predictedY[i];
+            float distance = sqrt(dx * dx + dy * dy);
+            if (distance > radius) continue;
+
+            float influence = kernels.viscosityKernel(distance, radius);
+            viscosityX += (velocityX[j] - velocityX[i]) * influence;
+            viscosityY += (velocityY[j] - velocityY[i]) * influence;
+
+            if (distance >= radius) continue;
+
+            float directionX = dx / distance;
+            float directionY = dy / distance;
+            if (distance == 0.0) {
+                float theta = random.uniform(ParticleSystem::OVERLAP_STREAM, ids[i], ids[j], settings.stepCount) * TWO_PI;
+                directionX = cos(theta);
+                directionY = sin(theta);
+            }
+
+            float slope = kernels.densityDerivative(distance, radius);
+            float nearSlope = kernels.nearDensityDerivative(distance, radius);
+
+            float sharedPressure = (pressure + calculatePressureFromDensity(density[j])) * 0.5;
+            float sharedNearPressure = (nearPressure + calculateNearPressureFromDensity(nearDensity[j])) * 0.5;
+
+            pressureX += sharedPressure * directionX * slope / density[i];
+            pressureY += sharedPressure * directionY * slope / density[i];
+            pressureX += sharedNearPressure * directionX * nearSlope / nearDensity[i];
+            pressureY += sharedNearPressure * directionY * nearSlope / nearDensity[i];
+        }
+
+        velocityChangeX[i] = pressureX / density[i] * settings.deltaTime + viscosityX * settings.viscosityStrength * settings.deltaTime;
+        velocityChangeY[i] = pressureY / density[i] * settings.deltaTime + viscosityY * settings.viscosityStrength * settings.deltaTime;
+    }
+}
+
+void SubdomainSolver::integrate() {
+    for (int i = 0; i < ownedCount; i++) {
+        velocityX[i] += velocityChangeX[i];
+        velocityY[i] += velocityChangeY[i];
+        positionX[i] += velocityX[i] * settings.deltaTime;
+        positionY[i] += velocityY[i] * settings.deltaTime;
+        resolveCollisions(i);
+    }
+}
+
+void SubdomainSolver::resolveCollisions(int particleIndex) {
+    if (positionX[particleIndex] < settings.boundsMinX) {
+        velocityX[particleIndex] *= -1.0 * settings.collisionDamping;
+        positionX[particleIndex] = settings.boundsMinX;
+    }
+
+    if (positionX[particleIndex] > settings.boundsMaxX) {
+        velocityX[particleIndex] *= -1.0 * settings.collisionDamping;
+        positionX[particleIndex] = settings.boundsMaxX;
+    }
+
+    if (positionY[particleIndex] < settings.boundsMinY) {
+        velocityY[particleIndex] *= -1.0 * settings.collisionDamping;
+        positionY[particleIndex] = settings.boundsMinY;
+    }
+
+    if (positionY[particleIndex] > settings.boundsMaxY) {
+        velocityY[particleIndex] *= -1.0 * settings.collisionDamping;
+        positionY[particleIndex] = settings.boundsMaxY;
+    }
+}
+
+float SubdomainSolver::calculatePressureFromDensity(float density) {
+    float densityError = density - settings.targetDensity;
+    return densityError * settings.pressureMultiplier;
+}
+
+float SubdomainSolver::calculateNearPressureFromDensity(float nearDensity) {
+    return nearDensity * settings.nearPressureMultiplier;
+}
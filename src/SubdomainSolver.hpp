@@ -0,0 +1,77 @@
+//
+//  SubdomainSolver.hpp
+//  fluidSimulation
+//
+
+#ifndef SubdomainSolver_hpp
+#define SubdomainSolver_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ofMain.h"
+#include "Kernels.hpp"
+#include "Random.hpp"
+
+// the double density step of FluidSystem2D in neighbor list mode, on flat arrays for one strip of the bounds.
+// particles [0, ownedCount) are stepped, the halo copies after them are only read.
+// neighbors are visited by exact cell and then by id, so the sums come out bitwise the same
+// however the bounds are split
+class SubdomainSolver {
+public:
+    SubdomainSolver();
+
+    // plain data, it is copied through shared memory as is
+    struct Settings {
+        float radius, deltaTime, predictionFactor, collisionDamping;
+        float targetDensity, pressureMultiplier, nearPressureMultiplier, viscosityStrength;
+        float gravityX, gravityY;
+        float boundsMinX, boundsMaxX, boundsMinY, boundsMaxY;
+        uint64_t seed;
+        uint32_t stepCount;
+    };
+
+    Settings settings;
+    float stripMinX, stripMaxX;
+
+    vector<int> ids;
+    vector<float> positionX, positionY, velocityX, velocityY;
+    vector<float> predictedX, predictedY, density, nearDensity;
+    int ownedCount;
+
+    // written by computeForces for the owned particles, applied by integrate
+    vector<float> velocityChangeX, velocityChangeY;
+
+    void setSettings(const Settings &settings);
+    void setStrip(float stripMinX, float stripMaxX);
+    void clear();
+    void addParticle(int id, float positionX, float positionY, float velocityX, float velocityY);
+    void addHalo(int id, float positionX, float positionY, float velocityX, float velocityY, float predictedX, float predictedY);
+    void clearHalo();
+    void removeParticle(int particleIndex);
+
+    // one full step for a domain without neighbors
+    void step();
+
+    // the same step in phases, halos are exchanged between them
+    void predict();
+    void findNeighbors();
+    void computeDensities();
+    void computeForces();
+    void integrate();
+
+private:
+    Kernels kernels;
+    Random random;
+
+    int cellMinX, cellMinY, cellsX, cellsY;
+    vector<uint64_t> cellEntries;
+    vector<int> cellStarts;
+    vector<int> neighborStarts, neighbors;
+
+    void resize(int count);
+    void resolveCollisions(int particleIndex);
+    float calculatePressureFromDensity(float density);
+    float calculateNearPressureFromDensity(float nearDensity);
+};
+
+#endif /* SubdomainSolver_hpp */
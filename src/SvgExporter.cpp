@@ -0,0 +1,141 @@
+//
+//  SvgExporter.cpp
+//  fluidSimulation
+//
+
+#include "SvgExporter.hpp"
+
+SvgExporter::SvgExporter() {
+    exportActive = false;
+    lastExportMicros = 0;
+    lineThickness = 1.0;
+    width = 0;
+    height = 0;
+}
+
+SvgExporter::~SvgExporter() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+Boolean SvgExporter::exportFrame(ParticleSystem &particleSystem, string _path, Boolean monochrome) {
+    if (exportActive) return false;
+    if (worker.joinable()) {
+        worker.join();
+    }
+    
+    int numParticles = particleSystem.particles.size();
+    primitives.resize(numParticles);
+    drawMode = particleSystem.drawMode;
+    lineThickness = numParticles > 0 ? particleSystem.particles[0].lineThickness : 1.0;
+    width = particleSystem.systemWidth;
+    height = particleSystem.systemHeight;
+    path = _path;
+    
+    // shape vertices are read from the particle meshes, circles only need the size
+    tbb::parallel_for( tbb::blocked_range<int>(0, numParticles), [&](tbb::blocked_range<int> r) {
+        for (int i = r.begin(); i < r.end(); ++i) {
+            Particle &particle = particleSystem.particles[i];
+            Primitive &primitive = primitives[i];
+            
+            primitive.x = particle.position.x;
+            primitive.y = particle.position.y;
+            primitive.size = particle.size;
+            primitive.color = monochrome ? ofColor::black : particle.particleColor;
+            
+            // dead pool slots are marked fully transparent and skipped by the writer
+            if (!particleSystem.aliveFlags[i]) {
+                primitive.color.a = 0;
+                continue;
+            }
+            
+            const ofMesh *shapeMesh = nullptr;
+            if (drawMode == ParticleSystem::RECTANGLES) {
+                shapeMesh = &particle.rectangleMesh;
+            } else if (drawMode == ParticleSystem::VECTORS) {
+                shapeMesh = &particle.vectorMesh;
+            } else if (drawMode == ParticleSystem::LINES) {
+                shapeMesh = &particle.lineMesh;
+            }
+            
+            if (shapeMesh == nullptr) continue;
+            
+            int numVertices = std::min(4, int(shapeMesh->getNumVertices()));
+            for (int j = 0; j < numVertices; j++) {
+                ofVec3f vertex = shapeMesh->getVertex(j);
+                primitive.points[j * 2] = vertex.x + primitive.x;
+                primitive.points[j * 2 + 1] = vertex.y + primitive.y;
+            }
+        }
+    });
+    
+    exportActive = true;
+    worker = std::thread(&SvgExporter::writeFile, this);
+    
+    return true;
+}
+
+Boolean SvgExporter::isExporting() {
+    return exportActive;
+}
+
+uint64_t SvgExporter::getLastExportMicros() {
+    return lastExportMicros;
+}
+
+void SvgExporter::writeFile() {
+    uint64_t exportStart = ofGetElapsedTimeMicros();
+    
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file != nullptr) {
+        // a large stdio buffer keeps the writes sequential, each primitive is one short formatted line
+        vector<char> buffer(1 << 20);
+        setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+        
+        fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+        fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n", width, height, width, height);
+        
+        if (drawMode == ParticleSystem::LINES) {
+            fprintf(file, "<g fill=\"none\" stroke-width=\"%.2f\">\n", lineThickness);
+        } else {
+            fprintf(file, "<g stroke=\"none\">\n");
+        }
+        
+        for (const Primitive &primitive : primitives) {
+            writePrimitive(file, primitive);
+        }
+        
+        fprintf(file, "</g>\n</svg>\n");
+        fclose(file);
+    }
+    
+    lastExportMicros = ofGetElapsedTimeMicros() - exportStart;
+    exportActive = false;
+}
+
+void SvgExporter::writePrimitive(FILE *file, const Primitive &primitive) {
+    const float *p = primitive.points;
+    int r = primitive.color.r;
+    int g = primitive.color.g;
+    int b = primitive.color.b;
+    if (primitive.color.a == 0) return;
+    
+    switch (drawMode) {
+        case ParticleSystem::CIRCLES:
+            if (primitive.size <= 0.0) return;
+            fprintf(file, "<circle cx=\"%.2f\" cy=\"%.2f\" r=\"%.2f\" fill=\"#%02x%02x%02x\"/>\n", primitive.x, primitive.y, primitive.size, r, g, b);
+            break;
+        case ParticleSystem::RECTANGLES:
+        case ParticleSystem::VECTORS:
+            fprintf(file, "<polygon points=\"%.2f,%.2f %.2f,%.2f %.2f,%.2f %.2f,%.2f\" fill=\"#%02x%02x%02x\"/>\n", p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], r, g, b);
+            break;
+        case ParticleSystem::LINES:
+            fprintf(file, "<line x1=\"%.2f\" y1=\"%.2f\" x2=\"%.2f\" y2=\"%.2f\" stroke=\"#%02x%02x%02x\"/>\n", p[0], p[1], p[2], p[3], r, g, b);
+            break;
+        case ParticleSystem::POINTS:
+        case ParticleSystem::SURFACE:
+            fprintf(file, "<circle cx=\"%.2f\" cy=\"%.2f\" r=\"1\" fill=\"#%02x%02x%02x\"/>\n", primitive.x, primitive.y, r, g, b);
+            break;
+    }
+}
@@ -0,0 +1,47 @@
+//
+//  SvgExporter.hpp
+//  fluidSimulation
+//
+
+#ifndef SvgExporter_hpp
+#define SvgExporter_hpp
+
+#include <stdio.h>
+#include <thread>
+#include <atomic>
+#include "ParticleSystem.hpp"
+
+// snapshots the particles on the calling thread and writes one svg primitive per particle
+// from a worker, so rendering keeps going while the file is written
+class SvgExporter {
+public:
+    SvgExporter();
+    ~SvgExporter();
+    
+    Boolean exportFrame(ParticleSystem &particleSystem, string path, Boolean monochrome);
+    Boolean isExporting();
+    uint64_t getLastExportMicros();
+    
+private:
+    struct Primitive {
+        float x, y, size;
+        float points[8];
+        ofColor color;
+    };
+    
+    void writeFile();
+    void writePrimitive(FILE *file, const Primitive &primitive);
+    
+    std::thread worker;
+    std::atomic<bool> exportActive;
+    std::atomic<uint64_t> lastExportMicros;
+    
+    // snapshot handed to the worker, untouched by the caller until the worker finishes
+    vector<Primitive> primitives;
+    ParticleSystem::drawModes drawMode;
+    float lineThickness;
+    int width, height;
+    string path;
+};
+
+#endif /* SvgExporter_hpp */
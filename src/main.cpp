@@ -1,8 +1,20 @@
 #include "ofMain.h"
+#include "ofAppNoWindow.h"
 #include "ofApp.h"
+#include "HeadlessApp.hpp"
 
 //========================================================================
-int main() {
+int main(int argc, char *argv[]) {
+    // --headless renders frames on the cpu without a window or gpu, for example
+    // fluidSimulation --headless --frames 300 --steps 2 --output frames --raw
+    HeadlessSettings headlessSettings;
+    if (HeadlessApp::parseArguments(argc, argv, headlessSettings)) {
+        ofInit();
+        auto window = make_shared<ofAppNoWindow>();
+        ofRunApp(window, make_shared<HeadlessApp>(headlessSettings));
+        return ofRunMainLoop();
+    }
+
 	ofGLWindowSettings settings;
 
     // settings.setSize(960, 600);
@@ -2,7 +2,7 @@
 
 //--------------------------------------------------------------
 void ofApp::setup(){
-    oscReceiver.setup(RECEIVING_PORT);
+    oscInput.setup(RECEIVING_PORT);
     
     blur.load("shaders/blur");
     contrast.load("shaders/contrast");
@@ -11,13 +11,17 @@ void ofApp::setup(){
     //systemHeight = 1200;
     systemWidth = 1080;
     systemHeight = 1920;
+    oscInput.setSystemSize(systemWidth, systemHeight);
     
     systemFbo.allocate(systemWidth, systemHeight);
     blurFbo.allocate(systemWidth, systemHeight);
     bloomFbo.allocate(systemWidth, systemHeight);
     contrastFbo.allocate(systemWidth, systemHeight);
+    splatRenderer.setup(systemWidth, systemHeight);
     
+#ifdef TARGET_OSX
     individualTextureSyphonServer.setName("fbo texture output");
+#endif
     ofSetFrameRate(60);
 
     // main gui setup
@@ -34,7 +38,7 @@ void ofApp::setup(){
     influenceRadius.addListener(this, &ofApp::setInfluenceRadius);
     gui.add(influenceRadius.set("influence radius", 10.0, 0.5, 35.0));
     timeScalar.addListener(this, &ofApp::setTimeScalar);
-    gui.add(timeScalar.set("time scalar", 1.0, 0.5, 4.0));
+    gui.add(timeScalar.set("time scalar", 1.0, 0.1, 4.0));
     gravityMultiplier.addListener(this, &ofApp::setGravityMultiplier);
     gui.add(gravityMultiplier.set("gravity multiplier", 0.0, 0.0, 5.0));
     gui.add(gravityRotationIncrement.setup("gravity rotation", 0.0, 0.0, 5.0));
@@ -58,6 +62,10 @@ void ofApp::setup(){
     gui.add(mouseForce.set("mouse force", 15.0, 1., 100.));
     lineThickness.addListener(this, &ofApp::setLineThickness);
     gui.add(lineThickness.setup("line thickness", 1.0, 0.1, 15.0));
+    surfaceThreshold.addListener(this, &ofApp::setSurfaceThreshold);
+    gui.add(surfaceThreshold.set("surface threshold", 0.5, 0.05, 3.0));
+    surfaceResolution.addListener(this, &ofApp::setSurfaceResolution);
+    gui.add(surfaceResolution.set("surface resolution", 4.0, 1.0, 16.0));
     
     // simulation gui settings
     simulationSettings.setName("sim settings");
@@ -67,6 +75,38 @@ void ofApp::setup(){
     simulationSettings.add(pressureMultiplier.set("pressure", 100, 0, 1000.0));
     nearPressureMultiplier.addListener(this, &ofApp::setNearPressureMultiplier);
     simulationSettings.add(nearPressureMultiplier.set("near pressure", 100, 0.0, 1000.0));
+    neighborMode.addListener(this, &ofApp::setNeighborMode);
+    simulationSettings.add(neighborMode.set("neighbor mode", 0, 0, 4));
+    verletSkin.addListener(this, &ofApp::setVerletSkin);
+    simulationSettings.add(verletSkin.set("verlet skin", 2.0, 0.0, 10.0));
+    tileCells.addListener(this, &ofApp::setTileCells);
+    simulationSettings.add(tileCells.set("tile cells", 8, 2, 32));
+    incrementalSort.addListener(this, &ofApp::setIncrementalSort);
+    simulationSettings.add(incrementalSort.set("incremental sort", false));
+    pairCache.addListener(this, &ofApp::setPairCache);
+    simulationSettings.add(pairCache.set("pair cache", false));
+    solverMode.addListener(this, &ofApp::setSolverMode);
+    simulationSettings.add(solverMode.set("solver", 0, 0, 1));
+    solverIterations.addListener(this, &ofApp::setSolverIterations);
+    simulationSettings.add(solverIterations.set("iterations", 6, 1, 20));
+    solverTolerance.addListener(this, &ofApp::setSolverTolerance);
+    simulationSettings.add(solverTolerance.set("tolerance", 0.01, 0.001, 0.1));
+    solverRestDensity.addListener(this, &ofApp::setSolverRestDensity);
+    simulationSettings.add(solverRestDensity.set("solver rest density", 1.0, 0.25, 3.0));
+    solverRelaxation.addListener(this, &ofApp::setSolverRelaxation);
+    simulationSettings.add(solverRelaxation.set("solver relaxation", 0.1, 0.0, 1.0));
+    viscosityStrength.addListener(this, &ofApp::setViscosityStrength);
+    simulationSettings.add(viscosityStrength.set("viscosity log10", log10(0.25), VISCOSITY_LOG_MIN, 5.0));
+    implicitViscosity.addListener(this, &ofApp::setImplicitViscosity);
+    simulationSettings.add(implicitViscosity.set("implicit viscosity", false));
+    viscosityIterations.addListener(this, &ofApp::setViscosityIterations);
+    simulationSettings.add(viscosityIterations.set("viscosity iterations", 4, 1, 20));
+    seed.addListener(this, &ofApp::setSeed);
+    simulationSettings.add(seed.set("seed", 0, 0, 1000));
+    forceField.addListener(this, &ofApp::setForceField);
+    simulationSettings.add(forceField.set("force field", 0, 0, 3));
+    forceFieldStrength.addListener(this, &ofApp::setForceFieldStrength);
+    simulationSettings.add(forceFieldStrength.set("force field strength", 1.0, 0.0, 5.0));
     gui.add(simulationSettings);
     
     // boundary gui settings
@@ -79,6 +119,12 @@ void ofApp::setup(){
     boundarySettings.add(borderOffset.set("offset", 0.0, 0.0, 50.0));
     circleBoundary.addListener(this, &ofApp::setCircleBoundary);
     boundarySettings.add(circleBoundary.set("circle boundary", false));
+    boundaryShape.addListener(this, &ofApp::setBoundaryShape);
+    boundarySettings.add(boundaryShape.set("boundary shape", 0, 0, 3));
+    emitterRate.addListener(this, &ofApp::setEmitterRate);
+    boundarySettings.add(emitterRate.set("emitter rate", 0.0, 0.0, 20.0));
+    sinkRadius.addListener(this, &ofApp::setSinkRadius);
+    boundarySettings.add(sinkRadius.set("sink radius", 0.0, 0.0, 200.0));
     gui.add(boundarySettings);
    
     // cool color gui setup
@@ -127,8 +173,9 @@ void ofApp::setup(){
     fluidSystem.setBoundsSize(ofVec3f(boundsWidth, boundsHeight, 0));
     fluidSystem.setCenter(systemWidth * 0.5, systemHeight * 0.5);
     fluidSystem.setCollisionDamping(0.05);
-    fluidSystem.setViscosityStrength(0.25);
+    fluidSystem.setViscosityStrength(getViscosityStrength(viscosityStrength));
     fluidSystem.setMode(0);
+    fluidSystem.setSeed(seed);
     fluidSystem.setNumberParticles(numberParticles);
     fluidSystem.resetRandom();
     
@@ -136,11 +183,14 @@ void ofApp::setup(){
     cam.setupPerspective();
     backgroundColor = ofColor::black;
     gravityRotation = ofVec2f(0.0, 1.0);
+    replayActive = false;
+    replayFrame = 0;
 }
 
 //--------------------------------------------------------------
 void ofApp::update() {
-    checkIncomingOsc();
+    // osc that arrived before this step is applied now, anything later waits for the next one
+    oscInput.applyEvents(fluidSystem, ofGetElapsedTimeMicros());
 
     fluidSystem.setCoolColor(coolColor);
     fluidSystem.setHotColor(hotColor);
@@ -151,7 +201,23 @@ void ofApp::update() {
     gravityRotation = gravityRotation.rotate(gravityRotationIncrement);
     fluidSystem.setGravityRotation(gravityRotation);
     
+    if (replayActive) {
+        frameReader.readFrame(replayFrame, fluidSystem);
+        replayFrame = (replayFrame + 1) % std::max(1, frameReader.getFrameCount());
+        return;
+    }
+    
+    if (domainDecomposition.isRunning()) {
+        if (!pauseActive || fluidSystem.nextFrameActive) {
+            domainDecomposition.step(fluidSystem);
+            fluidSystem.nextFrameActive = false;
+        }
+        frameRecorder.record(fluidSystem);
+        return;
+    }
+    
     fluidSystem.update();
+    frameRecorder.record(fluidSystem);
 }
 
 //--------------------------------------------------------------
@@ -164,18 +230,6 @@ void ofApp::draw(){
     blurFbo.begin();
     ofClear(0, 0, 0);
     
-    // begin svg export
-    if (fluidSystem.exportFrameActive) {
-        string filename = to_string(numberParticles) + "-" + ofGetTimestampString("%F") + ".svg";
-        ofBeginSaveScreenAsSVG(filename);
-        
-        ofSetColor(ofColor::black);
-        fluidSystem.setCoolColor(ofColor::black);
-        fluidSystem.setHotColor(ofColor::black);
-    } else {
-        ofBackground(backgroundColor);
-    }
-    
     // main draw
     ofBackground(backgroundColor);
     fluidSystem.draw();
@@ -201,13 +255,21 @@ void ofApp::draw(){
     systemFbo.end();
     systemFbo.draw(0, 0, ofGetWidth(), ofGetHeight());
     
-    // end svg export
+    if (sharedFramePublisher.isRunning()) {
+        systemFbo.readToPixels(publishPixels);
+        sharedFramePublisher.publish(fluidSystem, publishPixels.getNumChannels() == 4 ? publishPixels.getData() : nullptr);
+    }
+    
+    // svg export snapshots the particles and writes the file in the background
     if (fluidSystem.exportFrameActive) {
-        ofEndSaveScreenAsSVG();
+        string filename = to_string(numberParticles) + "-" + ofGetTimestampString("%F") + ".svg";
+        svgExporter.exportFrame(fluidSystem, ofToDataPath(filename), true);
         fluidSystem.exportFrameActive = false;
     }
 
+#ifdef TARGET_OSX
     individualTextureSyphonServer.publishTexture(&systemFbo.getTexture());
+#endif
     
     // guis
     gui.draw();
@@ -216,30 +278,15 @@ void ofApp::draw(){
     shaderGui.draw();
 
     std::stringstream strm;
-    strm << "fps: " << ofGetFrameRate();
-    ofSetWindowTitle(strm.str());
-}
-
-void ofApp::checkIncomingOsc() {
-    while(oscReceiver.hasWaitingMessages()) {
-        ofxOscMessage m;
-        oscReceiver.getNextMessage(m);
-        
-        if (m.getAddress() == "/simulateMouse") {
-            float x = ofMap(m.getArgAsFloat(0), -1.0, 1.0, 0, systemWidth);
-            float y = ofMap(m.getArgAsFloat(1), -1.0, 1.0, 0, systemHeight);
-            
-            fluidSystem.mouseInput(x, y, 0, simulateActive);
-        }
-        
-        if (m.getAddress() == "/simulateActive") {
-            if (m.getArgAsInt(0) == 1) {
-                simulateActive = true;
-            } else {
-                simulateActive = false;
-            }
-        }
+    strm << "fps: " << ofGetFrameRate() << " step: " << fluidSystem.stepMicros / 1000.0 << "ms";
+    strm << " lists: " << fluidSystem.getNeighborListBytes() / 1048576.0 << "MB";
+    if (fluidSystem.implicitViscosityActive) {
+        strm << " viscosity residual: " << fluidSystem.viscosityResidual;
+    }
+    if (svgExporter.isExporting()) {
+        strm << " exporting svg";
     }
+    ofSetWindowTitle(strm.str());
 }
 
 // keyboard functions
@@ -260,6 +307,50 @@ void ofApp::keyPressed(int key) {
         pauseActive = !pauseActive;
         fluidSystem.pause(pauseActive);
     }
+    
+    if(key == 'c') {
+        saveCheckpoint();
+    }
+    
+    if(key == 'l') {
+        loadCheckpoint();
+    }
+    
+    if(key == 'r') {
+        toggleRecording();
+    }
+    
+    if(key == 'y') {
+        toggleReplay();
+    }
+    
+    if(key == 'm') {
+        toggleDecomposition();
+    }
+    
+    if(key == 'v') {
+        verifyDecomposition();
+    }
+    
+    if(key == 'k') {
+        verifyCheckpoint();
+    }
+    
+    if(key == 'h') {
+        highViscosityPreset();
+    }
+    
+    if(key == 'f') {
+        renderFrame();
+    }
+    
+    if(key == 'b') {
+        verifyPostProcess();
+    }
+    
+    if(key == 'o') {
+        togglePublishing();
+    }
 }
 
 void ofApp::mouseDragged(int x, int y, int button) {
@@ -294,6 +385,7 @@ void ofApp::setDrawMode(int & drawMode) {
     // 2 = vectors
     // 3 = lines
     // 4 = points
+    // 5 = surface
     
     fluidSystem.setMode(drawMode);
 }
@@ -331,6 +423,107 @@ void ofApp::setNearPressureMultiplier(float & nearPressureMultiplier) {
     fluidSystem.setNearPressureMultiplier(nearPressureMultiplier);
 }
 
+void ofApp::setNeighborMode(int & neighborMode) {
+    // 0 = neighbor lists rebuilt every frame
+    // 1 = verlet lists with skin distance
+    // 2 = cell tiles
+    // 3 = streaming, no stored lists, not with the position based solver
+    // 4 = owned tiles, each stepped on its own
+    
+    fluidSystem.setNeighborMode(neighborMode);
+    syncNeighborMode();
+}
+
+void ofApp::syncNeighborMode() {
+    // the system refuses modes the solver cannot run with, show the one it took
+    if (neighborMode != fluidSystem.neighborMode) {
+        neighborMode = fluidSystem.neighborMode;
+    }
+}
+
+void ofApp::setVerletSkin(float & verletSkin) {
+    fluidSystem.setVerletSkin(verletSkin);
+}
+
+void ofApp::setTileCells(int & tileCells) {
+    fluidSystem.setTileCells(tileCells);
+}
+
+void ofApp::setIncrementalSort(bool & incrementalSort) {
+    fluidSystem.setIncrementalSort(incrementalSort);
+}
+
+void ofApp::setPairCache(bool & pairCache) {
+    fluidSystem.setPairCache(pairCache);
+}
+
+void ofApp::setSolverMode(int & solverMode) {
+    // 0 = explicit double density relaxation
+    // 1 = position based, iterated to the tolerance, rest density and relaxation are its own
+    
+    fluidSystem.setSolverMode(solverMode);
+    syncNeighborMode();
+}
+
+void ofApp::setSolverIterations(int & solverIterations) {
+    fluidSystem.setSolverIterations(solverIterations);
+}
+
+void ofApp::setSolverTolerance(float & solverTolerance) {
+    fluidSystem.setSolverTolerance(solverTolerance);
+}
+
+void ofApp::setSolverRestDensity(float & solverRestDensity) {
+    fluidSystem.setSolverRestDensity(solverRestDensity);
+}
+
+void ofApp::setSolverRelaxation(float & solverRelaxation) {
+    fluidSystem.setSolverRelaxation(solverRelaxation);
+}
+
+void ofApp::setViscosityStrength(float & viscosityStrength) {
+    fluidSystem.setViscosityStrength(getViscosityStrength(viscosityStrength));
+}
+
+float ofApp::getViscosityStrength(float viscosityLog) {
+    // the slider is logarithmic so water and honey both get usable travel, its bottom end is no viscosity
+    return viscosityLog <= VISCOSITY_LOG_MIN ? 0.0 : pow(10.0f, viscosityLog);
+}
+
+void ofApp::highViscosityPreset() {
+    // 8 sweeps settle within 0.01 of a converged solve at this strength, see the viscosity sweep
+    implicitViscosity = true;
+    viscosityIterations = 8;
+    viscosityStrength = 4.0;
+}
+
+void ofApp::setImplicitViscosity(bool & implicitViscosity) {
+    fluidSystem.setImplicitViscosity(implicitViscosity);
+}
+
+void ofApp::setViscosityIterations(int & viscosityIterations) {
+    fluidSystem.setViscosityIterations(viscosityIterations);
+}
+
+void ofApp::setForceField(int & forceField) {
+    // 0 = none
+    // 1 = wind
+    // 2 = swirl
+    // 3 = flow
+    
+    fluidSystem.setForceField(forceField);
+}
+
+void ofApp::setForceFieldStrength(float & forceFieldStrength) {
+    fluidSystem.setForceFieldStrength(forceFieldStrength);
+}
+
+void ofApp::setSeed(int & seed) {
+    // a new seed only means something from a fresh layout
+    fluidSystem.setSeed(seed);
+    fluidSystem.resetRandom();
+}
+
 void ofApp::setBoundsWidth(int & boundsWidth) {
     fluidSystem.setBoundsSize(ofVec3f(boundsWidth - borderOffset, boundsHeight - borderOffset, 0));}
 
@@ -373,10 +566,96 @@ void ofApp::setCircleBoundary(bool & circleBoundary) {
     fluidSystem.setCircleBoundary(circleBoundary);
 }
 
+void ofApp::setBoundaryShape(int & boundaryShape) {
+    // 0 = bounds or circle
+    // 1 = star
+    // 2 = mask image, bright pixels hold fluid
+    // 3 = text outline
+    
+    fluidSystem.setSdfBoundary(boundaryShape != 0);
+    
+    if (boundaryShape == 1) {
+        ofVec2f starCenter = ofVec2f(systemWidth * 0.5, systemHeight * 0.5);
+        float outerRadius = std::min(systemWidth, systemHeight) * 0.45;
+        
+        vector<ofVec2f> star;
+        for (int i = 0; i < 10; i++) {
+            float theta = i * TWO_PI / 10.0 - HALF_PI;
+            float starRadius = i % 2 == 0 ? outerRadius : outerRadius * 0.45;
+            star.push_back(starCenter + ofVec2f(cos(theta), sin(theta)) * starRadius);
+        }
+        fluidSystem.setBoundaryPolygons({ star });
+    } else if (boundaryShape == 2) {
+        ofPixels maskPixels;
+        if (ofLoadImage(maskPixels, "boundary.png")) {
+            fluidSystem.setBoundaryMask(maskPixels);
+        } else {
+            ofLogError("ofApp") << "could not load boundary.png";
+        }
+    } else if (boundaryShape == 3) {
+        if (!boundaryFont.isLoaded()) {
+            boundaryFont.load("DankMono-Bold.ttf", 400, true, true, true);
+        }
+        
+        string text = "FLUID";
+        ofRectangle textBounds = boundaryFont.getStringBoundingBox(text, 0, 0);
+        float scale = systemWidth * 0.9 / textBounds.width;
+        ofVec2f offset = ofVec2f(systemWidth * 0.5, systemHeight * 0.5) - ofVec2f(textBounds.x + textBounds.width * 0.5, textBounds.y + textBounds.height * 0.5) * scale;
+        
+        vector<vector<ofVec2f>> polygons;
+        for (ofPath &path : boundaryFont.getStringAsPoints(text)) {
+            for (ofPolyline &outline : path.getOutline()) {
+                vector<ofVec2f> polygon;
+                for (auto &vertex : outline.getVertices()) {
+                    polygon.push_back(ofVec2f(vertex.x, vertex.y) * scale + offset);
+                }
+                polygons.push_back(polygon);
+            }
+        }
+        fluidSystem.setBoundaryPolygons(polygons);
+    }
+}
+
+void ofApp::setEmitterRate(float & emitterRate) {
+    // a jet in the upper left, rate is in particles per step
+    FluidSystem2D::Emitter emitter;
+    emitter.position = ofVec2f(systemWidth * 0.15, systemHeight * 0.2);
+    emitter.velocity = ofVec2f(200.0, 0.0);
+    emitter.radius = 20.0;
+    emitter.rate = emitterRate;
+    
+    if (emitterRate > 0.0) {
+        fluidSystem.setEmitters({ emitter });
+    } else {
+        fluidSystem.setEmitters({});
+    }
+}
+
+void ofApp::setSinkRadius(float & sinkRadius) {
+    // a drain in the lower right
+    FluidSystem2D::Sink sink;
+    sink.position = ofVec2f(systemWidth * 0.85, systemHeight * 0.85);
+    sink.radius = sinkRadius;
+    
+    if (sinkRadius > 0.0) {
+        fluidSystem.setSinks({ sink });
+    } else {
+        fluidSystem.setSinks({});
+    }
+}
+
 void ofApp::setLineThickness(float & lineThickness) {
     fluidSystem.setLineThickness(lineThickness);
 }
 
+void ofApp::setSurfaceThreshold(float & surfaceThreshold) {
+    fluidSystem.setSurfaceThreshold(surfaceThreshold);
+}
+
+void ofApp::setSurfaceResolution(float & surfaceResolution) {
+    fluidSystem.setSurfaceResolution(surfaceResolution);
+}
+
 void ofApp::resetRandom() {
     fluidSystem.resetRandom();
 }
@@ -385,6 +664,141 @@ void ofApp::resetGrid() {
     fluidSystem.resetGrid(1.0);
 }
 
+void ofApp::saveCheckpoint() {
+    if (!fluidSystem.saveCheckpoint(ofToDataPath("checkpoint.bin"))) {
+        ofLogError("ofApp") << "could not save checkpoint";
+    }
+}
+
+void ofApp::loadCheckpoint() {
+    if (!fluidSystem.loadCheckpoint(ofToDataPath("checkpoint.bin"))) {
+        ofLogError("ofApp") << "could not load checkpoint";
+        return;
+    }
+    
+    // bring the gui in line with the loaded settings, the listeners just set the same values again
+    numberParticles = fluidSystem.aliveCount;
+    influenceRadius = fluidSystem.radius;
+    timeScalar = 1.0 / 60.0 / fluidSystem.deltaTime;
+    gravityMultiplier = fluidSystem.gravityMultiplier;
+    targetDensity = fluidSystem.targetDensity;
+    pressureMultiplier = fluidSystem.pressureMultiplier;
+    nearPressureMultiplier = fluidSystem.nearPressureMultiplier;
+    viscosityStrength = fluidSystem.viscosityStrength > 0.0 ? std::max(float(log10(fluidSystem.viscosityStrength)), VISCOSITY_LOG_MIN) : VISCOSITY_LOG_MIN;
+    neighborMode = fluidSystem.neighborMode;
+    verletSkin = fluidSystem.verletSkin;
+    tileCells = fluidSystem.tileCells;
+    incrementalSort = fluidSystem.incrementalSortActive;
+    pairCache = fluidSystem.pairCacheActive;
+    solverMode = fluidSystem.solverMode;
+    solverIterations = fluidSystem.solverIterations;
+    solverTolerance = fluidSystem.solverTolerance;
+    solverRestDensity = fluidSystem.solverRestDensity;
+    implicitViscosity = fluidSystem.implicitViscosityActive;
+    viscosityIterations = fluidSystem.viscosityIterations;
+    circleBoundary = fluidSystem.circleBoundaryActive;
+    
+    if (fluidSystem.gravityMultiplier > 0.0) {
+        gravityRotation = fluidSystem.gravityForce / fluidSystem.gravityMultiplier;
+    }
+}
+
+void ofApp::verifyCheckpoint() {
+    Boolean identical = fluidSystem.verifyCheckpoint(ofToDataPath("checkpoint-verify.bin"));
+    ofLogNotice("ofApp") << "checkpoint round trip " << (identical ? "identical" : "differs");
+}
+
+void ofApp::toggleRecording() {
+    if (frameRecorder.isRecording()) {
+        frameRecorder.stop();
+        ofLogNotice("ofApp") << "recorded " << frameRecorder.getRecordedFrames() << " frames, dropped " << frameRecorder.getDroppedFrames();
+    } else if (!frameRecorder.start(ofToDataPath("recording.frames"), RECORDING_DELTA, 30)) {
+        ofLogError("ofApp") << "could not start recording";
+    }
+}
+
+void ofApp::toggleReplay() {
+    if (replayActive) {
+        replayActive = false;
+        frameReader.close();
+        return;
+    }
+    
+    if (frameRecorder.isRecording()) {
+        frameRecorder.stop();
+    }
+    
+    if (!frameReader.open(ofToDataPath("recording.frames")) || frameReader.getFrameCount() == 0) {
+        ofLogError("ofApp") << "could not open recording";
+        return;
+    }
+    
+    replayFrame = 0;
+    replayActive = true;
+}
+
+void ofApp::toggleDecomposition() {
+    if (domainDecomposition.isRunning()) {
+        domainDecomposition.stop();
+        return;
+    }
+    
+    int numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    if (!domainDecomposition.start(fluidSystem, numWorkers)) {
+        ofLogError("ofApp") << "could not start the domain decomposition";
+        return;
+    }
+    ofLogNotice("ofApp") << "stepping on " << domainDecomposition.getNumWorkers() << " worker processes";
+}
+
+void ofApp::verifyDecomposition() {
+    if (!domainDecomposition.isRunning()) return;
+    
+    float difference = domainDecomposition.verify(fluidSystem, 60);
+    ofLogNotice("ofApp") << "decomposed vs single process after 60 steps, max position difference " << difference;
+}
+
+void ofApp::renderFrame() {
+    splatRenderer.setBackground(backgroundColor);
+    splatRenderer.render(fluidSystem);
+    
+    // the shader settings, applied on the cpu
+    postProcess.setBlurMix(blurMix);
+    postProcess.setBlurQuality(blurQuality);
+    postProcess.setBlurAngles(blurAngles);
+    postProcess.setBlurRadius(blurRadius);
+    postProcess.setContrastAmount(contrastAmount);
+    postProcess.process(splatRenderer.getPixels(), splatRenderer.getWidth(), splatRenderer.getHeight());
+    
+    string filename = to_string(numberParticles) + "-" + ofGetTimestampString("%F") + ".png";
+    if (!splatRenderer.savePng(ofToDataPath(filename))) {
+        ofLogError("ofApp") << "could not save " << filename;
+    }
+}
+
+void ofApp::verifyPostProcess() {
+    // a frame and the shaders' output for it under data/postprocess, both modes are logged against each
+    if (!PostProcess::verifyReferences(ofToDataPath("postprocess"))) {
+        ofLogError("ofApp") << "could not read the post process references";
+    }
+}
+
+void ofApp::togglePublishing() {
+    if (sharedFramePublisher.isRunning()) {
+        sharedFramePublisher.stop();
+        return;
+    }
+    
+    if (!sharedFramePublisher.start(SHARED_FRAMES_NAME, fluidSystem.particles.size(), systemWidth, systemHeight, 4)) {
+        ofLogError("ofApp") << "could not start publishing";
+        return;
+    }
+    ofLogNotice("ofApp") << "publishing to " << SHARED_FRAMES_NAME;
+}
+
 void ofApp::exit(){
     // idk something
+    frameRecorder.stop();
+    domainDecomposition.stop();
+    sharedFramePublisher.stop();
 }
@@ -3,18 +3,28 @@
 #include "ofMain.h"
 #include "ofxGui.h"
 #include "ofxOsc.h"
+#ifdef TARGET_OSX
 #include "ofxSyphon.h"
+#endif
 
 #include "FluidSystem2D.hpp"
 #include "FluidSystem3D.hpp"
+#include "FrameRecorder.hpp"
+#include "FrameReader.hpp"
+#include "SvgExporter.hpp"
+#include "SplatRenderer.hpp"
+#include "PostProcess.hpp"
+#include "SharedFramePublisher.hpp"
+#include "OscInput.hpp"
+#include "DomainDecomposition.hpp"
 
 #define RECEIVING_PORT 5432
+#define VISCOSITY_LOG_MIN -3.0f
 
 class ofApp : public ofBaseApp{
 public:
     void setup() override;
     void update() override;
-    void checkIncomingOsc();
     void draw() override;
     void exit() override;
     
@@ -25,8 +35,27 @@ public:
     void windowResized(int w, int h) override;
 private:
     FluidSystem2D fluidSystem;
+    
+    // recording and replay of particle frames
+    FrameRecorder frameRecorder;
+    FrameReader frameReader;
+    Boolean replayActive;
+    int replayFrame;
+    
+    SvgExporter svgExporter;
+    
+    // software rendered frames, the same pipeline runs on machines without a gpu
+    SplatRenderer splatRenderer;
+    PostProcess postProcess;
+    
+    // every step and frame published to shared memory for local consumers
+    SharedFramePublisher sharedFramePublisher;
+    ofPixels publishPixels;
     ofEasyCam cam;
     
+    // strips of the bounds stepped by worker processes
+    DomainDecomposition domainDecomposition;
+    
     ofShader blur;
     ofShader bloom;
     ofShader contrast;
@@ -35,8 +64,10 @@ private:
     ofFbo bloomFbo;
     ofFbo contrastFbo;
 
+#ifdef TARGET_OSX
     ofxSyphonServer individualTextureSyphonServer;
-    ofxOscReceiver oscReceiver;
+#endif
+    OscInput oscInput;
     ofFbo systemFbo;
     
     ofxPanel gui, coolColorGui, hotColorGui, shaderGui;
@@ -51,6 +82,19 @@ private:
     ofParameter<float> targetDensity;
     ofParameter<float> pressureMultiplier;
     ofParameter<float> nearPressureMultiplier;
+    ofParameter<int> neighborMode;
+    ofParameter<float> verletSkin;
+    ofParameter<int> tileCells;
+    ofParameter<bool> incrementalSort;
+    ofParameter<bool> pairCache;
+    ofParameter<int> solverMode, solverIterations;
+    ofParameter<float> solverTolerance, solverRestDensity, solverRelaxation;
+    ofParameter<float> viscosityStrength;
+    ofParameter<bool> implicitViscosity;
+    ofParameter<int> viscosityIterations;
+    ofParameter<int> seed;
+    ofParameter<int> forceField;
+    ofParameter<float> forceFieldStrength;
     
     ofParameter<int> boundsWidth, boundsHeight;
     ofParameter<int> borderOffset;
@@ -61,8 +105,13 @@ private:
     
     ofParameter<float> mouseForce, mouseRadius;
     ofParameter<bool> circleBoundary;
+    ofParameter<int> boundaryShape;
+    ofParameter<float> emitterRate, sinkRadius;
+    ofTrueTypeFont boundaryFont;
 
     ofxFloatSlider lineThickness;
+    ofParameter<float> surfaceThreshold;
+    ofParameter<float> surfaceResolution;
     ofxFloatSlider centerX, centerY, gravityRotationIncrement;
     ofxFloatSlider blurQuality, blurAngles, blurRadius, blurMix;
     ofxFloatSlider contrastAmount;
@@ -75,7 +124,6 @@ private:
     float widthRatio, heightRatio;
     ofVec2f gravityRotation;
     Boolean pauseActive;
-    Boolean simulateActive;
     
     // keyboard functions
     void pause();
@@ -91,6 +139,25 @@ private:
     void setTargetDensity(float & targetDensity);
     void setPressureMultiplier(float & pressureMultiplier);
     void setNearPressureMultiplier(float & nearPressureMultiplier);
+    void setNeighborMode(int & neighborMode);
+    void setVerletSkin(float & verletSkin);
+    void setTileCells(int & tileCells);
+    void setIncrementalSort(bool & incrementalSort);
+    void setPairCache(bool & pairCache);
+    void setSolverMode(int & solverMode);
+    void setSolverIterations(int & solverIterations);
+    void setSolverTolerance(float & solverTolerance);
+    void setSolverRestDensity(float & solverRestDensity);
+    void setSolverRelaxation(float & solverRelaxation);
+    void syncNeighborMode();
+    void setViscosityStrength(float & viscosityStrength);
+    float getViscosityStrength(float viscosityLog);
+    void highViscosityPreset();
+    void setImplicitViscosity(bool & implicitViscosity);
+    void setViscosityIterations(int & viscosityIterations);
+    void setSeed(int & seed);
+    void setForceField(int & forceField);
+    void setForceFieldStrength(float & forceFieldStrength);
     void setCoolColor(ofColor & coolColor);
     void setHotColor(ofColor & hotColor);
     
@@ -99,6 +166,9 @@ private:
     void setBoundsHeight(int & boundsHeight);
     void setBorderOffset(int & borderOffset);
     void setCircleBoundary(bool & circleBoundary);
+    void setBoundaryShape(int & boundaryShape);
+    void setEmitterRate(float & emitterRate);
+    void setSinkRadius(float & sinkRadius);
     
     // gui graphic listener functions
     void setVelocityCurve(float & velocityCurve);
@@ -107,6 +177,8 @@ private:
     void setMinSize(float & minSize);
     void setMaxSize(float & maxSize);
     void setLineThickness(float & lineThickness);
+    void setSurfaceThreshold(float & surfaceThreshold);
+    void setSurfaceResolution(float & surfaceResolution);
     
     // gui mouse listener functions
     void setMouseRadius(float & mouseRadius);
@@ -115,4 +187,15 @@ private:
     void resetRandom();
     void resetGrid();
     void resetCircle();
+    
+    void saveCheckpoint();
+    void loadCheckpoint();
+    void verifyCheckpoint();
+    void toggleRecording();
+    void toggleReplay();
+    void toggleDecomposition();
+    void verifyDecomposition();
+    void renderFrame();
+    void verifyPostProcess();
+    void togglePublishing();
 };